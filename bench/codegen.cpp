@@ -0,0 +1,94 @@
+// Front-end throughput on a large synthetic program.
+//
+//   make bench            (or: ./bench/codegen.out [functions])
+
+#include "../src/driver.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+static std::string syntheticProgram(int functions)
+{
+    std::string source;
+    for (int i = 0; i < functions; ++i)
+    {
+        std::string n = std::to_string(i);
+        source += "func fn" + n + "(a, b) {\n";
+        source += "    num acc = 0;\n";
+        source += "    for (num i = 0; i < a; i++) {\n";
+        source += "        if (i > b) { acc = acc + i * " + n + "; } else { acc = acc - 1; }\n";
+        source += "    }\n";
+        source += "    while (acc > 100) { acc = acc / 2; }\n";
+        source += "    return acc;\n";
+        source += "}\n";
+    }
+    source += "num total = 0;\n";
+    for (int i = 0; i < functions; ++i)
+    {
+        source += "total = total + fn" + std::to_string(i) + "(10, 3);\n";
+    }
+    source += "print(total);\n";
+    return source;
+}
+
+template <typename F>
+static double millis(F &&body)
+{
+    auto start = std::chrono::steady_clock::now();
+    body();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    int functions = argc > 1 ? std::atoi(argv[1]) : 20000;
+    std::string source = syntheticProgram(functions);
+
+    std::vector<Token> tokens;
+    AST::StmtList ast;
+    OutputBuffer out;
+
+    double lexMs = millis([&]
+                          { tokens = Lexer(source).tokenize(); });
+    double parseMs = millis([&]
+                            { ast = Parser(tokens).parse(); });
+    double semaMs = millis([&]
+                           { Sema(ast).analyze(); });
+    double optMs = millis([&]
+                          { Optimizer(ast).optimize(); });
+    double genMs = millis([&]
+                          { Generator(ast).generate(out); });
+
+    ThreadPool pool;
+    OutputBuffer parallelOut;
+    double parallelMs = millis([&]
+                               { Generator(ast).generate(parallelOut, pool); });
+
+    std::cout << "input:    " << functions << " functions, " << source.size() / 1024 << " KiB\n";
+    std::cout << "lex:      " << lexMs << " ms\n";
+    std::cout << "parse:    " << parseMs << " ms\n";
+    std::cout << "sema:     " << semaMs << " ms\n";
+    std::cout << "optimize: " << optMs << " ms\n";
+    std::cout << "generate: " << genMs << " ms (" << out.size() / 1024 << " KiB, "
+              << (out.size() / 1048576.0) / (genMs / 1000.0) << " MiB/s)\n";
+    std::cout << "parallel: " << parallelMs << " ms on " << pool.size() << " threads"
+              << (parallelOut.str() == out.str() ? "" : " (OUTPUT DIFFERS)") << "\n";
+
+    // The generator's write pattern: many short pieces.
+    std::string code = out.str();
+    const size_t piece = 7;
+    std::stringstream ss;
+    OutputBuffer buffer;
+    double ssMs = millis([&]
+                         {
+        for (size_t i = 0; i < code.size(); i += piece)
+            ss << std::string_view(code).substr(i, piece); });
+    double bufMs = millis([&]
+                          {
+        for (size_t i = 0; i < code.size(); i += piece)
+            buffer << std::string_view(code).substr(i, piece); });
+
+    std::cout << "append:   stringstream " << ssMs << " ms, OutputBuffer " << bufMs << " ms\n";
+    return ss.str().size() == buffer.size() ? 0 : 1;
+}
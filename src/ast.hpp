@@ -1,6 +1,9 @@
 #pragma once
 
+#include <limits>
 #include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "tokens.hpp"
@@ -10,6 +13,35 @@ namespace AST
 
     struct Expr;
     struct Stmt;
+    struct FunctionStmt;
+
+    // Filled in by Sema; the generator maps these to C++ types.
+    enum class Type
+    {
+        Unknown,
+        Void,
+        Bool,
+        I32,
+        Int, // i64, or a num proven to hold only integers
+        F32,
+        Num, // f64
+        Str,
+        View, // str_view: part of a str that outlives it
+        Arr,
+        Task, // handle of a spawned call; its element is the call's result
+        Chan, // its element is the type of the values it carries
+        Gen   // a generator's stream; its element is the type it yields
+    };
+
+    // Values an integer expression can take, filled in by Sema. `fixed`
+    // marks declared i32/i64 values and bitwise results, which are
+    // fixed-width integers by definition.
+    struct Range
+    {
+        double low = -std::numeric_limits<double>::infinity();
+        double high = std::numeric_limits<double>::infinity();
+        bool fixed = false;
+    };
 
     using ExprPtr = std::unique_ptr<Expr>;
     using StmtPtr = std::unique_ptr<Stmt>;
@@ -19,6 +51,9 @@ namespace AST
     {
         virtual ~Expr() = default;
         int line;
+        Type type = Type::Unknown;
+        Type element = Type::Unknown; // of a task, chan or gen
+        Range range;                  // of an integer
         explicit Expr(int line) : line(line) {}
     };
 
@@ -62,11 +97,22 @@ namespace AST
     {
         std::string callee;
         std::vector<ExprPtr> args;
+        const FunctionStmt *target = nullptr; // null for builtins and external functions
 
         CallExpr(std::string callee, std::vector<ExprPtr> &&args, int line)
             : Expr(line), callee(std::move(callee)), args(std::move(args)) {}
     };
 
+    // array[index]; also an assignment target
+    struct IndexExpr : Expr
+    {
+        ExprPtr array;
+        ExprPtr index;
+
+        IndexExpr(ExprPtr array, ExprPtr index, int line)
+            : Expr(line), array(std::move(array)), index(std::move(index)) {}
+    };
+
     struct Stmt
     {
         virtual ~Stmt() = default;
@@ -88,6 +134,12 @@ namespace AST
         std::string type;
         std::string name;
         std::unique_ptr<Expr> initializer;
+        Type varType = Type::Unknown;
+        Type element = Type::Unknown; // of a task, chan or gen
+        // top-level variable read by a function or before its declaration;
+        // the others become locals of main()
+        bool global = false;
+        bool constant = false; // initializer made of literals alone
 
         VarDeclStmt(std::string type, std::string name,
                     std::unique_ptr<Expr> initializer, int line)
@@ -132,6 +184,14 @@ namespace AST
         ExprPtr condition;
         ExprPtr increment;
         StmtPtr body;
+        // Written as `pfor`: runs on the runtime's work-stealing pool, with
+        // the reductions named in its `reduce` clauses.
+        bool pfor = false;
+        // Filled in by the Parallelizer: the iterations are independent
+        // apart from these reductions (operator, variable).
+        bool parallel = false;
+        std::vector<std::pair<std::string, std::string>> reductions;
+        bool straightLine = false; // no loops or calls in the body
 
         ForStmt(StmtPtr initializer, ExprPtr condition, ExprPtr increment, StmtPtr body, int line)
             : Stmt(line), initializer(std::move(initializer)),
@@ -140,6 +200,18 @@ namespace AST
               body(std::move(body)) {}
     };
 
+    // for (name in iterable): the elements of an arr or gen, in order
+    struct ForInStmt : Stmt
+    {
+        std::string name;
+        ExprPtr iterable;
+        StmtPtr body;
+        Type varType = Type::Unknown;
+
+        ForInStmt(std::string name, ExprPtr iterable, StmtPtr body, int line)
+            : Stmt(line), name(std::move(name)), iterable(std::move(iterable)), body(std::move(body)) {}
+    };
+
     struct WhileStmt : Stmt
     {
         ExprPtr condition;
@@ -153,10 +225,20 @@ namespace AST
     {
         std::string name;
         std::vector<std::string> params;
+        std::vector<std::string> paramTypeNames; // "num" for untyped parameters
         StmtPtr body;
-
-        FunctionStmt(const std::string &name, std::vector<std::string> params, StmtPtr body, int line)
-            : Stmt(line), name(name), params(std::move(params)), body(std::move(body)) {}
+        std::vector<Type> paramTypes;
+        std::vector<Type> paramElements; // of task, chan and gen parameters
+        std::vector<bool> paramsAssigned; // by the function itself
+        Type returnType = Type::Unknown;
+        // Has a `yield`: a call returns a gen of yieldType.
+        bool generator = false;
+        Type yieldType = Type::Unknown;
+
+        FunctionStmt(const std::string &name, std::vector<std::string> params,
+                     std::vector<std::string> paramTypeNames, StmtPtr body, int line)
+            : Stmt(line), name(name), params(std::move(params)),
+              paramTypeNames(std::move(paramTypeNames)), body(std::move(body)) {}
     };
 
     struct ReturnStmt : Stmt
@@ -167,4 +249,14 @@ namespace AST
             : Stmt(line), value(std::move(value)) {}
     };
 
+    struct BreakStmt : Stmt
+    {
+        explicit BreakStmt(int line) : Stmt(line) {}
+    };
+
+    struct ContinueStmt : Stmt
+    {
+        explicit ContinueStmt(int line) : Stmt(line) {}
+    };
+
 }
\ No newline at end of file
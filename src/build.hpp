@@ -0,0 +1,238 @@
+#pragma once
+
+#include "driver.hpp"
+#include "incremental.hpp"
+#include "jobserver.hpp"
+#include "split.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+
+struct BuildOptions
+{
+    size_t jobs = 0; // 0 = hardware concurrency, or the jobserver limit under make
+    std::string outDir;
+    bool incremental = false; // per-function objects cached in <output>.cache/
+    size_t split = 0;         // >1: compile each program as this many units in parallel
+    CompileOptions compile;
+};
+
+/*
+`gvoid build`: translates many .gvd files on a thread pool and runs the
+backend compiler for each of them, at most `jobs` at a time.
+*/
+class BatchBuilder
+{
+public:
+    BatchBuilder(std::vector<std::string> sources, BuildOptions options)
+        : m_sources(std::move(sources)), m_options(std::move(options)) {}
+
+    // Expands directories into the .gvd files below them.
+    static std::vector<std::string> collectSources(const std::vector<std::string> &paths)
+    {
+        namespace fs = std::filesystem;
+        std::vector<std::string> sources;
+
+        for (const auto &path : paths)
+        {
+            if (!fs::is_directory(path))
+            {
+                sources.push_back(path);
+                continue;
+            }
+
+            std::vector<std::string> found;
+            for (const auto &entry : fs::recursive_directory_iterator(path))
+            {
+                if (entry.is_regular_file() && entry.path().extension() == ".gvd")
+                {
+                    found.push_back(entry.path().string());
+                }
+            }
+            std::sort(found.begin(), found.end());
+            sources.insert(sources.end(), found.begin(), found.end());
+        }
+
+        return sources;
+    }
+
+    int run()
+    {
+        using Clock = std::chrono::steady_clock;
+        auto start = Clock::now();
+
+        size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+        // an incremental build compiles any number of functions at once
+        size_t jobsPerSource = splitting() ? m_options.split + 1 : m_options.incremental ? hardware : 1;
+        size_t limit = m_options.jobs;
+        if (limit == 0)
+        {
+            // under make -jN the jobserver is the real limit
+            limit = m_jobServer.available() ? m_sources.size() * jobsPerSource : hardware;
+        }
+        if (!m_options.incremental)
+            limit = std::min(limit, m_sources.size() * jobsPerSource);
+        limit = std::max<size_t>(1, limit);
+
+        JobSlots slots(limit, m_jobServer);
+        ThreadPool frontPool(std::min(hardware, m_sources.size()));
+        ThreadPool backPool(std::min(limit, m_sources.size()));
+
+        std::vector<std::future<std::future<bool>>> pending;
+        for (const auto &source : m_sources)
+        {
+            pending.push_back(frontPool.submit([this, &source, &slots, &backPool]
+                                               { return buildOne(source, slots, backPool); }));
+        }
+
+        size_t succeeded = 0;
+        for (auto &front : pending)
+        {
+            auto back = front.get();
+            if (back.valid() && back.get())
+            {
+                succeeded++;
+            }
+        }
+
+        double total = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        std::cout << "Built " << succeeded << "/" << m_sources.size() << " files in "
+                  << std::fixed << std::setprecision(1) << total << " ms (-j " << limit
+                  << (m_jobServer.available() ? ", jobserver" : "") << ")\n";
+
+        return succeeded == m_sources.size() ? 0 : 1;
+    }
+
+private:
+    std::vector<std::string> m_sources;
+    BuildOptions m_options;
+    JobServer m_jobServer;
+    std::mutex m_reportMutex;
+
+    bool splitting() const
+    {
+        return m_options.split > 1 && !m_options.incremental;
+    }
+
+    std::string outputPath(const std::string &source) const
+    {
+        namespace fs = std::filesystem;
+        fs::path exe = fs::path(source).replace_extension("");
+        if (!m_options.outDir.empty())
+        {
+            exe = fs::path(m_options.outDir) / exe.filename();
+        }
+#ifdef _WIN32
+        exe.replace_extension(".exe");
+#endif
+        return exe.string();
+    }
+
+    // Runs the front end on the calling (pool) thread and hands the backend
+    // compile to `backPool`. An invalid future means the front end failed.
+    std::future<bool> buildOne(const std::string &source, JobSlots &slots, ThreadPool &backPool)
+    {
+        using Clock = std::chrono::steady_clock;
+        auto start = Clock::now();
+
+        auto ast = std::make_shared<AST::StmtList>();
+        OutputBuffer code;
+        try
+        {
+            std::string text;
+            if (!readSource(source, text))
+            {
+                throw std::runtime_error("cannot open file");
+            }
+            *ast = parseSource(text, m_options.compile);
+            if (!m_options.incremental && !splitting())
+            {
+                Generator generator(*ast, m_options.compile.optimize);
+                generator.generate(code);
+            }
+        }
+        catch (const std::runtime_error &error)
+        {
+            report(source, false, error.what(), 0, 0);
+            return {};
+        }
+
+        std::string exeFile = outputPath(source);
+        std::string cppFile = exeFile + ".cxx";
+        if (!m_options.incremental && !splitting() && !code.writeToFile(cppFile))
+        {
+            report(source, false, "cannot write " + cppFile, 0, 0);
+            return {};
+        }
+
+        double frontMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        return backPool.submit([this, source, ast, cppFile, exeFile, frontMs, &slots]
+                               {
+            auto start = std::chrono::steady_clock::now();
+
+            bool ok;
+            std::string detail = exeFile;
+            // both builders take a job slot per unit themselves
+            if (splitting())
+            {
+                SplitBuilder builder(exeFile + ".split", m_options.split, m_options.compile, slots);
+                std::string error;
+                ok = builder.build(*ast, exeFile, error);
+                if (!ok)
+                    detail = error;
+
+                double backMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                report(source, ok, detail, frontMs, backMs);
+                return ok;
+            }
+            if (m_options.incremental)
+            {
+                IncrementalBuilder builder(exeFile + ".cache", m_options.compile, slots);
+                std::string error;
+                ok = builder.build(*ast, exeFile, error);
+                detail = ok ? exeFile + ", " + std::to_string(builder.compiledUnits()) + "/" +
+                                  std::to_string(builder.totalUnits()) + " units rebuilt"
+                            : error;
+
+                double backMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                report(source, ok, detail, frontMs, backMs);
+                return ok;
+            }
+
+            auto slot = slots.acquire();
+            ok = runProcess(compilerCommand(cppFile, exeFile, m_options.compile)) == 0;
+            std::remove(cppFile.c_str());
+            if (!ok)
+                detail = m_options.compile.compiler + " failed";
+
+            auto end = std::chrono::steady_clock::now();
+            slots.release(slot);
+
+            double backMs = std::chrono::duration<double, std::milli>(end - start).count();
+            report(source, ok, detail, frontMs, backMs);
+            return ok; });
+    }
+
+    void report(const std::string &source, bool ok, const std::string &detail, double frontMs, double backMs)
+    {
+        std::lock_guard<std::mutex> lock(m_reportMutex);
+        auto &out = ok ? std::cout : std::cerr;
+        out << (ok ? "  ok    " : "  FAIL  ") << source;
+        if (ok)
+        {
+            out << " -> " << detail << std::fixed << std::setprecision(1)
+                << " (front " << frontMs << " ms, cc " << backMs << " ms)\n";
+        }
+        else
+        {
+            out << ": " << detail << "\n";
+        }
+    }
+};
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "sema.hpp"
+#include "optimizer.hpp"
+#include "parallel.hpp"
+#include "generator.hpp"
+#include <cerrno>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char **environ;
+#else
+#include <cstdlib>
+#endif
+
+struct CompileOptions
+{
+    std::string compiler = "g++";
+    std::string level = "-O2"; // backend optimization level, set with -O<level>
+    std::vector<std::string> flags;
+    bool openmp = true;   // parallelize loops (parallel.hpp) and build with -fopenmp
+    bool optimize = true; // fold and propagate constants (optimizer.hpp), run the IR passes (passes.hpp)
+
+    // Flags for every backend invocation.
+    std::vector<std::string> backendFlags() const
+    {
+        std::vector<std::string> all = {level};
+        all.insert(all.end(), flags.begin(), flags.end());
+        all.push_back("-pthread"); // for pfor's pool (runtime.hpp)
+        all.push_back("-fwrapv");  // i64 arithmetic and bitwise results wrap (sema.hpp)
+        if (openmp)
+            all.push_back("-fopenmp");
+        return all;
+    }
+};
+
+inline bool readSource(const std::string &path, std::string &source)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    source.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return true;
+}
+
+inline bool writeOutput(const std::string &path, const std::string &contents)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    file << contents;
+    return static_cast<bool>(file);
+}
+
+// Lexer -> Parser -> Sema -> Optimizer -> Parallelizer. Throws
+// std::runtime_error on syntax and semantic errors.
+inline AST::StmtList parseSource(const std::string &source, const CompileOptions &options = {})
+{
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    Parser parser(tokens);
+    auto ast = parser.parse();
+    Sema sema(ast);
+    sema.analyze();
+    if (options.optimize)
+    {
+        Optimizer optimizer(ast);
+        optimizer.optimize();
+    }
+    if (options.openmp)
+    {
+        Parallelizer parallelizer(ast);
+        parallelizer.parallelize();
+    }
+    return ast;
+}
+
+inline void translate(const std::string &source, OutputBuffer &out, const CompileOptions &options = {})
+{
+    auto ast = parseSource(source, options);
+    Generator generator(ast, options.optimize);
+    if (std::thread::hardware_concurrency() > 1 &&
+        generator.functions().size() >= Generator::PARALLEL_MIN_FUNCTIONS)
+    {
+        ThreadPool pool;
+        generator.generate(out, pool);
+    }
+    else
+    {
+        generator.generate(out);
+    }
+}
+
+inline std::vector<std::string> compilerCommand(const std::string &cppFile, const std::string &exeFile,
+                                                const CompileOptions &options)
+{
+    std::vector<std::string> argv = {options.compiler};
+    std::vector<std::string> flags = options.backendFlags();
+    argv.insert(argv.end(), flags.begin(), flags.end());
+    argv.push_back(cppFile);
+    argv.push_back("-o");
+    argv.push_back(exeFile);
+    return argv;
+}
+
+// Compiles one translation unit to an object file.
+inline std::vector<std::string> objectCommand(const std::string &cppFile, const std::string &objFile,
+                                              const CompileOptions &options)
+{
+    std::vector<std::string> argv = {options.compiler};
+    std::vector<std::string> flags = options.backendFlags();
+    argv.insert(argv.end(), flags.begin(), flags.end());
+    argv.push_back("-c");
+    argv.push_back(cppFile);
+    argv.push_back("-o");
+    argv.push_back(objFile);
+    return argv;
+}
+
+inline std::vector<std::string> linkCommand(const std::vector<std::string> &objFiles, const std::string &exeFile,
+                                            const CompileOptions &options)
+{
+    std::vector<std::string> argv = {options.compiler};
+    std::vector<std::string> flags = options.backendFlags();
+    argv.insert(argv.end(), flags.begin(), flags.end());
+    argv.insert(argv.end(), objFiles.begin(), objFiles.end());
+    argv.push_back("-o");
+    argv.push_back(exeFile);
+    return argv;
+}
+
+// Runs a program without going through the shell. Returns its exit status,
+// or -1 if it could not be started. If `outputFd` is given, the program's
+// stdout and stderr are redirected to it.
+inline int runProcess(const std::vector<std::string> &argv, int outputFd = -1)
+{
+#ifndef _WIN32
+    std::vector<char *> args;
+    for (const auto &arg : argv)
+    {
+        args.push_back(const_cast<char *>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (outputFd >= 0)
+    {
+        posix_spawn_file_actions_adddup2(&actions, outputFd, STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, outputFd, STDERR_FILENO);
+    }
+
+    pid_t pid;
+    int spawned = posix_spawnp(&pid, args[0], &actions, nullptr, args.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (spawned != 0)
+    {
+        return -1;
+    }
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) == -1)
+    {
+        if (errno != EINTR)
+            return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#else
+    std::string command;
+    for (const auto &arg : argv)
+    {
+        command += "\"" + arg + "\" ";
+    }
+    (void)outputFd;
+    return system(command.c_str());
+#endif
+}
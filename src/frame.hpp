@@ -0,0 +1,374 @@
+#pragma once
+
+#include "ast.hpp"
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+Where the variables of a generator live. A generator becomes a struct (its
+frame) whose next() jumps to the label after the last yield, so parameters
+and every variable whose scope has a yield after its declaration become
+members; the rest stay locals. Members are named after their variables,
+and numbered where scopes or top-level names would clash.
+*/
+class GeneratorFrame
+{
+public:
+    struct Member
+    {
+        std::string name;
+        AST::Type type;
+        AST::Type element;
+        const AST::ForInStmt *iterating = nullptr; // holds this loop's gen or temporary arr
+        bool index = false;                        // position of a for-in loop in an arr
+    };
+
+    // The members a for-in loop that yields keeps its place in.
+    struct Iteration
+    {
+        std::string variable;
+        std::string source; // the gen, or a temporary arr; empty for an arr variable
+        std::string index;  // position in an arr
+    };
+
+    std::vector<Member> members; // parameters first
+    std::vector<std::string> params;
+    std::unordered_map<const AST::VarDeclStmt *, std::string> declarations;
+    std::unordered_map<const AST::ForInStmt *, Iteration> iterations;
+    std::unordered_map<const AST::ForStmt *, std::vector<std::string>> reductions; // of a pfor
+    std::unordered_map<const AST::IdentifierExpr *, std::string> references;
+
+    GeneratorFrame(const AST::FunctionStmt &func, const AST::StmtList &program)
+    {
+        for (const char *name : {"next", "begin", "end", "value_type", "_state", "_out", "_frame"})
+        {
+            m_reserved.insert(name);
+        }
+        for (const auto &stmt : program)
+        {
+            if (auto varDecl = dynamic_cast<const AST::VarDeclStmt *>(stmt.get()))
+                m_reserved.insert(varDecl->name);
+            else if (auto other = dynamic_cast<const AST::FunctionStmt *>(stmt.get()))
+                m_reserved.insert(other->name);
+        }
+        for (const auto &param : func.params)
+        {
+            m_declared.insert(param);
+        }
+        collectNames(*func.body);
+
+        m_scopes.emplace_back();
+        for (size_t i = 0; i < func.params.size(); ++i)
+        {
+            params.push_back(declare(func.params[i], func.paramTypes[i], func.paramElements[i], true));
+        }
+        // the body block shares the parameter scope
+        if (auto block = dynamic_cast<const AST::BlockStmt *>(func.body.get()))
+            statements(block->statements);
+        else
+            walk(*func.body);
+        m_scopes.pop_back();
+    }
+
+    // Whether `stmt` has a yield anywhere in it.
+    static bool yields(const AST::Stmt &stmt)
+    {
+        if (auto exprStmt = dynamic_cast<const AST::ExprStmt *>(&stmt))
+        {
+            auto call = dynamic_cast<const AST::CallExpr *>(exprStmt->expr.get());
+            return call && call->callee == "yield" && !call->target;
+        }
+        if (auto block = dynamic_cast<const AST::BlockStmt *>(&stmt))
+        {
+            for (const auto &s : block->statements)
+            {
+                if (yields(*s))
+                    return true;
+            }
+            return false;
+        }
+        if (auto ifStmt = dynamic_cast<const AST::IfStmt *>(&stmt))
+            return yields(*ifStmt->thenBranch) || (ifStmt->elseBranch && yields(*ifStmt->elseBranch));
+        if (auto whileStmt = dynamic_cast<const AST::WhileStmt *>(&stmt))
+            return yields(*whileStmt->body);
+        if (auto forStmt = dynamic_cast<const AST::ForStmt *>(&stmt))
+            return yields(*forStmt->body);
+        if (auto forIn = dynamic_cast<const AST::ForInStmt *>(&stmt))
+            return yields(*forIn->body);
+        return false;
+    }
+
+private:
+    // source name -> member name, or empty for an ordinary local
+    std::vector<std::unordered_map<std::string, std::string>> m_scopes;
+    std::unordered_set<std::string> m_reserved; // top-level names and the frame's own
+    std::unordered_set<std::string> m_declared; // every variable name in the function
+    int m_plain = 0;                            // inside a pfor body, which runs in a lambda
+    int m_iterations = 0;
+
+    void collectNames(const AST::Stmt &stmt)
+    {
+        if (auto varDecl = dynamic_cast<const AST::VarDeclStmt *>(&stmt))
+        {
+            m_declared.insert(varDecl->name);
+        }
+        else if (auto block = dynamic_cast<const AST::BlockStmt *>(&stmt))
+        {
+            for (const auto &s : block->statements)
+            {
+                collectNames(*s);
+            }
+        }
+        else if (auto ifStmt = dynamic_cast<const AST::IfStmt *>(&stmt))
+        {
+            collectNames(*ifStmt->thenBranch);
+            if (ifStmt->elseBranch)
+                collectNames(*ifStmt->elseBranch);
+        }
+        else if (auto whileStmt = dynamic_cast<const AST::WhileStmt *>(&stmt))
+        {
+            collectNames(*whileStmt->body);
+        }
+        else if (auto forStmt = dynamic_cast<const AST::ForStmt *>(&stmt))
+        {
+            if (forStmt->initializer)
+                collectNames(*forStmt->initializer);
+            collectNames(*forStmt->body);
+        }
+        else if (auto forIn = dynamic_cast<const AST::ForInStmt *>(&stmt))
+        {
+            m_declared.insert(forIn->name);
+            collectNames(*forIn->body);
+        }
+    }
+
+    bool bound(const std::string &member) const
+    {
+        for (const auto &scope : m_scopes)
+        {
+            for (const auto &binding : scope)
+            {
+                if (binding.second == member)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    // A member for a variable in scope from here on: the variable's own
+    // name if that is free, else the first free numbered one. Members the
+    // frame adds for itself (`own`) avoid every variable name.
+    std::string allocate(const std::string &name, AST::Type type, AST::Type element, bool own = false)
+    {
+        for (int suffix = 1;; ++suffix)
+        {
+            std::string candidate = suffix == 1 ? name : name + "_" + std::to_string(suffix);
+            if (m_reserved.count(candidate) || ((own || suffix > 1) && m_declared.count(candidate)) ||
+                bound(candidate))
+                continue;
+
+            auto existing = std::find_if(members.begin(), members.end(), [&candidate](const Member &member)
+                                         { return member.name == candidate; });
+            if (existing == members.end())
+            {
+                members.push_back({candidate, type, element});
+                return candidate;
+            }
+            if (existing->type == type && existing->element == element)
+                return candidate;
+        }
+    }
+
+    // Binds `name` in the innermost scope; returns its member, if it gets one.
+    std::string declare(const std::string &name, AST::Type type, AST::Type element, bool member)
+    {
+        std::string memberName = member && m_plain == 0 ? allocate(name, type, element) : std::string();
+        m_scopes.back()[name] = memberName;
+        return memberName;
+    }
+
+    // A declaration needs a member if a later statement of its block yields.
+    void statements(const AST::StmtList &list)
+    {
+        for (size_t i = 0; i < list.size(); ++i)
+        {
+            auto varDecl = dynamic_cast<const AST::VarDeclStmt *>(list[i].get());
+            if (!varDecl)
+            {
+                walk(*list[i]);
+                continue;
+            }
+
+            bool spans = false;
+            for (size_t j = i + 1; j < list.size() && !spans; ++j)
+            {
+                spans = yields(*list[j]);
+            }
+            variable(*varDecl, spans);
+        }
+    }
+
+    void variable(const AST::VarDeclStmt &varDecl, bool spans)
+    {
+        if (varDecl.initializer)
+            walk(*varDecl.initializer);
+        std::string member = declare(varDecl.name, varDecl.varType, varDecl.element, spans);
+        if (!member.empty())
+            declarations[&varDecl] = member;
+    }
+
+    void scoped(const AST::Stmt &stmt)
+    {
+        m_scopes.emplace_back();
+        walk(stmt);
+        m_scopes.pop_back();
+    }
+
+    void walk(const AST::Stmt &stmt)
+    {
+        if (auto varDecl = dynamic_cast<const AST::VarDeclStmt *>(&stmt))
+        {
+            variable(*varDecl, false);
+        }
+        else if (auto exprStmt = dynamic_cast<const AST::ExprStmt *>(&stmt))
+        {
+            walk(*exprStmt->expr);
+        }
+        else if (auto block = dynamic_cast<const AST::BlockStmt *>(&stmt))
+        {
+            m_scopes.emplace_back();
+            statements(block->statements);
+            m_scopes.pop_back();
+        }
+        else if (auto ifStmt = dynamic_cast<const AST::IfStmt *>(&stmt))
+        {
+            walk(*ifStmt->condition);
+            scoped(*ifStmt->thenBranch);
+            if (ifStmt->elseBranch)
+                scoped(*ifStmt->elseBranch);
+        }
+        else if (auto whileStmt = dynamic_cast<const AST::WhileStmt *>(&stmt))
+        {
+            walk(*whileStmt->condition);
+            scoped(*whileStmt->body);
+        }
+        else if (auto forStmt = dynamic_cast<const AST::ForStmt *>(&stmt))
+        {
+            forLoop(*forStmt);
+        }
+        else if (auto forIn = dynamic_cast<const AST::ForInStmt *>(&stmt))
+        {
+            forInLoop(*forIn);
+        }
+        else if (auto ret = dynamic_cast<const AST::ReturnStmt *>(&stmt))
+        {
+            if (ret->value)
+                walk(*ret->value);
+        }
+    }
+
+    void forLoop(const AST::ForStmt &loop)
+    {
+        if (loop.pfor)
+        {
+            std::vector<std::string> names;
+            for (const auto &reduction : loop.reductions)
+            {
+                std::string member = lookup(reduction.second);
+                names.push_back(member.empty() ? reduction.second : member);
+            }
+            reductions[&loop] = std::move(names);
+            m_plain++;
+        }
+
+        m_scopes.emplace_back();
+        if (auto init = dynamic_cast<const AST::VarDeclStmt *>(loop.initializer.get()))
+            variable(*init, yields(*loop.body));
+        else if (loop.initializer)
+            walk(*loop.initializer);
+        if (loop.condition)
+            walk(*loop.condition);
+        if (loop.increment)
+            walk(*loop.increment);
+        scoped(*loop.body);
+        m_scopes.pop_back();
+
+        if (loop.pfor)
+            m_plain--;
+    }
+
+    void forInLoop(const AST::ForInStmt &loop)
+    {
+        walk(*loop.iterable);
+        bool spans = m_plain == 0 && yields(*loop.body);
+
+        m_scopes.emplace_back();
+        std::string variable = declare(loop.name, loop.varType, AST::Type::Unknown, spans);
+        if (spans)
+        {
+            Iteration iteration;
+            iteration.variable = variable;
+            std::string id = std::to_string(m_iterations++);
+            bool arrVariable = loop.iterable->type == AST::Type::Arr &&
+                               dynamic_cast<const AST::IdentifierExpr *>(loop.iterable.get());
+            if (!arrVariable)
+            {
+                iteration.source = allocate("_in" + id, loop.iterable->type, loop.iterable->element, true);
+                members.back().iterating = &loop;
+            }
+            if (loop.iterable->type == AST::Type::Arr)
+            {
+                iteration.index = allocate("_i" + id, AST::Type::Unknown, AST::Type::Unknown, true);
+                members.back().index = true;
+            }
+            iterations[&loop] = iteration;
+        }
+        scoped(*loop.body);
+        m_scopes.pop_back();
+    }
+
+    std::string lookup(const std::string &name) const
+    {
+        for (auto it = m_scopes.rbegin(); it != m_scopes.rend(); ++it)
+        {
+            auto found = it->find(name);
+            if (found != it->end())
+                return found->second;
+        }
+        return std::string();
+    }
+
+    void walk(const AST::Expr &expr)
+    {
+        if (auto ident = dynamic_cast<const AST::IdentifierExpr *>(&expr))
+        {
+            std::string member = lookup(ident->name);
+            if (!member.empty())
+                references[ident] = member;
+        }
+        else if (auto unary = dynamic_cast<const AST::UnaryExpr *>(&expr))
+        {
+            walk(*unary->right);
+        }
+        else if (auto binary = dynamic_cast<const AST::BinaryExpr *>(&expr))
+        {
+            walk(*binary->left);
+            walk(*binary->right);
+        }
+        else if (auto call = dynamic_cast<const AST::CallExpr *>(&expr))
+        {
+            for (const auto &arg : call->args)
+            {
+                walk(*arg);
+            }
+        }
+        else if (auto index = dynamic_cast<const AST::IndexExpr *>(&expr))
+        {
+            walk(*index->array);
+            walk(*index->index);
+        }
+    }
+};
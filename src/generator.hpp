@@ -3,216 +3,546 @@
 #include "ast.hpp"
 #include "parser.hpp"
 #include "tokens.hpp"
-#include <sstream>
+#include "output.hpp"
+#include "locals.hpp"
+#include "passes.hpp"
+#include "frame.hpp"
+#include "runtime.hpp"
+#include "threadpool.hpp"
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
 #include <algorithm>
 
 class Generator
 {
 public:
-    explicit Generator(const AST::StmtList &statements)
-        : m_statements(statements) {}
+    // Fewer functions than this are generated on the calling thread.
+    static constexpr size_t PARALLEL_MIN_FUNCTIONS = 64;
+
+    // Expects an AST annotated by Sema. `optimize` runs the IR passes on the
+    // functions that are generated from the IR.
+    explicit Generator(const AST::StmtList &statements, bool optimize = true)
+        : m_statements(statements), m_optimize(optimize) {}
 
     std::string generate()
     {
-        std::stringstream ss;
+        OutputBuffer out;
+        generate(out);
+        return out.str();
+    }
 
-        ss << "#include <iostream>\n";
-        ss << "#include <vector>\n";
-        ss << "#include <string>\n";
-        ss << "#include <unordered_map>\n";
-        ss << "#include <cmath>\n\n";
-        ss << "using namespace std;\n\n";
+    void generate(OutputBuffer &out)
+    {
+        generatePrelude(out);
+        generateForwardDeclarations(out);
+        generateGlobals(out, Linkage::Internal);
+        generateMain(out);
 
         for (const auto &stmt : m_statements)
         {
-            if (auto varDecl = dynamic_cast<const AST::VarDeclStmt *>(stmt.get()))
+            if (auto func = dynamic_cast<const AST::FunctionStmt *>(stmt.get()))
             {
-                ss << mapType(varDecl->type) << " " << varDecl->name;
-                if (varDecl->initializer)
+                generateFunction(*func, out);
+            }
+        }
+    }
+
+    /*
+    Same output as generate(out), but function bodies are generated on
+    `pool`. All types are already on the AST, so the workers share nothing
+    mutable; batches are appended in source order.
+    */
+    void generate(OutputBuffer &out, ThreadPool &pool)
+    {
+        std::vector<const AST::FunctionStmt *> functions = this->functions();
+        if (functions.size() < PARALLEL_MIN_FUNCTIONS || pool.size() < 2)
+        {
+            generate(out);
+            return;
+        }
+
+        generatePrelude(out);
+        generateForwardDeclarations(out);
+        generateGlobals(out, Linkage::Internal);
+        generateMain(out);
+
+        size_t batches = std::min(functions.size(), pool.size() * 4);
+        size_t batchSize = (functions.size() + batches - 1) / batches;
+
+        std::vector<std::future<OutputBuffer>> parts;
+        for (size_t first = 0; first < functions.size(); first += batchSize)
+        {
+            size_t last = std::min(first + batchSize, functions.size());
+            parts.push_back(pool.submit([this, &functions, first, last]
+                                        {
+                Generator worker(m_statements, m_optimize);
+                OutputBuffer part;
+                for (size_t i = first; i < last; ++i)
                 {
-                    ss << " = ";
-                    generateExpr(*varDecl->initializer, ss);
+                    worker.generateFunction(*functions[i], part);
                 }
-                ss << ";\n";
-            }
-            else if (auto func = dynamic_cast<const AST::FunctionStmt *>(stmt.get()))
+                return part; }));
+        }
+
+        for (auto &part : parts)
+        {
+            out << part.get();
+        }
+    }
+
+    /*
+    Split output for separate compilation: one shared header with every
+    function prototype and `extern` global, one unit holding the globals and
+    main(), and one unit per function.
+    */
+    std::string generateHeader()
+    {
+        OutputBuffer out;
+        out << "#pragma once\n";
+        generatePrelude(out);
+        generateForwardDeclarations(out);
+        generateGlobals(out, Linkage::Declaration);
+        return out.str();
+    }
+
+    std::string generateMainUnit(const std::string &headerName)
+    {
+        OutputBuffer out;
+        out << "#include \"" << headerName << "\"\n\n";
+        generateGlobals(out, Linkage::External);
+        generateMain(out);
+        return out.str();
+    }
+
+    std::string generateFunctionUnit(const AST::FunctionStmt &func, const std::string &headerName)
+    {
+        return "#include \"" + headerName + "\"\n\n" + generateFunctionDefinition(func);
+    }
+
+    std::string generateFunctionDefinition(const AST::FunctionStmt &func)
+    {
+        OutputBuffer out;
+        generateFunction(func, out);
+        return out.str();
+    }
+
+    // The top-level functions, in source order.
+    std::vector<const AST::FunctionStmt *> functions() const
+    {
+        std::vector<const AST::FunctionStmt *> functions;
+        for (const auto &stmt : m_statements)
+        {
+            if (auto func = dynamic_cast<const AST::FunctionStmt *>(stmt.get()))
             {
-                ss << m_functionReturnTypes[func->name] << " " << func->name << "(";
-                ss << ");\n";
+                functions.push_back(func);
             }
         }
+        return functions;
+    }
+
+    // Prototype or extern declaration of a top-level name, as it appears in
+    // the header; empty if the name is not declared at file scope.
+    std::string declarationOf(const std::string &name) const
+    {
+        auto it = m_declarations.find(name);
+        return it != m_declarations.end() ? it->second : std::string();
+    }
+
+private:
+
+    const AST::StmtList &m_statements;
+    bool m_optimize;
+    std::unordered_map<std::string, std::string> m_declarations;
+    const IR::Locals *m_locals = nullptr; // of the function in generateIR
+    const GeneratorFrame *m_frame = nullptr; // of the generator in generateGenerator
+    int m_resumePoints = 0;                  // yields generated so far in it
 
-        ss << "int main() {\n";
+    void generatePrelude(OutputBuffer &out)
+    {
+        out << "#include <iostream>\n";
+        out << "#include <vector>\n";
+        out << "#include <string>\n";
+        out << "#include <unordered_map>\n";
+        out << "#include <cmath>\n";
+        out << "#include <cstdint>\n\n";
 
+        RuntimeUse use;
         for (const auto &stmt : m_statements)
         {
-            if (dynamic_cast<const AST::VarDeclStmt *>(stmt.get()))
+            use.scan(*stmt);
+        }
+        if (use.pool || use.tasks)
+            out << Runtime::THREADS << "\n";
+        if (use.pool)
+            out << Runtime::WORK_STEALING << "\n";
+        if (use.tasks)
+            out << Runtime::TASKS << "\n";
+        if (use.generators || use.files || use.text)
+            out << Runtime::GENERATORS << "\n";
+        if (use.format || use.output || use.input)
+            out << Runtime::FORMAT << "\n";
+        if (use.output || use.input)
+            out << Runtime::OUTPUT << "\n";
+        if (use.input)
+            out << Runtime::INPUT << "\n";
+        if (use.files)
+            out << Runtime::FILES << "\n";
+        if (use.text)
+            out << Runtime::TEXT << "\n";
+        out << "using namespace std;\n\n";
+    }
+
+    // Which parts of the runtime a program needs.
+    struct RuntimeUse
+    {
+        bool pool = false;  // pfor loops
+        bool tasks = false; // tasks and chans
+        bool generators = false;
+        bool output = false; // print
+        bool format = false; // str + num
+        bool input = false;
+        bool files = false;
+        bool text = false; // substr, find, split
+
+        void scan(const AST::Stmt &stmt)
+        {
+            if (auto varDecl = dynamic_cast<const AST::VarDeclStmt *>(&stmt))
+            {
+                handle(varDecl->varType);
+                if (varDecl->initializer)
+                    scan(*varDecl->initializer);
+            }
+            else if (auto exprStmt = dynamic_cast<const AST::ExprStmt *>(&stmt))
             {
+                scan(*exprStmt->expr);
             }
-            else if (dynamic_cast<const AST::FunctionStmt *>(stmt.get()))
+            else if (auto block = dynamic_cast<const AST::BlockStmt *>(&stmt))
             {
+                for (const auto &s : block->statements)
+                    scan(*s);
             }
-            else
+            else if (auto ifStmt = dynamic_cast<const AST::IfStmt *>(&stmt))
+            {
+                scan(*ifStmt->condition);
+                scan(*ifStmt->thenBranch);
+                if (ifStmt->elseBranch)
+                    scan(*ifStmt->elseBranch);
+            }
+            else if (auto whileStmt = dynamic_cast<const AST::WhileStmt *>(&stmt))
+            {
+                scan(*whileStmt->condition);
+                scan(*whileStmt->body);
+            }
+            else if (auto forStmt = dynamic_cast<const AST::ForStmt *>(&stmt))
             {
-                generateStatement(*stmt, ss);
+                pool = pool || forStmt->pfor;
+                if (forStmt->initializer)
+                    scan(*forStmt->initializer);
+                if (forStmt->condition)
+                    scan(*forStmt->condition);
+                if (forStmt->increment)
+                    scan(*forStmt->increment);
+                scan(*forStmt->body);
+            }
+            else if (auto forIn = dynamic_cast<const AST::ForInStmt *>(&stmt))
+            {
+                scan(*forIn->iterable);
+                scan(*forIn->body);
+            }
+            else if (auto ret = dynamic_cast<const AST::ReturnStmt *>(&stmt))
+            {
+                if (ret->value)
+                    scan(*ret->value);
+            }
+            else if (auto func = dynamic_cast<const AST::FunctionStmt *>(&stmt))
+            {
+                generators = generators || func->generator;
+                for (AST::Type type : func->paramTypes)
+                    handle(type);
+                scan(*func->body);
             }
         }
 
-        ss << "    return 0;\n";
-        ss << "}\n";
-
-        for (const auto &stmt : m_statements)
+        // every use of a task, chan or gen has an expression of that type
+        void scan(const AST::Expr &expr)
         {
-            if (auto func = dynamic_cast<const AST::FunctionStmt *>(stmt.get()))
+            handle(expr.type);
+            if (auto binary = dynamic_cast<const AST::BinaryExpr *>(&expr))
+            {
+                format = format || isConcatenation(*binary);
+                scan(*binary->left);
+                scan(*binary->right);
+            }
+            else if (auto unary = dynamic_cast<const AST::UnaryExpr *>(&expr))
+            {
+                scan(*unary->right);
+            }
+            else if (auto call = dynamic_cast<const AST::CallExpr *>(&expr))
+            {
+                output = output || call->callee == "print";
+                format = format || isInterpolation(*call);
+                input = input || isInput(*call);
+                files = files || isFile(*call);
+                text = text || isText(*call);
+                for (const auto &arg : call->args)
+                    scan(*arg);
+            }
+            else if (auto index = dynamic_cast<const AST::IndexExpr *>(&expr))
             {
-                generateFunction(*func, ss);
+                scan(*index->array);
+                scan(*index->index);
             }
         }
 
-        return ss.str();
-    }
-
-private:
-    bool hasMainFunction = false;
-    const AST::StmtList &m_statements;
-    std::unordered_map<std::string, std::string> m_varTypes;
-    std::unordered_map<std::string, std::string> m_functionReturnTypes;
-    std::unordered_map<std::string, std::vector<std::pair<std::string, std::string>>> m_functionParams;
+        void handle(AST::Type type)
+        {
+            tasks = tasks || type == AST::Type::Task || type == AST::Type::Chan;
+            generators = generators || type == AST::Type::Gen;
+        }
+    };
 
-    void generateForwardDeclarations(std::stringstream &ss)
+    void generateForwardDeclarations(OutputBuffer &out)
     {
+        // a generator returns its frame, so the frames come first
+        std::unordered_map<std::string, std::string> frames;
+        for (const auto &stmt : m_statements)
+        {
+            auto func = dynamic_cast<const AST::FunctionStmt *>(stmt.get());
+            if (func && func->generator && !frames.count(func->name))
+                generateFrame(*func, frames, out);
+        }
+
         for (const auto &stmt : m_statements)
         {
             if (auto func = dynamic_cast<const AST::FunctionStmt *>(stmt.get()))
             {
-                if (func->name == "main")
-                {
-                    hasMainFunction = true;
-                }
-                std::string returnType = inferFunctionReturnType(*func);
-                m_functionReturnTypes[func->name] = returnType;
-
-                std::vector<std::pair<std::string, std::string>> params;
-                for (const auto &param : func->params)
-                {
-                    params.emplace_back("int", param);
-                }
-                m_functionParams[func->name] = params;
+                std::string decl = (func->generator ? frameName(*func) : mapType(func->returnType)) + " " +
+                                   func->name + "(";
 
-                ss << returnType << " " << func->name << "(";
                 for (size_t i = 0; i < func->params.size(); ++i)
                 {
-                    ss << "int " << func->params[i];
+                    decl += func->generator ? mapType(func->paramTypes[i], func->paramElements[i]) + " " + func->params[i]
+                                            : parameter(*func, i);
                     if (i != func->params.size() - 1)
                     {
-                        ss << ", ";
+                        decl += ", ";
                     }
                 }
-                ss << ");\n";
+                decl += ");\n";
+
+                m_declarations[func->name] = func->generator ? frames[func->name] + decl : decl;
+                out << decl;
             }
         }
-        ss << "\n";
+        out << "\n";
     }
 
-    std::string inferFunctionReturnType(const AST::FunctionStmt &func)
+    static std::string frameName(const AST::FunctionStmt &func)
     {
-        std::string returnType = "void";
+        return "_gen_" + func.name;
+    }
 
-        if (auto block = dynamic_cast<const AST::BlockStmt *>(func.body.get()))
+    /*
+    The struct of a generator's frame, after the frames it holds by value: a
+    for-in loop that yields keeps the frame of the generator it calls in a
+    member. If that generator's frame is still being laid out (it calls
+    back into this one), the member is a gvoid::Gen instead. `frames` gets
+    each frame's declaration, along with those of the frames it holds.
+    */
+    void generateFrame(const AST::FunctionStmt &func, std::unordered_map<std::string, std::string> &frames,
+                       OutputBuffer &out)
+    {
+        frames[func.name] = std::string(); // laid out from here on
+        GeneratorFrame frame(func, m_statements);
+
+        std::string held;
+        std::string decl = "struct " + frameName(func) + " : gvoid::Generator<" + frameName(func) + ", " +
+                           mapType(func.yieldType) + "> {\n";
+        for (const auto &member : frame.members)
         {
-            for (const auto &stmt : block->statements)
+            std::string type = member.index ? "size_t" : mapType(member.type, member.element);
+            auto call = member.iterating ? dynamic_cast<const AST::CallExpr *>(member.iterating->iterable.get())
+                                         : nullptr;
+            if (call && (isFile(*call) || isText(*call)))
             {
-                if (auto ret = dynamic_cast<const AST::ReturnStmt *>(stmt.get()))
+                type = call->callee == "lines" ? "gvoid::Lines" : "gvoid::Split";
+            }
+            else if (call && call->target && call->target->generator)
+            {
+                auto it = frames.find(call->callee);
+                if (it == frames.end())
                 {
-                    if (ret->value)
-                    {
-                        returnType = inferExprType(*ret->value);
-                    }
-                    break;
+                    generateFrame(*call->target, frames, out);
+                    it = frames.find(call->callee);
+                }
+                if (!it->second.empty())
+                {
+                    type = frameName(*call->target);
+                    held += it->second;
                 }
             }
+            decl += type + " " + member.name + "{};\n";
         }
+        decl += "int _state = 0;\n";
+        decl += "bool next(" + mapType(func.yieldType) + " &_out);\n";
+        decl += "};\n";
 
-        return returnType;
+        out << decl;
+        frames[func.name] = decl + held;
     }
 
-    std::string inferExprType(const AST::Expr &expr)
+    enum class Linkage
     {
-        if (auto literal = dynamic_cast<const AST::LiteralExpr *>(&expr))
-        {
-            if (literal->type == TokenType::STRING_LIT)
-                return "std::string";
-            if (literal->type == TokenType::NUMBER)
-                return "double";
-        }
-        else if (auto ident = dynamic_cast<const AST::IdentifierExpr *>(&expr))
+        Internal,    // single translation unit: static
+        External,    // definition shared with other units
+        Declaration, // extern, for the shared header
+    };
+
+    // Top-level variables used by functions live at file scope; the rest
+    // are locals of main(), where the backend can keep them in registers.
+    // A global made of literals is initialized before main() runs, as in
+    // C++; any other initializer runs in main() where it was written, as it
+    // may read main()'s locals, and until then the global is 0 (or empty).
+    void generateGlobals(OutputBuffer &out, Linkage linkage)
+    {
+        for (const auto &stmt : m_statements)
         {
-            if (m_varTypes.count(ident->name))
-                return m_varTypes[ident->name];
+            auto varDecl = dynamic_cast<const AST::VarDeclStmt *>(stmt.get());
+            if (varDecl && varDecl->global)
+            {
+                std::string cppType = mapType(varDecl->varType, varDecl->element);
+
+                if (linkage == Linkage::Declaration)
+                {
+                    std::string decl = "extern " + cppType + " " + varDecl->name + ";\n";
+                    m_declarations[varDecl->name] = decl;
+                    out << decl;
+                    continue;
+                }
+
+                if (linkage == Linkage::Internal)
+                    out << "static ";
+                out << cppType << " " << varDecl->name;
+                if (varDecl->constant)
+                {
+                    out << " = ";
+                    generateAs(*varDecl->initializer, varDecl->varType, out);
+                }
+                out << ";\n";
+            }
         }
-        else if (auto call = dynamic_cast<const AST::CallExpr *>(&expr))
+    }
+
+    void generateMain(OutputBuffer &out)
+    {
+        out << "int main() {\n";
+
+        for (const auto &stmt : m_statements)
         {
-            if (m_functionReturnTypes.count(call->callee))
+            auto varDecl = dynamic_cast<const AST::VarDeclStmt *>(stmt.get());
+            if (varDecl && varDecl->global)
+            {
+                if (varDecl->initializer && !varDecl->constant)
+                {
+                    out << varDecl->name << " = ";
+                    generateAs(*varDecl->initializer, varDecl->varType, out);
+                    out << ";\n";
+                }
+            }
+            else if (dynamic_cast<const AST::FunctionStmt *>(stmt.get()))
             {
-                return m_functionReturnTypes[call->callee];
+            }
+            else
+            {
+                generateStatement(*stmt, out);
             }
         }
 
-        return "int";
+        RuntimeUse use;
+        for (const auto &stmt : m_statements)
+        {
+            use.scan(*stmt);
+        }
+        if (use.tasks)
+            out << "gvoid::TaskPool::finish();\n";
+        out << "    return 0;\n";
+        out << "}\n";
     }
 
-    void generateStatement(const AST::Stmt &stmt, std::stringstream &ss)
+    void generateStatement(const AST::Stmt &stmt, OutputBuffer &out)
     {
         if (auto import = dynamic_cast<const AST::ImportStmt *>(&stmt))
         {
-            generateImport(*import, ss);
+            generateImport(*import, out);
         }
         else if (auto varDecl = dynamic_cast<const AST::VarDeclStmt *>(&stmt))
         {
-            generateVarDecl(*varDecl, ss);
+            generateVarDecl(*varDecl, out);
         }
         else if (auto func = dynamic_cast<const AST::FunctionStmt *>(&stmt))
         {
-            generateFunction(*func, ss);
+            generateFunction(*func, out);
         }
         else if (auto expr = dynamic_cast<const AST::ExprStmt *>(&stmt))
         {
-            generateExpr(*expr->expr, ss);
-            ss << ";\n";
+            auto call = dynamic_cast<const AST::CallExpr *>(expr->expr.get());
+            if (call && call->callee == "yield" && !call->target)
+            {
+                generateYield(*call, out);
+                return;
+            }
+            generateExpr(*expr->expr, out);
+            out << ";\n";
         }
         else if (auto block = dynamic_cast<const AST::BlockStmt *>(&stmt))
         {
-            ss << "{\n";
+            out << "{\n";
             for (const auto &s : block->statements)
             {
-                generateStatement(*s, ss);
+                generateStatement(*s, out);
             }
-            ss << "}\n";
+            out << "}\n";
         }
         else if (auto ifStmt = dynamic_cast<const AST::IfStmt *>(&stmt))
         {
-            generateIf(*ifStmt, ss);
+            generateIf(*ifStmt, out);
         }
         else if (auto forStmt = dynamic_cast<const AST::ForStmt *>(&stmt))
         {
-            generateFor(*forStmt, ss);
+            generateFor(*forStmt, out);
+        }
+        else if (auto forIn = dynamic_cast<const AST::ForInStmt *>(&stmt))
+        {
+            generateForIn(*forIn, out);
         }
         else if (auto whileStmt = dynamic_cast<const AST::WhileStmt *>(&stmt))
         {
-            generateWhile(*whileStmt, ss);
+            generateWhile(*whileStmt, out);
         }
         else if (auto ret = dynamic_cast<const AST::ReturnStmt *>(&stmt))
         {
-            ss << "return ";
+            if (m_frame)
+            {
+                out << "{\n_state = -1;\nreturn false;\n}\n";
+                return;
+            }
+            out << "return ";
             if (ret->value)
-                generateExpr(*ret->value, ss);
-            ss << ";\n";
+                generateAs(*ret->value, AST::Type::Str, out);
+            out << ";\n";
+        }
+        else if (dynamic_cast<const AST::BreakStmt *>(&stmt))
+        {
+            out << "break;\n";
+        }
+        else if (dynamic_cast<const AST::ContinueStmt *>(&stmt))
+        {
+            out << "continue;\n";
         }
     }
 
-    void generateImport(const AST::ImportStmt &import, std::stringstream &ss)
+    void generateImport(const AST::ImportStmt &import, OutputBuffer &out)
     {
         static const std::unordered_map<std::string, std::string> importMap = {
             {"io", "<iostream>"},
@@ -224,309 +554,1068 @@ private:
         auto it = importMap.find(import.moduleName);
         if (it != importMap.end())
         {
-            ss << "#include " << it->second << "\n";
+            out << "#include " << it->second << "\n";
         }
         else
         {
-            ss << "// (Import state is coming soon) Import: " << import.moduleName << "\n";
+            out << "// (Import state is coming soon) Import: " << import.moduleName << "\n";
         }
     }
 
-    void generateVarDecl(const AST::VarDeclStmt &varDecl, std::stringstream &ss)
+    void generateVarDecl(const AST::VarDeclStmt &varDecl, OutputBuffer &out)
     {
-        std::string cppType = mapType(varDecl.type);
-        ss << cppType << " " << varDecl.name;
+        if (m_frame && m_frame->declarations.count(&varDecl))
+        {
+            // declared in the frame; a loop comes back here for a fresh value
+            out << m_frame->declarations.at(&varDecl) << " = ";
+            if (varDecl.initializer)
+                generateExpr(*varDecl.initializer, out);
+            else
+                out << "{}";
+            out << ";\n";
+            return;
+        }
+
+        out << mapType(varDecl.varType, varDecl.element) << " " << varDecl.name;
 
         if (varDecl.initializer)
         {
-            ss << " = ";
-            generateExpr(*varDecl.initializer, ss);
+            out << " = ";
+            generateAs(*varDecl.initializer, varDecl.varType, out);
         }
-        ss << ";\n";
-        m_varTypes[varDecl.name] = cppType;
+        out << ";\n";
     }
 
-    std::string mapType(const std::string &type)
+    // Unknown types come from calls to external functions; like every num
+    // not proven integral they are taken to be double. `element` is that of
+    // a task, chan or gen.
+    static std::string mapType(AST::Type type, AST::Type element = AST::Type::Unknown)
     {
-        static const std::unordered_map<std::string, std::string> typeMap = {
-            {"num", "double"},
-            {"str", "std::string"},
-            {"arr", "std::vector<double>"},
-            {"bool", "bool"},
-            {"void", "void"}};
+        switch (type)
+        {
+        case AST::Type::Task:
+            return "gvoid::Task<" + mapType(element) + ">";
+        case AST::Type::Chan:
+            return "gvoid::Chan<" + mapType(element) + ">";
+        case AST::Type::Gen:
+            return "gvoid::Gen<" + mapType(element) + ">";
+        case AST::Type::Void:
+            return "void";
+        case AST::Type::Bool:
+            return "bool";
+        case AST::Type::I32:
+            return "int32_t";
+        case AST::Type::Int:
+            return "int64_t";
+        case AST::Type::F32:
+            return "float";
+        case AST::Type::Str:
+            return "std::string";
+        case AST::Type::View:
+            return "std::string_view";
+        case AST::Type::Arr:
+            return "std::vector<double>";
+        case AST::Type::Num:
+        default:
+            return "double";
+        }
+    }
 
-        auto it = typeMap.find(type);
-        if (it != typeMap.end())
+    void generateFunction(const AST::FunctionStmt &func, OutputBuffer &out)
+    {
+        if (func.generator)
         {
-            return it->second;
+            generateGenerator(func, out);
+            return;
         }
-        return type;
+
+        out << mapType(func.returnType) << " " << func.name << "(";
+
+        for (size_t i = 0; i < func.params.size(); ++i)
+        {
+            out << parameter(func, i);
+            if (i != func.params.size() - 1)
+            {
+                out << ", ";
+            }
+        }
+
+        out << ") ";
+
+        // Only functions of scalars are lowered to the IR; the rest (and
+        // main()) are emitted straight from the AST.
+        std::unique_ptr<IR::Function> ir;
+        try
+        {
+            ir = IR::Builder(func).build();
+        }
+        catch (const IR::Unsupported &)
+        {
+        }
+
+        if (ir)
+        {
+            if (m_optimize)
+                IR::PassManager::standard().run(*ir);
+            generateIR(*ir, out);
+        }
+        else
+        {
+            generateStatement(*func.body, out);
+        }
+        out << "\n";
     }
 
-    void generateFunction(const AST::FunctionStmt &func, std::stringstream &ss)
+    // A str parameter the function never assigns is taken by reference.
+    static std::string parameter(const AST::FunctionStmt &func, size_t i)
     {
-        std::string returnType = m_functionReturnTypes[func.name];
+        bool assigned = i >= func.paramsAssigned.size() || func.paramsAssigned[i];
+        if (func.paramTypes[i] == AST::Type::Str && !assigned)
+            return "const std::string &" + func.params[i];
+        return mapType(func.paramTypes[i], func.paramElements[i]) + " " + func.params[i];
+    }
 
-        ss << returnType << " " << func.name << "(";
+    /*
+    Calling a generator only fills in its frame. next() is the body, inside
+    a switch on the frame's state: a yield stores the value, saves the
+    number of the case label it places right after itself and returns, so
+    the next call jumps back in there. Variables that live across a yield
+    are members (see GeneratorFrame); a return, or the end of the body,
+    leaves the state at -1, which no label matches.
+    */
+    void generateGenerator(const AST::FunctionStmt &func, OutputBuffer &out)
+    {
+        GeneratorFrame frame(func, m_statements);
 
-        const auto &params = m_functionParams[func.name];
+        out << frameName(func) << " " << func.name << "(";
         for (size_t i = 0; i < func.params.size(); ++i)
         {
-            ss << params[i].first << " " << func.params[i];
+            out << mapType(func.paramTypes[i], func.paramElements[i]) << " " << func.params[i];
             if (i != func.params.size() - 1)
             {
-                ss << ", ";
+                out << ", ";
             }
         }
+        out << ") {\n";
+        out << frameName(func) << " _frame;\n";
+        for (size_t i = 0; i < func.params.size(); ++i)
+        {
+            out << "_frame." << frame.params[i] << " = " << func.params[i] << ";\n";
+        }
+        out << "return _frame;\n";
+        out << "}\n";
 
-        ss << ") ";
-        generateStatement(*func.body, ss);
-        ss << "\n";
+        out << "bool " << frameName(func) << "::next(" << mapType(func.yieldType) << " &_out) {\n";
+        out << "switch (_state) {\n";
+        out << "case 0:;\n";
+        m_frame = &frame;
+        m_resumePoints = 0;
+        if (auto block = dynamic_cast<const AST::BlockStmt *>(func.body.get()))
+        {
+            for (const auto &stmt : block->statements)
+            {
+                generateStatement(*stmt, out);
+            }
+        }
+        else
+        {
+            generateStatement(*func.body, out);
+        }
+        m_frame = nullptr;
+        out << "}\n";
+        out << "_state = -1;\n";
+        out << "return false;\n";
+        out << "}\n\n";
+    }
+
+    /*
+    A function body from its IR: values become locals assigned once, blocks
+    become labels and control flow becomes gotos. Phis are resolved on the
+    incoming edges by assigning the phi's local before the jump; see
+    IR::Locals for which values share a local or need none.
+    */
+    void generateIR(const IR::Function &func, OutputBuffer &out)
+    {
+        IR::Locals locals(func);
+        m_locals = &locals;
+
+        out << "{\n";
+        for (const IR::Instr *local : locals.declarations(func))
+        {
+            out << mapType(local->type) << " _v" << local->id << ";\n";
+        }
+
+        std::vector<IR::Block *> order = func.reversePostorder();
+        std::unordered_set<const IR::Block *> labels;
+        // labels are known only once every goto is written
+        std::vector<OutputBuffer> bodies;
+        bodies.reserve(order.size());
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            bodies.emplace_back(256);
+            const IR::Block *next = i + 1 < order.size() ? order[i + 1] : nullptr;
+            for (const IR::Instr *instr : order[i]->instrs)
+            {
+                if (!locals.inlined(instr))
+                    generateInstr(*instr, bodies[i]);
+            }
+            generateExit(*order[i], next, func.returnType, labels, bodies[i]);
+        }
+
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            if (labels.count(order[i]))
+                out << "_b" << order[i]->id << ":;\n";
+            out << bodies[i];
+        }
+        out << "}\n";
+        m_locals = nullptr;
     }
 
-    void generateIf(const AST::IfStmt &ifStmt, std::stringstream &ss)
+    void generateValue(const IR::Instr &value, OutputBuffer &out)
     {
-        ss << "if (";
-        generateExpr(*ifStmt.condition, ss);
-        ss << ") ";
-        generateStatement(*ifStmt.thenBranch, ss);
+        if (value.op == IR::Op::Param)
+        {
+            out << value.text;
+        }
+        else if (m_locals->inlined(&value))
+        {
+            out << "(";
+            generateExpression(value, out);
+            out << ")";
+        }
+        else if (value.op != IR::Op::Const)
+        {
+            out << "_v" << m_locals->local(&value)->id;
+        }
+        else if (value.type == AST::Type::Str)
+        {
+            out << "\"" << escapeString(value.text) << "\"";
+        }
+        else if (value.text[0] == '-')
+        {
+            out << "(" << value.text << ")";
+        }
+        else
+        {
+            out << value.text;
+        }
+    }
+
+    // Same conversions as generateIntegral.
+    void generateIntegralValue(const IR::Instr &value, OutputBuffer &out)
+    {
+        if (isIntegral(value.type))
+        {
+            generateValue(value, out);
+            return;
+        }
+        out << "static_cast<int64_t>(";
+        generateValue(value, out);
+        out << ")";
+    }
+
+    void generateInstr(const IR::Instr &instr, OutputBuffer &out)
+    {
+        if (instr.type != AST::Type::Void)
+            out << "_v" << m_locals->local(&instr)->id << " = ";
+        generateExpression(instr, out);
+        out << ";\n";
+    }
+
+    void generateExpression(const IR::Instr &instr, OutputBuffer &out)
+    {
+        const auto &operands = instr.operands;
+        switch (instr.op)
+        {
+        case IR::Op::Copy:
+            generateValue(*operands[0], out);
+            break;
+
+        case IR::Op::Cast:
+            out << "static_cast<" << mapType(instr.type) << ">(";
+            generateValue(*operands[0], out);
+            out << ")";
+            break;
+
+        case IR::Op::Unary:
+            out << tokenTypeToString(instr.token);
+            if (instr.token == TokenType::BITWISE_NOT)
+                generateIntegralValue(*operands[0], out);
+            else
+                generateValue(*operands[0], out);
+            break;
+
+        case IR::Op::Binary:
+            if (instr.token == TokenType::PERCENT &&
+                (!isIntegral(operands[0]->type) || !isIntegral(operands[1]->type)))
+            {
+                out << "std::fmod(";
+                generateValue(*operands[0], out);
+                out << ", ";
+                generateValue(*operands[1], out);
+                out << ")";
+            }
+            else if (isBitwise(instr.token))
+            {
+                generateIntegralValue(*operands[0], out);
+                out << " " << tokenTypeToString(instr.token) << " ";
+                generateIntegralValue(*operands[1], out);
+            }
+            else
+            {
+                bool exact = instr.token == TokenType::FSLASH &&
+                             !isFloating(operands[0]->type) && !isFloating(operands[1]->type);
+                if (exact)
+                    out << "static_cast<double>(";
+                generateValue(*operands[0], out);
+                if (exact)
+                    out << ")";
+                out << " " << tokenTypeToString(instr.token) << " ";
+                generateValue(*operands[1], out);
+            }
+            break;
+
+        case IR::Op::Call:
+            out << instr.text << "(";
+            for (size_t i = 0; i < operands.size(); ++i)
+            {
+                if (i > 0)
+                    out << ", ";
+                generateValue(*operands[i], out);
+            }
+            out << ")";
+            break;
+
+        case IR::Op::Print:
+            out << "gvoid::print(";
+            for (size_t i = 0; i < operands.size(); ++i)
+            {
+                if (i > 0)
+                    out << ", ";
+                generateValue(*operands[i], out);
+            }
+            out << ")";
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    // The phi assignments for the edge from `from` to `to`.
+    void generateEdge(const IR::Block &from, const IR::Block &to, OutputBuffer &out)
+    {
+        size_t edge = std::find(to.preds.begin(), to.preds.end(), &from) - to.preds.begin();
+        std::vector<const IR::Instr *> copies;
+        for (const IR::Instr *phi : to.phis)
+        {
+            const IR::Instr *value = phi->operands[edge];
+            if (m_locals->inlined(value) || value->floating() || m_locals->local(value) != m_locals->local(phi))
+                copies.push_back(phi);
+        }
+
+        // assigned in order unless a value reads a local assigned before it
+        bool sequential = true;
+        for (size_t i = 0; i < copies.size(); ++i)
+        {
+            for (size_t j = 0; j < i; ++j)
+            {
+                sequential = sequential && !reads(*copies[i]->operands[edge], m_locals->local(copies[j]));
+            }
+        }
+
+        if (sequential)
+        {
+            for (const IR::Instr *phi : copies)
+            {
+                out << "_v" << m_locals->local(phi)->id << " = ";
+                generateValue(*phi->operands[edge], out);
+                out << ";\n";
+            }
+            return;
+        }
+
+        out << "{\n";
+        for (const IR::Instr *phi : copies)
+        {
+            out << mapType(phi->type) << " _t" << phi->id << " = ";
+            generateValue(*phi->operands[edge], out);
+            out << ";\n";
+        }
+        for (const IR::Instr *phi : copies)
+        {
+            out << "_v" << m_locals->local(phi)->id << " = _t" << phi->id << ";\n";
+        }
+        out << "}\n";
+    }
+
+    // Whether the expression for `value` reads `local`.
+    bool reads(const IR::Instr &value, const IR::Instr *local) const
+    {
+        if (value.floating())
+            return false;
+        if (!m_locals->inlined(&value))
+            return m_locals->local(&value) == local;
+        return std::any_of(value.operands.begin(), value.operands.end(),
+                           [this, local](const IR::Instr *operand)
+                           { return reads(*operand, local); });
+    }
+
+    void generateJump(const IR::Block &from, const IR::Block &to, const IR::Block *next,
+                      std::unordered_set<const IR::Block *> &labels, OutputBuffer &out)
+    {
+        generateEdge(from, to, out);
+        if (&to != next)
+        {
+            out << "goto _b" << to.id << ";\n";
+            labels.insert(&to);
+        }
+    }
+
+    void generateExit(const IR::Block &block, const IR::Block *next, AST::Type returnType,
+                      std::unordered_set<const IR::Block *> &labels, OutputBuffer &out)
+    {
+        switch (block.exit)
+        {
+        case IR::Block::Exit::Jump:
+        {
+            // a jump back to a loop test repeats the test instead: one
+            // branch per iteration rather than a branch and a goto
+            const IR::Block &to = *block.targets[0];
+            bool test = to.exit == IR::Block::Exit::Branch &&
+                        std::all_of(to.instrs.begin(), to.instrs.end(), [this](const IR::Instr *instr)
+                                    { return m_locals->inlined(instr); });
+            if (&to != next && test)
+            {
+                generateEdge(block, to, out);
+                generateExit(to, next, returnType, labels, out);
+            }
+            else
+            {
+                generateJump(block, to, next, labels, out);
+            }
+            break;
+        }
+
+        case IR::Block::Exit::Branch:
+        {
+            // fall through to whichever target comes next
+            const IR::Block *then = block.targets[0];
+            const IR::Block *otherwise = block.targets[1];
+            bool negate = then == next;
+            if (negate)
+                std::swap(then, otherwise);
+
+            out << (negate ? "if (!" : "if (");
+            generateValue(*block.value, out);
+            out << ") {\n";
+            generateJump(block, *then, nullptr, labels, out);
+            out << "}\n";
+            generateJump(block, *otherwise, next, labels, out);
+            break;
+        }
+
+        case IR::Block::Exit::Return:
+            out << "return";
+            if (block.value)
+            {
+                out << " ";
+                generateValue(*block.value, out);
+            }
+            else if (returnType != AST::Type::Void)
+            {
+                // fell off the end without a value
+                out << " {}";
+            }
+            out << ";\n";
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    void generateIf(const AST::IfStmt &ifStmt, OutputBuffer &out)
+    {
+        out << "if (";
+        generateExpr(*ifStmt.condition, out);
+        out << ") ";
+        generateStatement(*ifStmt.thenBranch, out);
 
         if (ifStmt.elseBranch)
         {
-            ss << "else ";
-            generateStatement(*ifStmt.elseBranch, ss);
+            out << "else ";
+            generateStatement(*ifStmt.elseBranch, out);
         }
     }
 
-    void generateFor(const AST::ForStmt &forStmt, std::stringstream &ss)
+    void generateFor(const AST::ForStmt &forStmt, OutputBuffer &out)
     {
-        ss << "for (";
+        if (forStmt.pfor)
+        {
+            generatePFor(forStmt, out);
+            return;
+        }
+        if (forStmt.parallel)
+            generateParallelFor(forStmt, out);
+
+        out << "for (";
         if (forStmt.initializer)
         {
-            generateStatement(*forStmt.initializer, ss);
-            std::string code = ss.str();
-            if (!code.empty() && code.back() == '\n')
+            generateStatement(*forStmt.initializer, out);
+            if (out.back() == '\n')
             {
-                ss.seekp(-1, std::ios_base::end);
+                out.popBack();
             }
         }
         else
         {
-            ss << ";";
+            out << ";";
         }
 
-        ss << " ";
+        out << " ";
         if (forStmt.condition)
         {
-            generateExpr(*forStmt.condition, ss);
+            generateExpr(*forStmt.condition, out);
         }
-        ss << "; ";
+        out << "; ";
 
         if (forStmt.increment)
         {
-            generateExpr(*forStmt.increment, ss);
+            generateExpr(*forStmt.increment, out);
         }
-        ss << ") ";
+        out << ") ";
 
-        generateStatement(*forStmt.body, ss);
+        generateStatement(*forStmt.body, out);
     }
 
-    void generateWhile(const AST::WhileStmt &whileStmt, std::stringstream &ss)
+    void generateParallelFor(const AST::ForStmt &forStmt, OutputBuffer &out)
     {
-        ss << "while (";
-        generateExpr(*whileStmt.condition, ss);
-        ss << ") ";
-        generateStatement(*whileStmt.body, ss);
+        if (out.back() != '\n')
+            out << "\n";
+        out << "#pragma omp parallel for";
+        for (const auto &[op, name] : forStmt.reductions)
+        {
+            out << " reduction(" << op << ": " << name << ")";
+        }
+
+        if (!forStmt.straightLine)
+        {
+            // iterations with loops or calls can differ a lot in cost
+            out << " schedule(guided)";
+        }
+        out << "\n";
     }
 
-    void generateExpr(const AST::Expr &expr, std::stringstream &ss)
+    /*
+    Sema only accepts `pfor (i = start; i < bound; ...)`. Every chunk of the
+    range runs the loop serially on the pool. A reduction variable is a
+    fresh local in each chunk, starting from the operator's identity; after
+    the loop the chunks' values are combined into it in chunk order, so a
+    floating-point sum comes out the same on every run.
+    */
+    void generatePFor(const AST::ForStmt &forStmt, OutputBuffer &out)
     {
-        if (auto binary = dynamic_cast<const AST::BinaryExpr *>(&expr))
+        auto &init = static_cast<const AST::VarDeclStmt &>(*forStmt.initializer);
+        auto &condition = static_cast<const AST::BinaryExpr &>(*forStmt.condition);
+        auto reductions = forStmt.reductions;
+        if (m_frame)
         {
-            generateBinaryExpr(*binary, ss);
+            // in a generator, by the names of their members
+            for (size_t i = 0; i < reductions.size(); ++i)
+                reductions[i].second = m_frame->reductions.at(&forStmt)[i];
         }
-        else if (auto unary = dynamic_cast<const AST::UnaryExpr *>(&expr))
+
+        out << "{\nconst gvoid::Range _range(";
+        generateExpr(*init.initializer, out);
+        out << ", ";
+        generateExpr(*condition.right, out);
+        out << ");\n";
+        for (const auto &[op, name] : reductions)
         {
-            generateUnaryExpr(*unary, ss);
+            out << "std::vector<decltype(" << name << ")> _" << name << "(_range.chunks);\n";
         }
-        else if (auto literal = dynamic_cast<const AST::LiteralExpr *>(&expr))
+
+        out << "gvoid::parallelFor(_range, [&](int64_t _lo, int64_t _hi, size_t _chunk) {\n";
+        for (const auto &[op, name] : reductions)
         {
-            generateLiteral(*literal, ss);
+            out << "decltype(" << name << ") " << name << " = " << reductionIdentity(op) << ";\n";
         }
-        else if (auto ident = dynamic_cast<const AST::IdentifierExpr *>(&expr))
+        out << "for (" << mapType(init.varType) << " " << init.name << " = _lo; " << init.name << " < _hi; ++"
+            << init.name << ") ";
+        generateStatement(*forStmt.body, out);
+        for (const auto &[op, name] : reductions)
         {
-            ss << ident->name;
+            out << "_" << name << "[_chunk] = " << name << ";\n";
         }
-        else if (auto call = dynamic_cast<const AST::CallExpr *>(&expr))
+        out << "});\n";
+
+        for (const auto &[op, name] : reductions)
+        {
+            out << "for (auto _part : _" << name << ") " << name << " = " << name << " " << op << " _part;\n";
+        }
+        out << "}\n";
+    }
+
+    static const char *reductionIdentity(const std::string &op)
+    {
+        if (op == "*")
+            return "1";
+        if (op == "&")
+            return "~0";
+        return "0";
+    }
+
+    // yield value, in a generator's next()
+    void generateYield(const AST::CallExpr &call, OutputBuffer &out)
+    {
+        int resumePoint = ++m_resumePoints;
+        out << "{\n_out = ";
+        generateExpr(*call.args[0], out);
+        out << ";\n";
+        out << "_state = " << resumePoint << ";\n";
+        out << "return true;\n";
+        out << "case " << resumePoint << ":;\n";
+        out << "}\n";
+    }
+
+    /*
+    A for-in loop that yields keeps its place in frame members. Any other
+    walks an arr variable by index, as the body may replace the arr, and
+    everything else with a range for.
+    */
+    void generateForIn(const AST::ForInStmt &loop, OutputBuffer &out)
+    {
+        bool arr = loop.iterable->type == AST::Type::Arr;
+        bool arrVariable = arr && dynamic_cast<const AST::IdentifierExpr *>(loop.iterable.get());
+
+        if (m_frame && m_frame->iterations.count(&loop))
         {
-            if (call->callee == "print")
+            const auto &iteration = m_frame->iterations.at(&loop);
+            out << "for (";
+            if (!iteration.source.empty())
             {
-                generatePrintCall(*call, ss);
+                out << iteration.source << " = ";
+                generateExpr(*loop.iterable, out);
+                out << (arr ? ", " : "; ");
             }
-            else
+            if (!arr)
             {
-                ss << call->callee << "(";
-                for (size_t i = 0; i < call->args.size(); ++i)
-                {
-                    generateExpr(*call->args[i], ss);
-                    if (i != call->args.size() - 1)
-                    {
-                        ss << ", ";
-                    }
-                }
-                ss << ")";
+                out << iteration.source << ".next(" << iteration.variable << ");) ";
+                generateStatement(*loop.body, out);
+                return;
             }
+
+            out << iteration.index << " = 0; " << iteration.index << " < ";
+            if (arrVariable)
+                generateExpr(*loop.iterable, out);
+            else
+                out << iteration.source;
+            out << ".size(); ++" << iteration.index << ") {\n";
+            out << iteration.variable << " = ";
+            if (arrVariable)
+                generateExpr(*loop.iterable, out);
+            else
+                out << iteration.source;
+            out << "[" << iteration.index << "];\n";
+            generateStatement(*loop.body, out);
+            out << "}\n";
+            return;
+        }
+
+        if (arrVariable)
+        {
+            out << "for (size_t _i = 0; _i < ";
+            generateExpr(*loop.iterable, out);
+            out << ".size(); ++_i) {\n";
+            out << mapType(loop.varType) << " " << loop.name << " = ";
+            generateExpr(*loop.iterable, out);
+            out << "[_i];\n";
+            generateStatement(*loop.body, out);
+            out << "}\n";
+            return;
+        }
+
+        if (loop.varType == AST::Type::Str)
+        {
+            // one str for all the values, which keeps its capacity
+            out << "{\nauto _source = ";
+            generateExpr(*loop.iterable, out);
+            out << ";\nstd::string " << loop.name << ";\nwhile (_source.next(" << loop.name << ")) ";
+            generateStatement(*loop.body, out);
+            out << "}\n";
+            return;
+        }
+
+        out << "for (" << mapType(loop.varType) << " " << loop.name << " : ";
+        generateExpr(*loop.iterable, out);
+        out << ") ";
+        generateStatement(*loop.body, out);
+    }
+
+    void generateWhile(const AST::WhileStmt &whileStmt, OutputBuffer &out)
+    {
+        out << "while (";
+        generateExpr(*whileStmt.condition, out);
+        out << ") ";
+        generateStatement(*whileStmt.body, out);
+    }
+
+    void generateExpr(const AST::Expr &expr, OutputBuffer &out)
+    {
+        if (auto binary = dynamic_cast<const AST::BinaryExpr *>(&expr))
+        {
+            generateBinaryExpr(*binary, out);
+        }
+        else if (auto unary = dynamic_cast<const AST::UnaryExpr *>(&expr))
+        {
+            generateUnaryExpr(*unary, out);
+        }
+        else if (auto literal = dynamic_cast<const AST::LiteralExpr *>(&expr))
+        {
+            generateLiteral(*literal, out);
+        }
+        else if (auto ident = dynamic_cast<const AST::IdentifierExpr *>(&expr))
+        {
+            out << (m_frame && m_frame->references.count(ident) ? m_frame->references.at(ident) : ident->name);
         }
         else if (auto call = dynamic_cast<const AST::CallExpr *>(&expr))
         {
-            generateCall(*call, ss);
+            generateCall(*call, out);
+        }
+        else if (auto index = dynamic_cast<const AST::IndexExpr *>(&expr))
+        {
+            generateExpr(*index->array, out);
+            out << "[";
+            generateIndex(*index->index, out);
+            out << "]";
+        }
+    }
+
+    void generateIndex(const AST::Expr &index, OutputBuffer &out)
+    {
+        if (isIntegral(index.type))
+        {
+            generateExpr(index, out);
+            return;
         }
+        out << "static_cast<size_t>(";
+        generateExpr(index, out);
+        out << ")";
     }
 
-    void generateBinaryExpr(const AST::BinaryExpr &expr, std::stringstream &ss)
+    void generateBinaryExpr(const AST::BinaryExpr &expr, OutputBuffer &out)
     {
         if (expr.op == TokenType::STREAM_OUT)
         {
-            ss << "std::cout << ";
-            generateExpr(*expr.right, ss);
+            out << "std::cout << ";
+            generateExpr(*expr.right, out);
+            return;
+        }
+
+        if (isRealRemainder(expr))
+        {
+            generateRealRemainder(expr, out);
+            return;
+        }
+
+        if (isConcatenation(expr))
+        {
+            generateConcatenation(expr, out);
             return;
         }
 
-        ss << "(";
-        generateExpr(*expr.left, ss);
+        out << "(";
+        if (inDoubles(expr))
+        {
+            // 7 / 2 is 3.5, not 3; integers that could outgrow int64_t are
+            // added and multiplied as the doubles they are
+            out << "static_cast<double>(";
+            generateExpr(*expr.left, out);
+            out << ")";
+        }
+        else if (isBitwise(expr.op))
+        {
+            generateIntegral(*expr.left, out);
+        }
+        else
+        {
+            generateExpr(*expr.left, out);
+        }
 
         switch (expr.op)
         {
         case TokenType::PLUS:
-            ss << " + ";
+            out << " + ";
             break;
         case TokenType::MINUS:
-            ss << " - ";
+            out << " - ";
             break;
         case TokenType::ASTER:
-            ss << " * ";
+            out << " * ";
             break;
         case TokenType::FSLASH:
-            ss << " / ";
+            out << " / ";
             break;
         case TokenType::PERCENT:
-            ss << " % ";
+            out << " % ";
             break;
 
-        // Compound assignment
+        // Assignment
+        case TokenType::ASSIGN:
+            out << " = ";
+            break;
         case TokenType::PLUS_EQ:
-            ss << " += ";
+            out << " += ";
             break;
         case TokenType::MINUS_EQ:
-            ss << " -= ";
+            out << " -= ";
             break;
         case TokenType::ASTER_EQ:
-            ss << " *= ";
+            out << " *= ";
             break;
         case TokenType::FSLASH_EQ:
-            ss << " /= ";
+            out << " /= ";
             break;
         case TokenType::PERCENT_EQ:
-            ss << " %= ";
+            out << " %= ";
             break;
 
         // Comparison
         case TokenType::EQ_EQ:
-            ss << " == ";
+            out << " == ";
             break;
         case TokenType::BANG_EQ:
-            ss << " != ";
+            out << " != ";
             break;
         case TokenType::LT:
-            ss << " < ";
+            out << " < ";
             break;
         case TokenType::GT:
-            ss << " > ";
+            out << " > ";
             break;
         case TokenType::LT_EQ:
-            ss << " <= ";
+            out << " <= ";
             break;
         case TokenType::GT_EQ:
-            ss << " >= ";
+            out << " >= ";
             break;
 
         // Logical
         case TokenType::LOGICAL_AND:
-            ss << " && ";
+            out << " && ";
             break;
         case TokenType::LOGICAL_OR:
-            ss << " || ";
+            out << " || ";
             break;
 
         // Bitwise
         case TokenType::AND:
-            ss << " & ";
+            out << " & ";
             break;
         case TokenType::OR:
-            ss << " | ";
+            out << " | ";
             break;
         case TokenType::XOR:
-            ss << " ^ ";
+            out << " ^ ";
             break;
 
         // Other
         case TokenType::ARROW_RIGHT:
-            ss << "->";
+            out << "->";
             break;
 
         default:
-            ss << " " << tokenTypeToString(expr.op) << " ";
+            out << " " << tokenTypeToString(expr.op) << " ";
             break;
         }
 
-        generateExpr(*expr.right, ss);
-        ss << ")";
+        if (isBitwise(expr.op))
+        {
+            generateIntegral(*expr.right, out);
+        }
+        else
+        {
+            generateExpr(*expr.right, out);
+        }
+        out << ")";
+    }
+
+    // str + ... or s += ...
+    static bool isConcatenation(const AST::BinaryExpr &expr)
+    {
+        return (expr.op == TokenType::PLUS || expr.op == TokenType::PLUS_EQ) && expr.type == AST::Type::Str;
+    }
+
+    // The operands of a chain a + b + ... of strs, in order, with f-strings
+    // taken apart as well; a number added to a number inside it is one
+    // operand.
+    static void collectPieces(const AST::Expr &expr, std::vector<const AST::Expr *> &pieces)
+    {
+        auto binary = dynamic_cast<const AST::BinaryExpr *>(&expr);
+        if (binary && binary->op == TokenType::PLUS && binary->type == AST::Type::Str)
+        {
+            collectPieces(*binary->left, pieces);
+            collectPieces(*binary->right, pieces);
+            return;
+        }
+        auto call = dynamic_cast<const AST::CallExpr *>(&expr);
+        if (call && isInterpolation(*call))
+        {
+            for (const auto &part : call->args)
+                collectPieces(*part, pieces);
+            return;
+        }
+        pieces.push_back(&expr);
+    }
+
+    void generatePieces(const std::vector<const AST::Expr *> &pieces, OutputBuffer &out)
+    {
+        for (size_t i = 0; i < pieces.size(); ++i)
+        {
+            if (i > 0)
+                out << ", ";
+            generateExpr(*pieces[i], out);
+        }
+    }
+
+    /*
+    A whole chain of str + (or an f-string) becomes one gvoid::concat()
+    call, which sizes the result once and appends every piece, and
+    s += chain one gvoid::append() to s, instead of a temporary std::string
+    per +.
+    */
+    void generateConcatenation(const AST::Expr &expr, OutputBuffer &out)
+    {
+        std::vector<const AST::Expr *> pieces;
+        auto binary = dynamic_cast<const AST::BinaryExpr *>(&expr);
+        if (binary && binary->op == TokenType::PLUS_EQ)
+        {
+            out << "gvoid::append(";
+            generateExpr(*binary->left, out);
+            collectPieces(*binary->right, pieces);
+            out << ", ";
+        }
+        else
+        {
+            out << "gvoid::concat(";
+            collectPieces(expr, pieces);
+        }
+        generatePieces(pieces, out);
+        out << ")";
+    }
+
+    static bool inDoubles(const AST::BinaryExpr &expr)
+    {
+        bool arithmetic = expr.op == TokenType::FSLASH ||
+                          (isFloating(expr.type) && (expr.op == TokenType::PLUS || expr.op == TokenType::MINUS ||
+                                                     expr.op == TokenType::ASTER));
+        return arithmetic && !isFloating(expr.left->type) && !isFloating(expr.right->type);
+    }
+
+    static bool isBitwise(TokenType op)
+    {
+        return op == TokenType::AND || op == TokenType::OR || op == TokenType::XOR;
+    }
+
+    static bool isIntegral(AST::Type type)
+    {
+        return type == AST::Type::Bool || type == AST::Type::I32 || type == AST::Type::Int;
+    }
+
+    static bool isFloating(AST::Type type)
+    {
+        return type == AST::Type::F32 || type == AST::Type::Num;
+    }
+
+    // Bitwise operators need integers; a double operand is truncated.
+    void generateIntegral(const AST::Expr &expr, OutputBuffer &out)
+    {
+        if (isIntegral(expr.type))
+        {
+            generateExpr(expr, out);
+            return;
+        }
+        out << "static_cast<int64_t>(";
+        generateExpr(expr, out);
+        out << ")";
+    }
+
+    // % on doubles has no C++ operator.
+    static bool isRealRemainder(const AST::BinaryExpr &expr)
+    {
+        if (expr.op == TokenType::PERCENT)
+            return !isIntegral(expr.type);
+        if (expr.op == TokenType::PERCENT_EQ)
+            return !isIntegral(expr.left->type) || !isIntegral(expr.right->type);
+        return false;
+    }
+
+    void generateRealRemainder(const AST::BinaryExpr &expr, OutputBuffer &out)
+    {
+        out << "(";
+        if (expr.op == TokenType::PERCENT_EQ)
+        {
+            generateExpr(*expr.left, out);
+            out << " = ";
+        }
+        out << "std::fmod(";
+        generateExpr(*expr.left, out);
+        out << ", ";
+        generateExpr(*expr.right, out);
+        out << "))";
     }
 
-    void generateUnaryExpr(const AST::UnaryExpr &expr, std::stringstream &ss)
+    void generateUnaryExpr(const AST::UnaryExpr &expr, OutputBuffer &out)
     {
         switch (expr.op)
         {
         case TokenType::MINUS:
-            ss << "-";
+            out << "-";
             break;
         case TokenType::NOT:
-            ss << "!";
+            out << "!";
             break;
         case TokenType::PLUS_PLUS:
-            ss << "++";
+            out << "++";
             break;
         case TokenType::MINUS_MINUS:
-            ss << "--";
+            out << "--";
             break;
         case TokenType::BITWISE_NOT:
-            ss << "~";
-            break;
+            out << "~";
+            generateIntegral(*expr.right, out);
+            return;
         default:
-            ss << tokenTypeToString(expr.op);
+            out << tokenTypeToString(expr.op);
             break;
         }
-        generateExpr(*expr.right, ss);
+        generateExpr(*expr.right, out);
     }
 
-    void generateLiteral(const AST::LiteralExpr &literal, std::stringstream &ss)
+    void generateLiteral(const AST::LiteralExpr &literal, OutputBuffer &out)
     {
         switch (literal.type)
         {
         case TokenType::STRING_LIT:
-            ss << "\"" << escapeString(literal.value) << "\"";
+            out << "\"" << escapeString(literal.value) << "\"";
             break;
         case TokenType::NUMBER:
-            ss << literal.value;
+            // folded constants can be negative; keep `x - -1` from becoming `x--1`
+            if (literal.value[0] == '-')
+                out << "(" << literal.value << ")";
+            else
+                out << literal.value;
             break;
         case TokenType::TRUE:
-            ss << "true";
+            out << "true";
             break;
         case TokenType::FALSE:
-            ss << "false";
+            out << "false";
             break;
         default:
-            ss << literal.value;
+            out << literal.value;
         }
     }
 
@@ -557,49 +1646,152 @@ private:
         return result;
     }
 
-    void generateCall(const AST::CallExpr &call, std::stringstream &ss)
+    void generateCall(const AST::CallExpr &call, OutputBuffer &out)
     {
         if (call.callee == "print")
         {
-            generatePrintCall(call, ss);
+            generatePrintCall(call, out);
         }
         else if (call.callee == "size")
         {
             if (!call.args.empty())
             {
-                ss << "(";
-                generateExpr(*call.args[0], ss);
-                ss << ").size()";
+                auto literal = dynamic_cast<const AST::LiteralExpr *>(call.args[0].get());
+                out << (literal && literal->type == TokenType::STRING_LIT ? "std::string(" : "(");
+                generateExpr(*call.args[0], out);
+                out << ").size()";
             }
             else
             {
-                ss << "0 /* size() called with no arguments */";
+                out << "0 /* size() called with no arguments */";
             }
         }
+        else if (isInterpolation(call))
+        {
+            generateConcatenation(call, out);
+        }
+        else if (call.callee == "array")
+        {
+            // array(n): n zeros
+            out << "std::vector<double>(";
+            if (!call.args.empty())
+                generateIndex(*call.args[0], out);
+            out << ")";
+        }
+        else if (call.callee == "spawn")
+        {
+            generateSpawn(static_cast<const AST::CallExpr &>(*call.args[0]), out);
+        }
+        else if (call.callee == "await")
+        {
+            out << "(";
+            generateExpr(*call.args[0], out);
+            out << ").get()";
+        }
+        else if (call.callee == "channel" && !call.target)
+        {
+            out << "gvoid::Capacity{static_cast<int64_t>(";
+            generateExpr(*call.args[0], out);
+            out << ")}";
+        }
+        else if ((call.callee == "send" || call.callee == "receive") && !call.target)
+        {
+            out << "(";
+            generateExpr(*call.args[0], out);
+            out << ")." << call.callee << "(";
+            if (call.args.size() > 1)
+                generateAs(*call.args[1], AST::Type::Str, out);
+            out << ")";
+        }
+        else if (call.callee == ">>")
+        {
+            out << "gvoid::read<" << mapType(call.type) << ">()";
+        }
         else
         {
-            ss << call.callee << "(";
+            out << (isInput(call) || isFile(call) || isText(call) ? "gvoid::" : "") << call.callee << "(";
             for (size_t i = 0; i < call.args.size(); ++i)
             {
-                generateExpr(*call.args[i], ss);
+                if (call.target)
+                    generateAs(*call.args[i], call.target->paramTypes[i], out);
+                else
+                    generateExpr(*call.args[i], out);
                 if (i != call.args.size() - 1)
                 {
-                    ss << ", ";
+                    out << ", ";
                 }
             }
-            ss << ")";
+            out << ")";
         }
     }
 
-    void generatePrintCall(const AST::CallExpr &call, std::stringstream &ss)
+    // input(), readLine(), readNum(), eof() and the read of `>> x`.
+    static bool isInput(const AST::CallExpr &call)
     {
-        ss << "cout";
-        for (const auto &arg : call.args)
+        return !call.target && (call.callee == "input" || call.callee == "readLine" ||
+                                call.callee == "readNum" || call.callee == "eof" || call.callee == ">>");
+    }
+
+    // readFile(), writeFile() and lines().
+    static bool isFile(const AST::CallExpr &call)
+    {
+        return !call.target && (call.callee == "readFile" || call.callee == "writeFile" || call.callee == "lines");
+    }
+
+    // f"...", which the parser makes a call.
+    static bool isInterpolation(const AST::CallExpr &call)
+    {
+        return !call.target && call.callee == "f\"\"";
+    }
+
+    // substr(), find() and split().
+    static bool isText(const AST::CallExpr &call)
+    {
+        return !call.target && (call.callee == "substr" || call.callee == "find" || call.callee == "split");
+    }
+
+    // A str_view where a str is wanted is copied into one; C++ only does
+    // that explicitly.
+    void generateAs(const AST::Expr &expr, AST::Type type, OutputBuffer &out)
+    {
+        if (expr.type == AST::Type::View && type == AST::Type::Str)
         {
-            ss << " << ";
-            generateExpr(*arg, ss);
+            out << "std::string(";
+            generateExpr(expr, out);
+            out << ")";
+            return;
         }
-        ss << " << std::endl";
+        generateExpr(expr, out);
+    }
+
+    // The arguments are evaluated here, the call itself on a pool thread.
+    void generateSpawn(const AST::CallExpr &target, OutputBuffer &out)
+    {
+        out << "gvoid::spawn([";
+        for (size_t i = 0; i < target.args.size(); ++i)
+        {
+            out << (i ? ", _a" : "_a") << i << " = ";
+            generateAs(*target.args[i], target.target->paramTypes[i], out);
+        }
+        out << "]() mutable { return " << target.callee << "(";
+        for (size_t i = 0; i < target.args.size(); ++i)
+        {
+            out << (i ? ", std::move(_a" : "std::move(_a") << i << ")";
+        }
+        out << "); })";
+    }
+
+    // Buffered; see Runtime::OUTPUT.
+    // A str built with + or an f-string is printed piece by piece, straight
+    // into the output buffer, without making the str.
+    void generatePrintCall(const AST::CallExpr &call, OutputBuffer &out)
+    {
+        std::vector<const AST::Expr *> pieces;
+        for (const auto &arg : call.args)
+            collectPieces(*arg, pieces);
+        out << "gvoid::print(";
+        generatePieces(pieces, out);
+        out << ")";
     }
 
     std::string tokenTypeToString(TokenType type)
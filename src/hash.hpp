@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// 64-bit FNV-1a, used to key cached build artifacts by content.
+inline uint64_t fnv1a(const std::string &data, uint64_t hash = 0xcbf29ce484222325ULL)
+{
+    for (unsigned char c : data)
+    {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+inline std::string toHex(uint64_t value)
+{
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(value));
+    return buffer;
+}
@@ -0,0 +1,287 @@
+#pragma once
+
+#include "driver.hpp"
+#include "hash.hpp"
+#include "jobserver.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <set>
+#include <unordered_set>
+
+/*
+Function-granularity incremental builds.
+
+Every function goes into its own translation unit and object file, named by
+a hash of the unit's code plus the declarations of everything it refers to.
+An edit to one function therefore only recompiles that function (and main(),
+whose unit covers the globals), and the executable is relinked only when the
+set of objects changes. Units that are not cached yet are compiled in
+parallel, each holding a job slot.
+
+Cache layout (per program): program.hpp, <hash>.cxx, <hash>.o, link.manifest
+*/
+class IncrementalBuilder
+{
+public:
+    IncrementalBuilder(std::string cacheDir, CompileOptions options, JobSlots &slots)
+        : m_cacheDir(std::move(cacheDir)), m_options(std::move(options)), m_slots(slots) {}
+
+    bool build(const AST::StmtList &ast, const std::string &exeFile, std::string &error)
+    {
+        namespace fs = std::filesystem;
+
+        std::error_code ec;
+        fs::create_directories(m_cacheDir, ec);
+
+        Generator generator(ast, m_options.optimize);
+        std::string header = generator.generateHeader();
+        if (!writeIfChanged(m_cacheDir + "/" + HEADER_NAME, header))
+        {
+            error = "cannot write to " + m_cacheDir;
+            return false;
+        }
+
+        uint64_t seed = fnv1a(m_options.compiler);
+        for (const auto &flag : m_options.backendFlags())
+        {
+            seed = fnv1a(flag, seed);
+        }
+
+        std::vector<std::pair<uint64_t, std::string>> units;
+        units.emplace_back(fnv1a(header, seed), generator.generateMainUnit(HEADER_NAME));
+
+        for (const auto &stmt : ast)
+        {
+            if (auto func = dynamic_cast<const AST::FunctionStmt *>(stmt.get()))
+            {
+                std::set<std::string> names = {func->name};
+                collectReferences(*func->body, names);
+
+                uint64_t hash = seed;
+                for (const auto &name : names)
+                {
+                    hash = fnv1a(generator.declarationOf(name), hash);
+                }
+                units.emplace_back(hash, generator.generateFunctionUnit(*func, HEADER_NAME));
+            }
+        }
+
+        std::vector<std::string> objects;
+        std::vector<std::string> bases;
+        std::vector<size_t> missing;
+        for (auto &[hash, code] : units)
+        {
+            bases.push_back(m_cacheDir + "/" + toHex(fnv1a(code, hash)));
+            objects.push_back(bases.back() + ".o");
+            if (!fs::exists(objects.back()))
+                missing.push_back(bases.size() - 1);
+        }
+        m_total = objects.size();
+        m_compiled = missing.size();
+
+        if (!missing.empty())
+        {
+            ThreadPool pool(std::min(missing.size(), m_slots.limit()));
+            std::vector<std::future<bool>> compiled;
+            for (size_t i : missing)
+            {
+                compiled.push_back(pool.submit([this, &bases, &units, i]
+                                               { return compileUnit(bases[i], units[i].second); }));
+            }
+
+            bool ok = true;
+            for (size_t i = 0; i < compiled.size(); ++i)
+            {
+                if (!compiled[i].get() && ok)
+                {
+                    error = m_options.compiler + " failed on " + bases[missing[i]] + ".cxx";
+                    ok = false;
+                }
+            }
+            if (!ok)
+                return false;
+        }
+
+        std::string manifest;
+        for (const auto &objFile : objects)
+        {
+            manifest += objFile + "\n";
+        }
+
+        std::string manifestFile = m_cacheDir + "/link.manifest";
+        std::string previous;
+        if (!fs::exists(exeFile) || !readSource(manifestFile, previous) || previous != manifest)
+        {
+            auto slot = m_slots.acquire();
+            int status = runProcess(linkCommand(objects, exeFile, m_options));
+            m_slots.release(slot);
+            if (status != 0)
+            {
+                error = m_options.compiler + " failed to link " + exeFile;
+                return false;
+            }
+            writeOutput(manifestFile, manifest);
+        }
+
+        prune(objects);
+        return true;
+    }
+
+    size_t compiledUnits() const
+    {
+        return m_compiled;
+    }
+
+    size_t totalUnits() const
+    {
+        return m_total;
+    }
+
+private:
+    static constexpr const char *HEADER_NAME = "program.hpp";
+
+    std::string m_cacheDir;
+    CompileOptions m_options;
+    JobSlots &m_slots;
+    size_t m_compiled = 0;
+    size_t m_total = 0;
+
+    // Into <base>.o, which only appears once it is complete.
+    bool compileUnit(const std::string &base, const std::string &code)
+    {
+        std::string objFile = base + ".o";
+        if (!writeOutput(base + ".cxx", code))
+            return false;
+
+        auto slot = m_slots.acquire();
+        int status = runProcess(objectCommand(base + ".cxx", objFile + ".tmp", m_options));
+        m_slots.release(slot);
+
+        std::error_code ec;
+        if (status == 0)
+            std::filesystem::rename(objFile + ".tmp", objFile, ec);
+        if (status != 0 || ec)
+        {
+            std::remove((objFile + ".tmp").c_str());
+            return false;
+        }
+        return true;
+    }
+
+    static bool writeIfChanged(const std::string &path, const std::string &contents)
+    {
+        std::string current;
+        if (readSource(path, current) && current == contents)
+            return true;
+        return writeOutput(path, contents);
+    }
+
+    // Objects from earlier builds that are no longer part of the program.
+    void prune(const std::vector<std::string> &objects)
+    {
+        namespace fs = std::filesystem;
+
+        std::unordered_set<std::string> live;
+        for (const auto &objFile : objects)
+        {
+            live.insert(fs::path(objFile).stem().string());
+        }
+
+        std::error_code ec;
+        for (const auto &entry : fs::directory_iterator(m_cacheDir, ec))
+        {
+            auto ext = entry.path().extension();
+            if ((ext == ".o" || ext == ".cxx") && !live.count(entry.path().stem().string()))
+            {
+                fs::remove(entry.path(), ec);
+            }
+        }
+    }
+
+    static void collectReferences(const AST::Expr &expr, std::set<std::string> &names)
+    {
+        if (auto binary = dynamic_cast<const AST::BinaryExpr *>(&expr))
+        {
+            collectReferences(*binary->left, names);
+            collectReferences(*binary->right, names);
+        }
+        else if (auto unary = dynamic_cast<const AST::UnaryExpr *>(&expr))
+        {
+            collectReferences(*unary->right, names);
+        }
+        else if (auto ident = dynamic_cast<const AST::IdentifierExpr *>(&expr))
+        {
+            names.insert(ident->name);
+        }
+        else if (auto call = dynamic_cast<const AST::CallExpr *>(&expr))
+        {
+            names.insert(call->callee);
+            for (const auto &arg : call->args)
+            {
+                collectReferences(*arg, names);
+            }
+        }
+        else if (auto index = dynamic_cast<const AST::IndexExpr *>(&expr))
+        {
+            collectReferences(*index->array, names);
+            collectReferences(*index->index, names);
+        }
+    }
+
+    static void collectReferences(const AST::Stmt &stmt, std::set<std::string> &names)
+    {
+        if (auto varDecl = dynamic_cast<const AST::VarDeclStmt *>(&stmt))
+        {
+            if (varDecl->initializer)
+                collectReferences(*varDecl->initializer, names);
+        }
+        else if (auto exprStmt = dynamic_cast<const AST::ExprStmt *>(&stmt))
+        {
+            collectReferences(*exprStmt->expr, names);
+        }
+        else if (auto block = dynamic_cast<const AST::BlockStmt *>(&stmt))
+        {
+            for (const auto &s : block->statements)
+            {
+                collectReferences(*s, names);
+            }
+        }
+        else if (auto ifStmt = dynamic_cast<const AST::IfStmt *>(&stmt))
+        {
+            collectReferences(*ifStmt->condition, names);
+            collectReferences(*ifStmt->thenBranch, names);
+            if (ifStmt->elseBranch)
+                collectReferences(*ifStmt->elseBranch, names);
+        }
+        else if (auto forStmt = dynamic_cast<const AST::ForStmt *>(&stmt))
+        {
+            for (const auto &reduction : forStmt->reductions)
+            {
+                names.insert(reduction.second);
+            }
+            if (forStmt->initializer)
+                collectReferences(*forStmt->initializer, names);
+            if (forStmt->condition)
+                collectReferences(*forStmt->condition, names);
+            if (forStmt->increment)
+                collectReferences(*forStmt->increment, names);
+            collectReferences(*forStmt->body, names);
+        }
+        else if (auto whileStmt = dynamic_cast<const AST::WhileStmt *>(&stmt))
+        {
+            collectReferences(*whileStmt->condition, names);
+            collectReferences(*whileStmt->body, names);
+        }
+        else if (auto forIn = dynamic_cast<const AST::ForInStmt *>(&stmt))
+        {
+            collectReferences(*forIn->iterable, names);
+            collectReferences(*forIn->body, names);
+        }
+        else if (auto ret = dynamic_cast<const AST::ReturnStmt *>(&stmt))
+        {
+            if (ret->value)
+                collectReferences(*ret->value, names);
+        }
+    }
+};
@@ -0,0 +1,1015 @@
+#pragma once
+
+#include "ast.hpp"
+#include "tokens.hpp"
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+gvoid IR: a function as a graph of basic blocks holding typed instructions
+in SSA form. Every instruction is a value defined exactly once; where
+control flow merges, a phi picks the value coming from each predecessor
+(operand i belongs to preds[i]). Constants and parameters belong to no
+block and are usable everywhere.
+
+IR::Builder lowers a typed function body; `if`, `while` and `for` become
+explicit branches and jumps. SSA is built directly while lowering
+(Braun et al., "Simple and Efficient Construction of Static Single
+Assignment Form"): a block is sealed once all of its predecessors are
+known, and variables read in unsealed blocks get a phi that is completed
+on sealing.
+*/
+namespace IR
+{
+    enum class Op
+    {
+        Const,  // text: literal
+        Param,  // text: parameter name
+        Phi,
+        Copy,
+        Cast,   // to `type`
+        Unary,  // token: operator
+        Binary, // token: operator
+        Call,   // text: callee
+        Print,
+    };
+
+    struct Block;
+
+    struct Instr
+    {
+        int id;
+        Op op;
+        AST::Type type;
+        TokenType token = TokenType::UNKNOWN;
+        std::string text;
+        std::vector<Instr *> operands;
+        Block *block = nullptr;
+        Instr *replacement = nullptr; // set by passes, see Function::applyReplacements
+
+        Instr(int id, Op op, AST::Type type)
+            : id(id), op(op), type(type) {}
+
+        // Computes its value from its operands and nothing else.
+        bool pure() const
+        {
+            return op == Op::Const || op == Op::Param || op == Op::Phi || op == Op::Copy ||
+                   op == Op::Cast || op == Op::Unary || op == Op::Binary;
+        }
+
+        bool floating() const
+        {
+            return op == Op::Const || op == Op::Param;
+        }
+    };
+
+    struct Block
+    {
+        enum class Exit
+        {
+            None,
+            Jump,   // targets[0]
+            Branch, // value ? targets[0] : targets[1]
+            Return, // value, null for none
+        };
+
+        int id;
+        std::vector<Instr *> phis;
+        std::vector<Instr *> instrs;
+        Exit exit = Exit::None;
+        Instr *value = nullptr;
+        Block *targets[2] = {nullptr, nullptr};
+        std::vector<Block *> preds;
+
+        // analysis state, see Function::computeDominators
+        int order = -1; // reverse postorder index, -1 if unreachable
+        Block *idom = nullptr;
+
+        explicit Block(int id)
+            : id(id) {}
+
+        std::vector<Block *> successors() const
+        {
+            switch (exit)
+            {
+            case Exit::Jump:
+                return {targets[0]};
+            case Exit::Branch:
+                return {targets[0], targets[1]};
+            default:
+                return {};
+            }
+        }
+    };
+
+    struct Function
+    {
+        std::string name;
+        AST::Type returnType = AST::Type::Void;
+        std::vector<std::unique_ptr<Block>> blocks;
+        std::deque<Instr> values; // every value ever created, indexed by id
+        int blockCount = 0;       // block ids handed out, removed blocks included
+        Block *entry = nullptr;
+
+        Block *newBlock()
+        {
+            blocks.push_back(std::make_unique<Block>(blockCount++));
+            return blocks.back().get();
+        }
+
+        Instr *newValue(Op op, AST::Type type)
+        {
+            values.emplace_back(static_cast<int>(values.size()), op, type);
+            return &values.back();
+        }
+
+        // Blocks reachable from the entry, in reverse postorder: every block
+        // comes before its successors except along back edges. The first
+        // target of a branch is visited last, so that it comes right after
+        // the branch.
+        std::vector<Block *> reversePostorder() const
+        {
+            std::vector<Block *> order;
+            std::vector<char> visited(blockCount);
+            std::vector<std::pair<Block *, size_t>> stack = {{entry, 0}};
+            visited[entry->id] = true;
+
+            while (!stack.empty())
+            {
+                auto &[block, next] = stack.back();
+                auto successors = block->successors();
+                if (next < successors.size())
+                {
+                    Block *successor = successors[successors.size() - ++next];
+                    if (!visited[successor->id])
+                    {
+                        visited[successor->id] = true;
+                        stack.push_back({successor, 0});
+                    }
+                    continue;
+                }
+                order.push_back(block);
+                stack.pop_back();
+            }
+
+            std::reverse(order.begin(), order.end());
+            return order;
+        }
+
+        // Drops unreachable blocks, together with the phi operands that
+        // came from them.
+        void removeUnreachable()
+        {
+            std::vector<char> reachable(blockCount);
+            for (Block *block : reversePostorder())
+            {
+                reachable[block->id] = true;
+            }
+
+            for (auto &block : blocks)
+            {
+                if (!reachable[block->id])
+                    continue;
+
+                for (size_t i = block->preds.size(); i-- > 0;)
+                {
+                    if (reachable[block->preds[i]->id])
+                        continue;
+                    block->preds.erase(block->preds.begin() + i);
+                    for (Instr *phi : block->phis)
+                    {
+                        phi->operands.erase(phi->operands.begin() + i);
+                    }
+                }
+            }
+
+            blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                                        [&reachable](const std::unique_ptr<Block> &block)
+                                        { return !reachable[block->id]; }),
+                         blocks.end());
+        }
+
+        // Iterative dominators (Cooper, Harvey and Kennedy); fills in
+        // `order` and `idom` of every reachable block.
+        std::vector<Block *> computeDominators()
+        {
+            for (auto &block : blocks)
+            {
+                block->order = -1;
+                block->idom = nullptr;
+            }
+
+            std::vector<Block *> order = reversePostorder();
+            for (size_t i = 0; i < order.size(); ++i)
+            {
+                order[i]->order = static_cast<int>(i);
+            }
+
+            entry->idom = entry;
+            bool changed = true;
+            while (changed)
+            {
+                changed = false;
+                for (size_t i = 1; i < order.size(); ++i)
+                {
+                    Block *block = order[i];
+                    Block *idom = nullptr;
+                    for (Block *pred : block->preds)
+                    {
+                        if (pred->order < 0 || !pred->idom)
+                            continue;
+                        idom = idom ? intersect(pred, idom) : pred;
+                    }
+                    if (idom != block->idom)
+                    {
+                        block->idom = idom;
+                        changed = true;
+                    }
+                }
+            }
+            return order;
+        }
+
+        static bool dominates(const Block *a, const Block *b)
+        {
+            while (b != a && b->idom != b)
+            {
+                b = b->idom;
+            }
+            return a == b;
+        }
+
+        static Instr *resolve(Instr *value)
+        {
+            while (value && value->replacement)
+            {
+                value = value->replacement;
+            }
+            return value;
+        }
+
+        // Rewrites every use of a replaced value to its replacement and
+        // removes the replaced instructions.
+        void applyReplacements()
+        {
+            auto replaced = [](const Instr *instr)
+            { return instr->replacement != nullptr; };
+
+            for (auto &block : blocks)
+            {
+                for (auto *list : {&block->phis, &block->instrs})
+                {
+                    list->erase(std::remove_if(list->begin(), list->end(), replaced), list->end());
+                    for (Instr *instr : *list)
+                    {
+                        for (auto &operand : instr->operands)
+                        {
+                            operand = resolve(operand);
+                        }
+                    }
+                }
+                block->value = resolve(block->value);
+            }
+        }
+
+        std::string toString() const
+        {
+            std::string text = "func " + name + "\n";
+            for (Block *block : reversePostorder())
+            {
+                text += "b" + std::to_string(block->id) + ":\n";
+                for (auto *list : {&block->phis, &block->instrs})
+                {
+                    for (const Instr *instr : *list)
+                    {
+                        text += "    " + valueName(instr) + " = " + describe(*instr) + "\n";
+                    }
+                }
+
+                switch (block->exit)
+                {
+                case Block::Exit::Jump:
+                    text += "    jump b" + std::to_string(block->targets[0]->id) + "\n";
+                    break;
+                case Block::Exit::Branch:
+                    text += "    branch " + valueName(block->value) + ", b" + std::to_string(block->targets[0]->id) +
+                            ", b" + std::to_string(block->targets[1]->id) + "\n";
+                    break;
+                case Block::Exit::Return:
+                    text += "    return" + (block->value ? " " + valueName(block->value) : std::string()) + "\n";
+                    break;
+                default:
+                    break;
+                }
+            }
+            return text;
+        }
+
+    private:
+        static Block *intersect(Block *a, Block *b)
+        {
+            while (a != b)
+            {
+                while (a->order > b->order)
+                    a = a->idom;
+                while (b->order > a->order)
+                    b = b->idom;
+            }
+            return a;
+        }
+
+        static std::string valueName(const Instr *instr)
+        {
+            if (instr->floating())
+                return instr->text;
+            return "%" + std::to_string(instr->id);
+        }
+
+        static std::string describe(const Instr &instr)
+        {
+            static const char *names[] = {"const", "param", "phi", "copy", "cast", "unary", "binary", "call", "print"};
+            std::string text = names[static_cast<int>(instr.op)];
+            if (instr.op == Op::Unary || instr.op == Op::Binary)
+                text += " " + to_string(instr.token);
+            if (instr.op == Op::Call)
+                text += " " + instr.text;
+            for (const Instr *operand : instr.operands)
+            {
+                text += " " + valueName(operand);
+            }
+            return text;
+        }
+    };
+
+    // Thrown by the builder for code the IR does not model (strings,
+    // arrays, top-level variables); such functions are generated from the
+    // AST instead.
+    struct Unsupported : std::runtime_error
+    {
+        using std::runtime_error::runtime_error;
+    };
+
+    class Builder
+    {
+    public:
+        // Expects a function annotated by Sema.
+        explicit Builder(const AST::FunctionStmt &func)
+            : m_func(func) {}
+
+        std::unique_ptr<Function> build()
+        {
+            m_ir = std::make_unique<Function>();
+            m_ir->name = m_func.name;
+            m_ir->returnType = m_func.returnType;
+            if (m_func.returnType != AST::Type::Void && !scalar(m_func.returnType))
+                throw Unsupported("return type");
+
+            m_ir->entry = newBlock();
+            m_current = m_ir->entry;
+            m_sealed[m_current->id] = true;
+
+            openScope();
+            for (size_t i = 0; i < m_func.params.size(); ++i)
+            {
+                if (!scalar(m_func.paramTypes[i]))
+                    throw Unsupported("parameter type");
+
+                Variable var = declare(m_func.params[i], m_func.paramTypes[i]);
+
+                Instr *param = m_ir->newValue(Op::Param, var.type);
+                param->text = m_func.params[i];
+                writeVariable(var, m_current, param);
+            }
+
+            // the body block shares the parameter scope
+            if (auto body = dynamic_cast<const AST::BlockStmt *>(m_func.body.get()))
+            {
+                for (const auto &stmt : body->statements)
+                {
+                    statement(*stmt);
+                }
+            }
+            else
+            {
+                statement(*m_func.body);
+            }
+
+            if (m_current->exit == Block::Exit::None)
+                m_current->exit = Block::Exit::Return;
+
+            m_ir->removeUnreachable();
+            return std::move(m_ir);
+        }
+
+    private:
+        struct Variable
+        {
+            int index; // in declaration order; shadowed names get their own
+            AST::Type type;
+        };
+
+        const AST::FunctionStmt &m_func;
+        std::unique_ptr<Function> m_ir;
+        Block *m_current = nullptr;
+        int m_variables = 0;
+        std::vector<std::pair<const std::string *, Variable>> m_names; // innermost last
+        std::vector<size_t> m_scopes;                                  // m_names size at each scope entry
+        // by block id
+        std::vector<std::vector<std::pair<int, Instr *>>> m_definitions; // variable index -> current value
+        std::vector<std::vector<std::pair<Variable, Instr *>>> m_incompletePhis;
+        std::vector<char> m_sealed;
+        std::vector<std::pair<Block *, Block *>> m_loops; // break and continue targets, innermost last
+
+        static bool scalar(AST::Type type)
+        {
+            switch (type)
+            {
+            case AST::Type::Bool:
+            case AST::Type::I32:
+            case AST::Type::Int:
+            case AST::Type::F32:
+            case AST::Type::Num:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        // --- SSA construction
+
+        void writeVariable(const Variable &var, const Block *block, Instr *value)
+        {
+            for (auto &[index, current] : m_definitions[block->id])
+            {
+                if (index == var.index)
+                {
+                    current = value;
+                    return;
+                }
+            }
+            m_definitions[block->id].push_back({var.index, value});
+        }
+
+        Instr *readVariable(const Variable &var, Block *block)
+        {
+            for (auto &[index, current] : m_definitions[block->id])
+            {
+                if (index == var.index)
+                    return current;
+            }
+            return readVariableRecursive(var, block);
+        }
+
+        Instr *readVariableRecursive(const Variable &var, Block *block)
+        {
+            Instr *value;
+            if (!m_sealed[block->id])
+            {
+                value = newPhi(var.type, block);
+                m_incompletePhis[block->id].push_back({var, value});
+            }
+            else if (block->preds.empty())
+            {
+                // read before any write, or in unreachable code
+                value = constant(var.type, var.type == AST::Type::Bool ? "false" : "0");
+            }
+            else if (block->preds.size() == 1)
+            {
+                value = readVariable(var, block->preds[0]);
+            }
+            else
+            {
+                value = newPhi(var.type, block);
+                writeVariable(var, block, value);
+                addPhiOperands(var, value);
+            }
+            writeVariable(var, block, value);
+            return value;
+        }
+
+        void addPhiOperands(const Variable &var, Instr *phi)
+        {
+            for (Block *pred : phi->block->preds)
+            {
+                phi->operands.push_back(readVariable(var, pred));
+            }
+        }
+
+        void sealBlock(Block *block)
+        {
+            for (auto &[var, phi] : m_incompletePhis[block->id])
+            {
+                addPhiOperands(var, phi);
+            }
+            m_incompletePhis[block->id].clear();
+            m_sealed[block->id] = true;
+        }
+
+        Instr *newPhi(AST::Type type, Block *block)
+        {
+            Instr *phi = m_ir->newValue(Op::Phi, type);
+            phi->block = block;
+            block->phis.push_back(phi);
+            return phi;
+        }
+
+        // --- control flow
+
+        Block *newBlock()
+        {
+            Block *block = m_ir->newBlock();
+            m_sealed.push_back(false);
+            m_definitions.emplace_back();
+            m_incompletePhis.emplace_back();
+            return block;
+        }
+
+        void jump(Block *target)
+        {
+            m_current->exit = Block::Exit::Jump;
+            m_current->targets[0] = target;
+            target->preds.push_back(m_current);
+        }
+
+        void branch(Instr *condition, Block *then, Block *otherwise)
+        {
+            m_current->exit = Block::Exit::Branch;
+            m_current->value = condition;
+            m_current->targets[0] = then;
+            m_current->targets[1] = otherwise;
+            then->preds.push_back(m_current);
+            otherwise->preds.push_back(m_current);
+        }
+
+        // After a return, code continues in a block nothing jumps to.
+        void startUnreachable()
+        {
+            m_current = newBlock();
+            m_sealed[m_current->id] = true;
+        }
+
+        // --- instructions
+
+        Instr *constant(AST::Type type, const std::string &literal)
+        {
+            Instr *value = m_ir->newValue(Op::Const, type);
+            value->text = literal;
+            return value;
+        }
+
+        Instr *emit(Op op, AST::Type type, std::vector<Instr *> operands, TokenType token = TokenType::UNKNOWN)
+        {
+            Instr *instr = m_ir->newValue(op, type);
+            instr->token = token;
+            instr->operands = std::move(operands);
+            instr->block = m_current;
+            m_current->instrs.push_back(instr);
+            return instr;
+        }
+
+        Instr *convert(Instr *value, AST::Type type)
+        {
+            if (value->type == type)
+                return value;
+            return emit(Op::Cast, type, {value});
+        }
+
+        // --- statements
+
+        void openScope()
+        {
+            m_scopes.push_back(m_names.size());
+        }
+
+        void closeScope()
+        {
+            m_names.resize(m_scopes.back());
+            m_scopes.pop_back();
+        }
+
+        Variable declare(const std::string &name, AST::Type type)
+        {
+            Variable var{m_variables++, type};
+            m_names.push_back({&name, var});
+            return var;
+        }
+
+        Variable lookup(const std::string &name) const
+        {
+            for (auto it = m_names.rbegin(); it != m_names.rend(); ++it)
+            {
+                if (*it->first == name)
+                    return it->second;
+            }
+            throw Unsupported("top-level variable " + name);
+        }
+
+        void statement(const AST::Stmt &stmt)
+        {
+            if (auto varDecl = dynamic_cast<const AST::VarDeclStmt *>(&stmt))
+            {
+                if (!scalar(varDecl->varType))
+                    throw Unsupported("variable type");
+
+                AST::Type type = varDecl->varType;
+                Instr *initial;
+                if (!varDecl->initializer)
+                    initial = constant(type, type == AST::Type::Bool ? "false" : "0");
+                else if (dynamic_cast<const AST::IdentifierExpr *>(varDecl->initializer.get()))
+                    initial = emit(Op::Copy, type, {convert(value(*varDecl->initializer), type)});
+                else
+                    initial = convert(value(*varDecl->initializer), type);
+
+                writeVariable(declare(varDecl->name, type), m_current, initial);
+            }
+            else if (auto exprStmt = dynamic_cast<const AST::ExprStmt *>(&stmt))
+            {
+                effect(*exprStmt->expr);
+            }
+            else if (auto block = dynamic_cast<const AST::BlockStmt *>(&stmt))
+            {
+                openScope();
+                for (const auto &s : block->statements)
+                {
+                    statement(*s);
+                }
+                closeScope();
+            }
+            else if (auto ifStmt = dynamic_cast<const AST::IfStmt *>(&stmt))
+            {
+                ifStatement(*ifStmt);
+            }
+            else if (auto whileStmt = dynamic_cast<const AST::WhileStmt *>(&stmt))
+            {
+                loop(nullptr, whileStmt->condition.get(), nullptr, *whileStmt->body);
+            }
+            else if (auto forStmt = dynamic_cast<const AST::ForStmt *>(&stmt))
+            {
+                // left to the AST generator, which emits the OpenMP pragma
+                // or the call into the runtime's pool
+                if (forStmt->parallel || forStmt->pfor)
+                    throw Unsupported("parallel loop");
+                openScope();
+                loop(forStmt->initializer.get(), forStmt->condition.get(), forStmt->increment.get(), *forStmt->body);
+                closeScope();
+            }
+            else if (auto ret = dynamic_cast<const AST::ReturnStmt *>(&stmt))
+            {
+                m_current->exit = Block::Exit::Return;
+                if (ret->value)
+                    m_current->value = convert(value(*ret->value), m_func.returnType);
+                startUnreachable();
+            }
+            else if (dynamic_cast<const AST::BreakStmt *>(&stmt))
+            {
+                jump(m_loops.back().first);
+                startUnreachable();
+            }
+            else if (dynamic_cast<const AST::ContinueStmt *>(&stmt))
+            {
+                jump(m_loops.back().second);
+                startUnreachable();
+            }
+            else
+            {
+                throw Unsupported("statement");
+            }
+        }
+
+        void scoped(const AST::Stmt &stmt)
+        {
+            openScope();
+            statement(stmt);
+            closeScope();
+        }
+
+        void ifStatement(const AST::IfStmt &ifStmt)
+        {
+            Instr *condition = value(*ifStmt.condition);
+            Block *then = newBlock();
+            Block *merge = newBlock();
+            Block *otherwise = ifStmt.elseBranch ? newBlock() : merge;
+
+            branch(condition, then, otherwise);
+            sealBlock(then);
+
+            m_current = then;
+            scoped(*ifStmt.thenBranch);
+            jump(merge);
+
+            if (ifStmt.elseBranch)
+            {
+                sealBlock(otherwise);
+                m_current = otherwise;
+                scoped(*ifStmt.elseBranch);
+                jump(merge);
+            }
+
+            sealBlock(merge);
+            m_current = merge;
+        }
+
+        // while (condition) body, or for (initializer; condition; increment) body
+        void loop(const AST::Stmt *initializer, const AST::Expr *condition, const AST::Expr *increment,
+                  const AST::Stmt &body)
+        {
+            if (initializer)
+                statement(*initializer);
+
+            Block *header = newBlock();
+            Block *bodyBlock = newBlock();
+            Block *step = increment ? newBlock() : header;
+            Block *exit = newBlock();
+            jump(header);
+
+            // the back edge is still to come: the header stays unsealed
+            m_current = header;
+            if (condition)
+                branch(value(*condition), bodyBlock, exit);
+            else
+                jump(bodyBlock);
+            sealBlock(bodyBlock);
+
+            m_current = bodyBlock;
+            m_loops.push_back({exit, step});
+            scoped(body);
+            m_loops.pop_back();
+            jump(step);
+
+            if (increment)
+            {
+                // every `continue` is known by now
+                sealBlock(step);
+                m_current = step;
+                effect(*increment);
+                jump(header);
+            }
+
+            sealBlock(header);
+            sealBlock(exit);
+            m_current = exit;
+        }
+
+        // --- expressions
+
+        // Evaluates an expression for its side effects only.
+        void effect(const AST::Expr &e)
+        {
+            if (auto call = dynamic_cast<const AST::CallExpr *>(&e))
+                callExpr(*call, false);
+            else
+                expr(e);
+        }
+
+        Instr *value(const AST::Expr &e)
+        {
+            Instr *result = expr(e);
+            if (!result)
+                throw Unsupported("void value");
+            return result;
+        }
+
+        // Null for calls without a value.
+        Instr *expr(const AST::Expr &e)
+        {
+            if (auto literal = dynamic_cast<const AST::LiteralExpr *>(&e))
+            {
+                if (!scalar(e.type))
+                    throw Unsupported("literal");
+                return constant(e.type, literal->value);
+            }
+
+            if (auto ident = dynamic_cast<const AST::IdentifierExpr *>(&e))
+            {
+                return readVariable(lookup(ident->name), m_current);
+            }
+
+            if (auto unary = dynamic_cast<const AST::UnaryExpr *>(&e))
+            {
+                if (unary->op == TokenType::PLUS_PLUS || unary->op == TokenType::MINUS_MINUS)
+                {
+                    auto &target = static_cast<const AST::IdentifierExpr &>(*unary->right);
+                    Variable var = lookup(target.name);
+                    TokenType op = unary->op == TokenType::PLUS_PLUS ? TokenType::PLUS : TokenType::MINUS;
+                    Instr *result = emit(Op::Binary, var.type,
+                                         {readVariable(var, m_current), constant(AST::Type::Int, "1")}, op);
+                    writeVariable(var, m_current, result);
+                    return result;
+                }
+
+                Instr *operand = value(*unary->right);
+                AST::Type type = unary->op == TokenType::NOT           ? AST::Type::Bool
+                                 : unary->op == TokenType::BITWISE_NOT ? AST::Type::Int
+                                                                       : resultType(unary->op, operand->type, operand->type);
+                return emit(Op::Unary, type, {operand}, unary->op);
+            }
+
+            if (auto binary = dynamic_cast<const AST::BinaryExpr *>(&e))
+            {
+                return binaryExpr(*binary);
+            }
+
+            if (auto call = dynamic_cast<const AST::CallExpr *>(&e))
+            {
+                return callExpr(*call, true);
+            }
+
+            throw Unsupported("expression");
+        }
+
+        // Type of the C++ expression the generator emits for `op`, so that a
+        // value computes the same whether it is named or nested.
+        static AST::Type resultType(TokenType op, AST::Type left, AST::Type right)
+        {
+            auto integral = [](AST::Type type)
+            { return type == AST::Type::Bool || type == AST::Type::I32 || type == AST::Type::Int; };
+
+            switch (op)
+            {
+            case TokenType::EQ_EQ:
+            case TokenType::BANG_EQ:
+            case TokenType::LT:
+            case TokenType::GT:
+            case TokenType::LT_EQ:
+            case TokenType::GT_EQ:
+            case TokenType::LOGICAL_AND:
+            case TokenType::LOGICAL_OR:
+                return AST::Type::Bool;
+            case TokenType::AND:
+            case TokenType::OR:
+            case TokenType::XOR:
+                return AST::Type::Int;
+            case TokenType::FSLASH:
+                if (integral(left) && integral(right))
+                    return AST::Type::Num;
+                break;
+            case TokenType::PERCENT:
+                // std::fmod, which is only float for two floats
+                if (!integral(left) || !integral(right))
+                    return left == AST::Type::F32 && right == AST::Type::F32 ? AST::Type::F32 : AST::Type::Num;
+                break;
+            default:
+                break;
+            }
+
+            for (AST::Type type : {AST::Type::Num, AST::Type::F32, AST::Type::Int, AST::Type::I32})
+            {
+                if (left == type || right == type)
+                    return type;
+            }
+            return AST::Type::Int; // arithmetic on bools
+        }
+
+        static TokenType compoundOperator(TokenType op)
+        {
+            switch (op)
+            {
+            case TokenType::PLUS_EQ:
+                return TokenType::PLUS;
+            case TokenType::MINUS_EQ:
+                return TokenType::MINUS;
+            case TokenType::ASTER_EQ:
+                return TokenType::ASTER;
+            case TokenType::FSLASH_EQ:
+                return TokenType::FSLASH;
+            case TokenType::PERCENT_EQ:
+                return TokenType::PERCENT;
+            default:
+                return TokenType::UNKNOWN;
+            }
+        }
+
+        Instr *binaryExpr(const AST::BinaryExpr &binary)
+        {
+            if (binary.op == TokenType::ASSIGN || compoundOperator(binary.op) != TokenType::UNKNOWN)
+            {
+                auto target = dynamic_cast<const AST::IdentifierExpr *>(binary.left.get());
+                if (!target)
+                    throw Unsupported("element assignment");
+                Variable var = lookup(target->name);
+
+                Instr *result;
+                if (binary.op == TokenType::ASSIGN)
+                {
+                    result = convert(value(*binary.right), var.type);
+                    if (dynamic_cast<const AST::IdentifierExpr *>(binary.right.get()))
+                        result = emit(Op::Copy, var.type, {result});
+                }
+                else
+                {
+                    Instr *current = readVariable(var, m_current);
+                    Instr *operand = value(*binary.right);
+                    TokenType op = compoundOperator(binary.op);
+                    result = convert(emit(Op::Binary, resultType(op, current->type, operand->type), {current, operand}, op),
+                                     var.type);
+                }
+                writeVariable(var, m_current, result);
+                return result;
+            }
+
+            if (!scalar(binary.type))
+                throw Unsupported("binary operands");
+
+            if (binary.op == TokenType::LOGICAL_AND || binary.op == TokenType::LOGICAL_OR)
+                return shortCircuit(binary);
+
+            Instr *left = value(*binary.left);
+            Instr *right = value(*binary.right);
+            if (!scalar(left->type) || !scalar(right->type))
+                throw Unsupported("binary operands");
+            // integers that sema found could outgrow int64_t
+            if (binary.type == AST::Type::Num && resultType(binary.op, left->type, right->type) == AST::Type::Int)
+            {
+                left = convert(left, AST::Type::Num);
+                right = convert(right, AST::Type::Num);
+            }
+            return emit(Op::Binary, resultType(binary.op, left->type, right->type), {left, right}, binary.op);
+        }
+
+        // a && b, a || b: b only runs if a does not decide the result.
+        Instr *shortCircuit(const AST::BinaryExpr &binary)
+        {
+            bool isAnd = binary.op == TokenType::LOGICAL_AND;
+            Instr *left = value(*binary.left);
+            Block *decided = m_current;
+            Block *rhs = newBlock();
+            Block *merge = newBlock();
+
+            if (isAnd)
+                branch(left, rhs, merge);
+            else
+                branch(left, merge, rhs);
+            sealBlock(rhs);
+
+            m_current = rhs;
+            Instr *right = convert(value(*binary.right), AST::Type::Bool);
+            Block *evaluated = m_current;
+            jump(merge);
+            sealBlock(merge);
+            m_current = merge;
+
+            Instr *phi = newPhi(AST::Type::Bool, merge);
+            for (Block *pred : merge->preds)
+            {
+                phi->operands.push_back(pred == decided ? constant(AST::Type::Bool, isAnd ? "false" : "true")
+                                                        : pred == evaluated ? right
+                                                                            : nullptr);
+            }
+            return phi;
+        }
+
+        Instr *callExpr(const AST::CallExpr &call, bool used)
+        {
+            if (call.callee == "print")
+            {
+                std::vector<Instr *> args;
+                for (const auto &arg : call.args)
+                {
+                    auto literal = dynamic_cast<const AST::LiteralExpr *>(arg.get());
+                    if (literal && literal->type == TokenType::STRING_LIT)
+                        args.push_back(constant(AST::Type::Str, literal->value));
+                    else
+                        args.push_back(value(*arg));
+                }
+                emit(Op::Print, AST::Type::Void, std::move(args));
+                return nullptr;
+            }
+            if (call.callee == "size")
+                throw Unsupported("size()");
+            if (!call.target && (call.callee == "spawn" || call.callee == "await" || call.callee == "channel" ||
+                                 call.callee == "send" || call.callee == "receive"))
+                throw Unsupported("task or chan");
+            if (!call.target && (call.callee == "input" || call.callee == "readLine" ||
+                                 call.callee == "readNum" || call.callee == "eof" || call.callee == ">>"))
+                throw Unsupported("input");
+            if (!call.target && (call.callee == "readFile" || call.callee == "writeFile" || call.callee == "lines"))
+                throw Unsupported("file");
+            if (!call.target && (call.callee == "substr" || call.callee == "find" || call.callee == "split"))
+                throw Unsupported("text");
+            if (!call.target && call.callee == "f\"\"")
+                throw Unsupported("f-string");
+
+            std::vector<Instr *> args;
+            for (const auto &arg : call.args)
+            {
+                args.push_back(value(*arg));
+            }
+
+            // external functions are taken to return double, if anything
+            AST::Type type = call.target ? call.target->returnType
+                                         : used ? AST::Type::Num
+                                                : AST::Type::Void;
+            if (type != AST::Type::Void && !scalar(type))
+                throw Unsupported("call result");
+
+            Instr *result = emit(Op::Call, type, std::move(args));
+            result->text = call.callee;
+            return type == AST::Type::Void ? nullptr : result;
+        }
+    };
+}
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+/*
+GNU make jobserver client.
+
+When gvoid runs under `make -jN`, make passes a pipe (or named fifo) through
+MAKEFLAGS holding N-1 tokens. Every job we start beyond the first has to take a
+token from it and give it back when done, so the whole build stays at N jobs.
+If the pipe is closed or fails, we stop using it and fall back to our own
+limit rather than wait on it forever.
+*/
+class JobServer
+{
+public:
+    JobServer()
+    {
+#ifndef _WIN32
+        const char *flags = std::getenv("MAKEFLAGS");
+        if (flags)
+        {
+            parseMakeFlags(flags);
+        }
+#endif
+    }
+
+    ~JobServer()
+    {
+#ifndef _WIN32
+        if (m_ownsFds)
+        {
+            close(m_readFd);
+        }
+#endif
+    }
+
+    JobServer(const JobServer &) = delete;
+    JobServer &operator=(const JobServer &) = delete;
+
+    bool available() const
+    {
+        return m_readFd >= 0 && m_writeFd >= 0 && !m_failed;
+    }
+
+    // False if no token can be had: the jobserver is gone.
+    bool acquire(char &token)
+    {
+#ifndef _WIN32
+        while (available())
+        {
+            ssize_t got = read(m_readFd, &token, 1);
+            if (got == 1)
+                return true;
+            if (!retry(got, m_readFd, POLLIN))
+                m_failed = true;
+        }
+#else
+        (void)token;
+#endif
+        return false;
+    }
+
+    void release(char token)
+    {
+#ifndef _WIN32
+        while (available())
+        {
+            ssize_t written = write(m_writeFd, &token, 1);
+            if (written == 1)
+                return;
+            if (!retry(written, m_writeFd, POLLOUT))
+                m_failed = true;
+        }
+#else
+        (void)token;
+#endif
+    }
+
+private:
+    int m_readFd = -1;
+    int m_writeFd = -1;
+    bool m_ownsFds = false;
+    std::atomic<bool> m_failed{false};
+
+#ifndef _WIN32
+    // After a read or write that moved nothing: whether to try again. make
+    // 4.3 hands out a non-blocking pipe, so EAGAIN waits for it to be ready;
+    // end of file and other errors mean the jobserver is unusable.
+    static bool retry(ssize_t result, int fd, short events)
+    {
+        if (result >= 0)
+            return false;
+        if (errno == EINTR)
+            return true;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            return false;
+        pollfd ready{fd, events, 0};
+        while (poll(&ready, 1, -1) < 0)
+        {
+            if (errno != EINTR)
+                return false;
+        }
+        return true;
+    }
+
+    void parseMakeFlags(const std::string &flags)
+    {
+        std::string auth;
+        for (const char *key : {"--jobserver-auth=", "--jobserver-fds="})
+        {
+            size_t pos = flags.rfind(key);
+            if (pos != std::string::npos)
+            {
+                size_t start = pos + std::string(key).size();
+                auth = flags.substr(start, flags.find(' ', start) - start);
+                break;
+            }
+        }
+
+        if (auth.empty())
+            return;
+
+        if (auth.rfind("fifo:", 0) == 0)
+        {
+            int fd = open(auth.substr(5).c_str(), O_RDWR);
+            if (fd >= 0)
+            {
+                m_readFd = m_writeFd = fd;
+                m_ownsFds = true;
+            }
+            return;
+        }
+
+        size_t comma = auth.find(',');
+        if (comma == std::string::npos)
+            return;
+
+        int readFd = std::atoi(auth.substr(0, comma).c_str());
+        int writeFd = std::atoi(auth.substr(comma + 1).c_str());
+
+        // make closes the pipe for recipes not marked as recursive ('+'),
+        // in which case the advertised descriptors are stale
+        if (fcntl(readFd, F_GETFD) == -1 || fcntl(writeFd, F_GETFD) == -1)
+            return;
+
+        m_readFd = readFd;
+        m_writeFd = writeFd;
+    }
+#endif
+};
+
+/*
+Concurrency limit for backend compiler jobs: at most `limit` at once, and
+every job beyond the implicit one also holds a jobserver token if a jobserver
+is present.
+*/
+class JobSlots
+{
+public:
+    struct Slot
+    {
+        bool implicit;
+        char token;
+    };
+
+    JobSlots(size_t limit, JobServer &jobServer)
+        : m_limit(limit == 0 ? 1 : limit), m_jobServer(jobServer) {}
+
+    size_t limit() const
+    {
+        return m_limit;
+    }
+
+    Slot acquire()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]
+                  { return m_active < m_limit; });
+        m_active++;
+
+        if (m_implicitFree || !m_jobServer.available())
+        {
+            m_implicitFree = false;
+            return {true, '\0'};
+        }
+
+        lock.unlock();
+        char token;
+        if (m_jobServer.acquire(token))
+            return {false, token};
+        return {true, '\0'}; // the jobserver failed; m_limit still holds
+    }
+
+    void release(const Slot &slot)
+    {
+        if (!slot.implicit)
+        {
+            m_jobServer.release(slot.token);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (slot.implicit && m_jobServer.available())
+            {
+                m_implicitFree = true;
+            }
+            m_active--;
+        }
+        m_cv.notify_one();
+    }
+
+private:
+    size_t m_limit;
+    JobServer &m_jobServer;
+    size_t m_active = 0;
+    bool m_implicitFree = true;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+};
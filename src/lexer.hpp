@@ -10,8 +10,8 @@
 class Lexer
 {
 public:
-    explicit Lexer(const std::string &source)
-        : m_source(source), m_currentPos(0), m_cline(1) {}
+    explicit Lexer(const std::string &source, int line = 1)
+        : m_source(source), m_currentPos(0), m_cline(line) {}
 
     std::vector<Token> tokenize()
     {
@@ -101,6 +101,12 @@ private:
         case ';':
             advance();
             return Token{TokenType::SEMICOLON, m_cline};
+        case ':':
+            advance();
+            return Token{TokenType::COLON, m_cline};
+        case ',':
+            advance();
+            return Token{TokenType::COMMA, m_cline};
         case '(':
             advance();
             return Token{TokenType::LPAREN, m_cline};
@@ -233,6 +239,12 @@ private:
             return Token{TokenType::LT, m_cline};
         }
         case '>':
+            if (peekNext() == '>')
+            {
+                advance();
+                advance();
+                return Token{TokenType::STREAM_IN, m_cline};
+            }
             advance();
             return Token{TokenType::GT, m_cline};
         case '!':
@@ -300,6 +312,12 @@ private:
             return numberLiteral();
         }
 
+        if (c == 'f' && peekNext() == '"')
+        {
+            advance();
+            return stringLiteral(true);
+        }
+
         if (isalpha(c) || c == '_')
         {
             return identifier();
@@ -308,14 +326,29 @@ private:
         return std::nullopt;
     }
 
-    Token stringLiteral()
+    // An f-string is kept whole for the parser. Inside its braces a '"'
+    // opens a string of the expression instead of ending the f-string.
+    Token stringLiteral(bool interpolated = false)
     {
         advance();
         std::string value;
-        while (peek() != '"' && !isAtEnd())
+        int depth = 0;
+        bool nested = false;
+        while ((peek() != '"' || depth > 0) && !isAtEnd())
         {
-            if (peek() == '\n')
+            char c = peek();
+            if (c == '\n')
                 m_cline++;
+            if (!interpolated || nested)
+                nested = nested && c != '"';
+            else if (c == '"')
+                nested = true;
+            else if ((c == '{' || c == '}') && depth == 0 && peekNext() == c)
+                value += advance(); // {{ or }}
+            else if (c == '{')
+                depth++;
+            else if (c == '}' && depth > 0)
+                depth--;
             value += advance();
         }
 
@@ -325,7 +358,7 @@ private:
         }
 
         advance();
-        return {TokenType::STRING_LIT, m_cline, value};
+        return {interpolated ? TokenType::FSTRING_LIT : TokenType::STRING_LIT, m_cline, value};
     }
 
     Token numberLiteral()
@@ -372,12 +405,23 @@ const std::unordered_map<std::string, TokenType> Lexer::keywords = {
     {"num", TokenType::KEYWORD_VAR_NUM},
     {"str", TokenType::KEYWORD_VAR_STR},
     {"arr", TokenType::KEYWORD_VAR_ARR},
+    {"i32", TokenType::KEYWORD_VAR_I32},
+    {"i64", TokenType::KEYWORD_VAR_I64},
+    {"f32", TokenType::KEYWORD_VAR_F32},
+    {"f64", TokenType::KEYWORD_VAR_F64},
+    {"bool", TokenType::KEYWORD_VAR_BOOL},
+    {"chan", TokenType::KEYWORD_VAR_CHAN},
+    {"str_view", TokenType::KEYWORD_VAR_VIEW},
     {"if", TokenType::IF},
     {"elif", TokenType::ELIF},
     {"else", TokenType::ELSE},
     {"while", TokenType::WHILE},
     {"do", TokenType::DO},
     {"for", TokenType::FOR},
+    {"pfor", TokenType::PFOR},
+    {"spawn", TokenType::SPAWN},
+    {"await", TokenType::AWAIT},
+    {"yield", TokenType::YIELD},
     {"break", TokenType::BREAK},
     {"continue", TokenType::CONTINUE},
     {"print", TokenType::PRINT},
@@ -0,0 +1,279 @@
+#pragma once
+
+#include "ir.hpp"
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+/*
+How the generator turns IR values back into C++ locals.
+
+A value used once, later in its own block with only pure instructions in
+between, is not given a local: it is written into its use as a nested
+expression. The remaining values get one local each, except that a phi
+shares its local with those of its operands whose lifetimes do not
+overlap with it. That removes the copies on most edges: a loop counter
+ends up as one variable again, not one per definition.
+*/
+namespace IR
+{
+    class Locals
+    {
+    public:
+        explicit Locals(const Function &func)
+            : m_uses(func.values.size()), m_inlined(func.values.size()),
+              m_defs(func.values.size(), NONE), m_parent(func.values.size()),
+              m_liveIn(func.blockCount), m_liveOut(func.blockCount)
+        {
+            findUses(func);
+            findInlined(func);
+            computeLiveness(func);
+            coalesce(func);
+        }
+
+        bool inlined(const Instr *value) const
+        {
+            return m_inlined[value->id];
+        }
+
+        // The value whose local holds `value`.
+        const Instr *local(const Instr *value) const
+        {
+            while (m_parent[value->id])
+            {
+                value = m_parent[value->id];
+            }
+            return value;
+        }
+
+        // Values that need a local of their own, in creation order.
+        std::vector<const Instr *> declarations(const Function &func) const
+        {
+            std::vector<const Instr *> locals;
+            for (const Instr &value : func.values)
+            {
+                if (m_defs[value.id] != NONE && !m_parent[value.id])
+                    locals.push_back(&value);
+            }
+            return locals;
+        }
+
+    private:
+        static constexpr int NONE = INT_MIN; // no local
+
+        struct Use
+        {
+            const Block *block;
+            int position;           // index of the using instruction, or instrs.size() at the exit
+            const Instr *user;      // null for exits and phi operands
+            bool edge = false;      // phi operand, read on the way out of `block`
+        };
+
+        // all by value id
+        std::vector<std::vector<Use>> m_uses;
+        std::vector<char> m_inlined;
+        std::vector<int> m_defs; // position in its block, -1 for phis
+        std::vector<const Instr *> m_parent;
+        // by block id, sorted value ids
+        std::vector<std::vector<int>> m_liveIn, m_liveOut;
+
+        void findUses(const Function &func)
+        {
+            for (const auto &block : func.blocks)
+            {
+                const auto &instrs = block->instrs;
+                int end = static_cast<int>(instrs.size());
+                for (int i = 0; i < end; ++i)
+                {
+                    for (const Instr *operand : instrs[i]->operands)
+                    {
+                        m_uses[operand->id].push_back({block.get(), i, instrs[i]});
+                    }
+                }
+                if (block->value)
+                    m_uses[block->value->id].push_back({block.get(), end, nullptr});
+
+                for (const Instr *phi : block->phis)
+                {
+                    for (size_t i = 0; i < phi->operands.size(); ++i)
+                    {
+                        const Block *pred = block->preds[i];
+                        m_uses[phi->operands[i]->id].push_back({pred, static_cast<int>(pred->instrs.size()), nullptr, true});
+                    }
+                }
+            }
+        }
+
+        void findInlined(const Function &func)
+        {
+            for (const auto &block : func.blocks)
+            {
+                const auto &instrs = block->instrs;
+                for (size_t i = 0; i < instrs.size(); ++i)
+                {
+                    const Instr *instr = instrs[i];
+                    const auto &uses = m_uses[instr->id];
+                    if (!instr->pure() || uses.size() != 1 || uses[0].block != block.get())
+                        continue;
+
+                    // it may move down to its use past pure instructions only
+                    if (std::all_of(instrs.begin() + i + 1, instrs.begin() + uses[0].position,
+                                    [](const Instr *between)
+                                    { return between->pure(); }))
+                        m_inlined[instr->id] = true;
+                }
+            }
+
+            for (const auto &block : func.blocks)
+            {
+                for (const Instr *phi : block->phis)
+                {
+                    m_defs[phi->id] = -1;
+                }
+                for (size_t i = 0; i < block->instrs.size(); ++i)
+                {
+                    const Instr *instr = block->instrs[i];
+                    if (instr->type != AST::Type::Void && !inlined(instr))
+                        m_defs[instr->id] = static_cast<int>(i);
+                }
+            }
+        }
+
+        // Where an operand of `user` is actually read: an inlined user is
+        // evaluated at its own use.
+        Use effective(Use use) const
+        {
+            while (use.user && inlined(use.user))
+            {
+                use = m_uses[use.user->id][0];
+            }
+            return use;
+        }
+
+        // From each use back to the definition (Appel's path exploration);
+        // values are visited in id order, so every set comes out sorted.
+        void computeLiveness(const Function &func)
+        {
+            std::vector<int> inStamp(func.blockCount, -1), outStamp(func.blockCount, -1);
+            std::vector<const Block *> work;
+
+            for (const Instr &value : func.values)
+            {
+                int id = value.id;
+                if (m_defs[id] == NONE)
+                    continue;
+
+                auto liveOut = [&](const Block *block)
+                {
+                    if (outStamp[block->id] != id)
+                    {
+                        outStamp[block->id] = id;
+                        m_liveOut[block->id].push_back(id);
+                    }
+                };
+
+                for (const Use &use : m_uses[id])
+                {
+                    Use at = effective(use);
+                    if (at.edge)
+                        liveOut(at.block);
+                    if (at.block != value.block)
+                        work.push_back(at.block);
+                }
+
+                while (!work.empty())
+                {
+                    const Block *block = work.back();
+                    work.pop_back();
+                    if (block == value.block || inStamp[block->id] == id)
+                        continue;
+
+                    inStamp[block->id] = id;
+                    m_liveIn[block->id].push_back(id);
+                    for (const Block *pred : block->preds)
+                    {
+                        liveOut(pred);
+                        work.push_back(pred);
+                    }
+                }
+            }
+        }
+
+        static bool contains(const std::vector<int> &set, int id)
+        {
+            return std::binary_search(set.begin(), set.end(), id);
+        }
+
+        // Whether `value` still has to be kept after `def` is defined.
+        bool liveAfter(const Instr *value, const Instr *def) const
+        {
+            const Block *block = def->block;
+            int position = m_defs[def->id];
+
+            bool defined = contains(m_liveIn[block->id], value->id) ||
+                           (value->block == block && m_defs[value->id] <= position);
+            if (!defined)
+                return false;
+            if (value->op == Op::Phi && def->op == Op::Phi && value->block == block)
+                return true;
+            if (contains(m_liveOut[block->id], value->id))
+                return true;
+
+            for (const Use &use : m_uses[value->id])
+            {
+                Use at = effective(use);
+                if (at.block == block && at.position > position)
+                    return true;
+            }
+            return false;
+        }
+
+        bool interfere(const Instr *a, const Instr *b) const
+        {
+            return liveAfter(a, b) || liveAfter(b, a);
+        }
+
+        void coalesce(const Function &func)
+        {
+            std::vector<std::vector<const Instr *>> members(func.values.size());
+            for (Block *block : func.reversePostorder())
+            {
+                for (const Instr *phi : block->phis)
+                {
+                    for (const Instr *operand : phi->operands)
+                    {
+                        if (m_defs[operand->id] == NONE || operand->type != phi->type)
+                            continue;
+
+                        const Instr *a = local(phi);
+                        const Instr *b = local(operand);
+                        if (a == b)
+                            continue;
+
+                        auto &into = members[a->id];
+                        auto &from = members[b->id];
+                        if (into.empty())
+                            into.push_back(a);
+                        if (from.empty())
+                            from.push_back(b);
+
+                        bool overlap = false;
+                        for (const Instr *x : into)
+                        {
+                            for (const Instr *y : from)
+                            {
+                                overlap = overlap || interfere(x, y);
+                            }
+                        }
+                        if (overlap)
+                            continue;
+
+                        m_parent[b->id] = a;
+                        into.insert(into.end(), from.begin(), from.end());
+                        from.clear();
+                    }
+                }
+            }
+        }
+    };
+}
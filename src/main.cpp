@@ -1,12 +1,12 @@
-#include "lexer.hpp"
-#include "parser.hpp"
-#include "generator.hpp"
+#include "driver.hpp"
+#include "build.hpp"
+#include "server.hpp"
 #include <iostream>
 #include <fstream>
 #include <cstdlib>
 #include <cstdio>
 
-void compileNRun(std::string &code)
+void compileNRun(const OutputBuffer &code, const CompileOptions &options)
 {
     const std::string cppFile = "_temp.cxx";
     const std::string exeFile =
@@ -16,17 +16,12 @@ void compileNRun(std::string &code)
         "_temp";
     #endif
 
-    std::ofstream f(cppFile);
-    if (!f.is_open())
+    if (!code.writeToFile(cppFile))
     {
         return;
     }
 
-    f << code;
-    f.close();
-
-    std::string compileCmd = "g++ " + cppFile + " -o " + exeFile;
-    int compileResult = system(compileCmd.c_str());
+    int compileResult = runProcess(compilerCommand(cppFile, exeFile, options));
 
     if (compileResult != 0)
     {
@@ -50,28 +45,171 @@ void compileNRun(std::string &code)
     }
 }
 
+int buildCommand(int argc, char **argv)
+{
+    BuildOptions options;
+    std::vector<std::string> paths;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc)
+        {
+            options.jobs = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg.rfind("-j", 0) == 0 && arg.size() > 2)
+        {
+            options.jobs = std::strtoul(arg.c_str() + 2, nullptr, 10);
+        }
+        else if (arg == "--incremental")
+        {
+            options.incremental = true;
+        }
+        else if (arg == "--no-parallel")
+        {
+            options.compile.openmp = false;
+        }
+        else if (arg == "--no-opt")
+        {
+            options.compile.optimize = false;
+        }
+        else if (arg.rfind("-O", 0) == 0 && arg.size() > 2)
+        {
+            options.compile.level = arg;
+        }
+        else if (arg == "--split" && i + 1 < argc)
+        {
+            options.split = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "-o" && i + 1 < argc)
+        {
+            options.outDir = argv[++i];
+        }
+        else
+        {
+            paths.push_back(arg);
+        }
+    }
+
+    if (options.incremental && options.split > 1)
+    {
+        std::cerr << "--incremental and --split cannot be combined\n";
+        return 1;
+    }
+
+    auto sources = BatchBuilder::collectSources(paths);
+    if (sources.empty())
+    {
+        std::cerr << "Usage: " << argv[0] << " build [-j N] [-o <dir>] [--incremental | --split N] [--no-parallel] [--no-opt] [-O<level>] <file.gvd | dir>...\n";
+        return 1;
+    }
+
+    BatchBuilder builder(std::move(sources), std::move(options));
+    return builder.run();
+}
+
+#ifndef _WIN32
+int serverCommand(int argc, char **argv)
+{
+    std::string socketPath = defaultSocketPath();
+    CompileOptions options;
+    std::vector<std::string> rest;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "-s" && i + 1 < argc)
+        {
+            socketPath = argv[++i];
+        }
+        else if (arg == "--no-parallel")
+        {
+            options.openmp = false;
+        }
+        else if (arg == "--no-opt")
+        {
+            options.optimize = false;
+        }
+        else if (arg.rfind("-O", 0) == 0 && arg.size() > 2)
+        {
+            options.level = arg;
+        }
+        else
+        {
+            rest.push_back(arg);
+        }
+    }
+
+    if (std::string(argv[1]) == "serve")
+    {
+        CompileServer server(socketPath, options);
+        return server.run();
+    }
+
+    if (rest.size() != 2 || (rest[0] != "compile" && rest[0] != "run"))
+    {
+        std::cerr << "Usage: " << argv[0] << " client [-s <socket>] compile|run <file.gvd>\n";
+        return 1;
+    }
+    return clientCommand(socketPath, rest[0], rest[1]);
+}
+#endif
 
 int main(int argc, char **argv)
 {
     if (argc < 2)
     {
-        std::cerr << "Usage: " << argv[0] << " <source_file>\n";
+        std::cerr << "Usage: " << argv[0] << " [--no-parallel] [--no-opt] [-O<level>] <source_file>\n";
+        std::cerr << "       " << argv[0] << " build [-j N] [-o <dir>] [--incremental | --split N] [--no-parallel] [--no-opt] [-O<level>] <file.gvd | dir>...\n";
+        std::cerr << "       " << argv[0] << " serve [-s <socket>] [--no-parallel] [--no-opt] [-O<level>]\n";
+        std::cerr << "       " << argv[0] << " client [-s <socket>] compile|run <file.gvd>\n";
+        return 1;
+    }
+
+    if (std::string(argv[1]) == "build")
+    {
+        return buildCommand(argc, argv);
+    }
+
+#ifndef _WIN32
+    if (std::string(argv[1]) == "serve" || std::string(argv[1]) == "client")
+    {
+        return serverCommand(argc, argv);
+    }
+#endif
+
+    CompileOptions options;
+    int first = 1;
+    for (; first + 1 < argc; ++first)
+    {
+        std::string arg = argv[first];
+        if (arg == "--no-parallel")
+            options.openmp = false;
+        else if (arg == "--no-opt")
+            options.optimize = false;
+        else if (arg.rfind("-O", 0) == 0 && arg.size() > 2)
+            options.level = arg;
+        else
+            break;
+    }
+    const char *path = argv[first];
+
+    std::string source;
+    if (!readSource(path, source))
+    {
+        std::cerr << "Error opening file: " << path << "\n";
         return 1;
     }
-    std::ifstream file(argv[1]);
-    if (!file.is_open())
+    OutputBuffer cppCode;
+    try
     {
-        std::cerr << "Error opening file: " << argv[1] << "\n";
+        translate(source, cppCode, options);
+    }
+    catch (const std::runtime_error &error)
+    {
+        std::cerr << error.what() << "\n";
         return 1;
     }
-    std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-    Lexer lexer(source);
-    auto tokens = lexer.tokenize();
-    Parser parse(tokens);
-    auto ast = parse.parse();
-    Generator generator(ast);
-    std::string cppCode = generator.generate();
-    compileNRun(cppCode);
-    file.close();
+    compileNRun(cppCode, options);
     return 0;
-}
\ No newline at end of file
+}
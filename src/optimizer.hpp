@@ -0,0 +1,975 @@
+#pragma once
+
+#include "ast.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+Constant folding and propagation on the annotated AST, between Sema and the
+generator.
+
+Operators whose operands are literals are evaluated at compile time
+(arithmetic, comparisons, logic, concatenation of string literals). A
+variable that is never assigned after its declaration and is initialized
+with a literal of its own type is replaced by that literal wherever it is
+read, which in turn feeds further folding; a global only if that literal is
+its value from the start (generateGlobals()). Strings are not propagated: a
+literal is a char array in C++, not a std::string. An `if`, `while` or `for`
+whose condition folds to a constant is replaced by the code that actually
+runs.
+
+Folding computes exactly what the generated C++ would: i64 arithmetic that
+overflows, division by zero and non-finite results are left to run time.
+
+Dead code is removed afterwards: functions that cannot be reached from the
+top-level statements, and variables that are never referenced and whose
+initializer has no side effects (repeatedly, since dropping one variable
+can leave the ones its initializer read unused).
+*/
+class Optimizer
+{
+public:
+    explicit Optimizer(AST::StmtList &statements)
+        : m_statements(statements) {}
+
+    void optimize()
+    {
+        // The first walk only learns which variables are ever written;
+        // propagation needs the whole program for that.
+        m_collecting = true;
+        walkProgram();
+        m_collecting = false;
+        walkProgram();
+
+        removeUnreachableFunctions();
+        do
+        {
+            countReferences();
+        } while (sweepUnused());
+    }
+
+private:
+    // A compile-time value; which member is used depends on `kind`.
+    struct Constant
+    {
+        enum class Kind
+        {
+            Int,
+            Real,
+            Bool,
+            Str
+        } kind;
+        int64_t i = 0;
+        double d = 0;
+        bool b = false;
+        std::string s;
+
+        bool isNumber() const
+        {
+            return kind == Kind::Int || kind == Kind::Real;
+        }
+
+        double real() const
+        {
+            return kind == Kind::Int ? static_cast<double>(i) : d;
+        }
+    };
+
+    // null for parameters, which only shadow
+    using Scope = std::unordered_map<std::string, AST::VarDeclStmt *>;
+
+    AST::StmtList &m_statements;
+    std::vector<Scope> m_scopes;
+    std::unordered_set<const AST::VarDeclStmt *> m_written;
+    std::unordered_map<const AST::VarDeclStmt *, size_t> m_references;
+    bool m_collecting = false;
+
+    void walkProgram()
+    {
+        m_scopes.clear();
+        m_scopes.emplace_back();
+        for (auto &stmt : m_statements)
+        {
+            if (auto varDecl = dynamic_cast<AST::VarDeclStmt *>(stmt.get()))
+            {
+                m_scopes.back()[varDecl->name] = varDecl;
+            }
+        }
+
+        for (auto &stmt : m_statements)
+        {
+            if (!dynamic_cast<AST::FunctionStmt *>(stmt.get()))
+            {
+                foldStmt(stmt);
+            }
+        }
+        for (auto &stmt : m_statements)
+        {
+            if (stmt && dynamic_cast<AST::FunctionStmt *>(stmt.get()))
+            {
+                foldStmt(stmt);
+            }
+        }
+        eraseRemoved(m_statements);
+    }
+
+    static void eraseRemoved(AST::StmtList &statements)
+    {
+        statements.erase(std::remove(statements.begin(), statements.end(), nullptr), statements.end());
+    }
+
+    AST::VarDeclStmt *lookup(const std::string &name)
+    {
+        for (auto it = m_scopes.rbegin(); it != m_scopes.rend(); ++it)
+        {
+            auto found = it->find(name);
+            if (found != it->end())
+                return found->second;
+        }
+        return nullptr;
+    }
+
+    void markWritten(const AST::Expr &target)
+    {
+        if (auto ident = dynamic_cast<const AST::IdentifierExpr *>(&target))
+        {
+            if (auto decl = lookup(ident->name))
+                m_written.insert(decl);
+        }
+        else if (auto index = dynamic_cast<const AST::IndexExpr *>(&target))
+        {
+            markWritten(*index->array);
+        }
+    }
+
+    // Literal a read of `name` can be replaced with, if any.
+    const AST::LiteralExpr *constantValue(const std::string &name)
+    {
+        if (m_collecting)
+            return nullptr;
+
+        // a global with a value computed in main() is 0 before that, and a
+        // function may read it then
+        auto decl = lookup(name);
+        if (!decl || m_written.count(decl) || !decl->initializer || (decl->global && !decl->constant))
+            return nullptr;
+
+        auto literal = dynamic_cast<const AST::LiteralExpr *>(decl->initializer.get());
+        if (!literal || literal->Expr::type != decl->varType || decl->varType == AST::Type::Str)
+            return nullptr;
+        return literal;
+    }
+
+    // Folds `stmt` in place; resets it to null when nothing of it remains.
+    void foldStmt(AST::StmtPtr &stmt)
+    {
+        if (auto varDecl = dynamic_cast<AST::VarDeclStmt *>(stmt.get()))
+        {
+            if (varDecl->initializer)
+                foldExpr(varDecl->initializer);
+            m_scopes.back()[varDecl->name] = varDecl;
+        }
+        else if (auto exprStmt = dynamic_cast<AST::ExprStmt *>(stmt.get()))
+        {
+            foldExpr(exprStmt->expr);
+        }
+        else if (auto block = dynamic_cast<AST::BlockStmt *>(stmt.get()))
+        {
+            m_scopes.emplace_back();
+            for (auto &s : block->statements)
+            {
+                foldStmt(s);
+            }
+            eraseRemoved(block->statements);
+            m_scopes.pop_back();
+        }
+        else if (auto ifStmt = dynamic_cast<AST::IfStmt *>(stmt.get()))
+        {
+            foldExpr(ifStmt->condition);
+            foldScoped(ifStmt->thenBranch);
+            if (ifStmt->elseBranch)
+                foldScoped(ifStmt->elseBranch);
+
+            bool taken;
+            if (truthValue(*ifStmt->condition, taken))
+            {
+                AST::StmtPtr branch = taken ? std::move(ifStmt->thenBranch) : std::move(ifStmt->elseBranch);
+                stmt = branch ? asBlock(std::move(branch)) : nullptr;
+            }
+        }
+        else if (auto whileStmt = dynamic_cast<AST::WhileStmt *>(stmt.get()))
+        {
+            foldExpr(whileStmt->condition);
+            foldScoped(whileStmt->body);
+
+            bool taken;
+            if (truthValue(*whileStmt->condition, taken) && !taken)
+                stmt = nullptr;
+        }
+        else if (auto forStmt = dynamic_cast<AST::ForStmt *>(stmt.get()))
+        {
+            m_scopes.emplace_back();
+            if (forStmt->initializer)
+                foldStmt(forStmt->initializer);
+            if (forStmt->condition)
+                foldExpr(forStmt->condition);
+            if (forStmt->increment)
+                foldExpr(forStmt->increment);
+            foldScoped(forStmt->body);
+            m_scopes.pop_back();
+
+            bool taken;
+            if (forStmt->condition && truthValue(*forStmt->condition, taken) && !taken)
+                stmt = forStmt->initializer ? asBlock(std::move(forStmt->initializer)) : nullptr;
+        }
+        else if (auto forIn = dynamic_cast<AST::ForInStmt *>(stmt.get()))
+        {
+            foldExpr(forIn->iterable);
+            m_scopes.emplace_back();
+            m_scopes.back()[forIn->name] = nullptr;
+            foldScoped(forIn->body);
+            m_scopes.pop_back();
+        }
+        else if (auto ret = dynamic_cast<AST::ReturnStmt *>(stmt.get()))
+        {
+            if (ret->value)
+                foldExpr(ret->value);
+        }
+        else if (auto func = dynamic_cast<AST::FunctionStmt *>(stmt.get()))
+        {
+            m_scopes.emplace_back();
+            for (const auto &param : func->params)
+            {
+                m_scopes.back()[param] = nullptr;
+            }
+
+            // the body block shares the parameter scope
+            if (auto body = dynamic_cast<AST::BlockStmt *>(func->body.get()))
+            {
+                for (auto &s : body->statements)
+                {
+                    foldStmt(s);
+                }
+                eraseRemoved(body->statements);
+            }
+            else
+            {
+                foldScoped(func->body);
+            }
+            m_scopes.pop_back();
+        }
+    }
+
+    // Branch and loop bodies are always kept, if only as an empty block.
+    void foldScoped(AST::StmtPtr &stmt)
+    {
+        m_scopes.emplace_back();
+        int line = stmt->line;
+        foldStmt(stmt);
+        if (!stmt)
+            stmt = std::make_unique<AST::BlockStmt>(AST::StmtList(), line);
+        m_scopes.pop_back();
+    }
+
+    // A branch that replaces its `if` keeps its own scope.
+    static AST::StmtPtr asBlock(AST::StmtPtr stmt)
+    {
+        if (dynamic_cast<AST::BlockStmt *>(stmt.get()))
+            return stmt;
+
+        int line = stmt->line;
+        AST::StmtList statements;
+        statements.push_back(std::move(stmt));
+        return std::make_unique<AST::BlockStmt>(std::move(statements), line);
+    }
+
+    void foldExpr(AST::ExprPtr &expr)
+    {
+        if (auto ident = dynamic_cast<AST::IdentifierExpr *>(expr.get()))
+        {
+            if (auto literal = constantValue(ident->name))
+            {
+                auto copy = std::make_unique<AST::LiteralExpr>(literal->value, literal->type, ident->line);
+                copy->Expr::type = literal->Expr::type;
+                expr = std::move(copy);
+            }
+        }
+        else if (auto unary = dynamic_cast<AST::UnaryExpr *>(expr.get()))
+        {
+            if (unary->op == TokenType::PLUS_PLUS || unary->op == TokenType::MINUS_MINUS)
+            {
+                markWritten(*unary->right);
+                return;
+            }
+
+            foldExpr(unary->right);
+            Constant operand;
+            if (constantOf(*unary->right, operand) && foldUnary(unary->op, operand))
+                expr = literalOf(operand, unary->line);
+        }
+        else if (auto binary = dynamic_cast<AST::BinaryExpr *>(expr.get()))
+        {
+            if (isAssignment(binary->op))
+            {
+                markWritten(*binary->left);
+                if (auto index = dynamic_cast<AST::IndexExpr *>(binary->left.get()))
+                    foldExpr(index->index);
+                foldExpr(binary->right);
+                return;
+            }
+
+            foldExpr(binary->left);
+            foldExpr(binary->right);
+
+            Constant left, right;
+            bool leftConstant = constantOf(*binary->left, left);
+            bool rightConstant = constantOf(*binary->right, right);
+
+            if (leftConstant && rightConstant && foldBinary(*binary, left, right))
+            {
+                expr = literalOf(left, binary->line);
+            }
+            else if (leftConstant && left.kind == Constant::Kind::Bool &&
+                     (binary->op == TokenType::LOGICAL_AND || binary->op == TokenType::LOGICAL_OR))
+            {
+                // false && x, true || x: x never runs. true && x, false || x: x decides.
+                bool decides = (binary->op == TokenType::LOGICAL_AND) == left.b;
+                if (!decides)
+                    expr = literalOf(left, binary->line);
+                else if (binary->right->type == AST::Type::Bool)
+                    expr = std::move(binary->right);
+            }
+        }
+        else if (auto call = dynamic_cast<AST::CallExpr *>(expr.get()))
+        {
+            for (auto &arg : call->args)
+            {
+                foldExpr(arg);
+            }
+        }
+        else if (auto index = dynamic_cast<AST::IndexExpr *>(expr.get()))
+        {
+            foldExpr(index->array);
+            foldExpr(index->index);
+        }
+    }
+
+    static bool isAssignment(TokenType op)
+    {
+        switch (op)
+        {
+        case TokenType::ASSIGN:
+        case TokenType::PLUS_EQ:
+        case TokenType::MINUS_EQ:
+        case TokenType::ASTER_EQ:
+        case TokenType::FSLASH_EQ:
+        case TokenType::PERCENT_EQ:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static bool constantOf(const AST::Expr &expr, Constant &value)
+    {
+        auto literal = dynamic_cast<const AST::LiteralExpr *>(&expr);
+        if (!literal)
+            return false;
+
+        switch (literal->type)
+        {
+        case TokenType::NUMBER:
+            if (expr.type == AST::Type::Int)
+            {
+                value.kind = Constant::Kind::Int;
+                const char *end = literal->value.data() + literal->value.size();
+                return std::from_chars(literal->value.data(), end, value.i).ptr == end;
+            }
+            if (expr.type == AST::Type::Num)
+            {
+                value.kind = Constant::Kind::Real;
+                value.d = std::strtod(literal->value.c_str(), nullptr);
+                return true;
+            }
+            return false;
+        case TokenType::TRUE:
+        case TokenType::FALSE:
+            value.kind = Constant::Kind::Bool;
+            value.b = literal->type == TokenType::TRUE;
+            return true;
+        case TokenType::STRING_LIT:
+            value.kind = Constant::Kind::Str;
+            value.s = literal->value;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static bool truthValue(const AST::Expr &condition, bool &value)
+    {
+        Constant constant;
+        if (!constantOf(condition, constant))
+            return false;
+
+        switch (constant.kind)
+        {
+        case Constant::Kind::Bool:
+            value = constant.b;
+            return true;
+        case Constant::Kind::Int:
+            value = constant.i != 0;
+            return true;
+        case Constant::Kind::Real:
+            value = constant.d != 0;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static AST::ExprPtr literalOf(const Constant &value, int line)
+    {
+        std::unique_ptr<AST::LiteralExpr> literal;
+        switch (value.kind)
+        {
+        case Constant::Kind::Int:
+            literal = std::make_unique<AST::LiteralExpr>(std::to_string(value.i), TokenType::NUMBER, line);
+            literal->Expr::type = AST::Type::Int;
+            break;
+        case Constant::Kind::Real:
+            literal = std::make_unique<AST::LiteralExpr>(realLiteral(value.d), TokenType::NUMBER, line);
+            literal->Expr::type = AST::Type::Num;
+            break;
+        case Constant::Kind::Bool:
+            literal = std::make_unique<AST::LiteralExpr>(value.b ? "true" : "false",
+                                                         value.b ? TokenType::TRUE : TokenType::FALSE, line);
+            literal->Expr::type = AST::Type::Bool;
+            break;
+        case Constant::Kind::Str:
+            literal = std::make_unique<AST::LiteralExpr>(value.s, TokenType::STRING_LIT, line);
+            literal->Expr::type = AST::Type::Str;
+            break;
+        }
+        return literal;
+    }
+
+    // Shortest text that reads back as the same double, and still as a
+    // double rather than an integer.
+    static std::string realLiteral(double value)
+    {
+        char digits[32];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        std::string text(digits, result.ptr);
+        if (text.find_first_of(".e") == std::string::npos)
+            text += ".0";
+        return text;
+    }
+
+    static bool finite(Constant &value, double result)
+    {
+        if (!std::isfinite(result))
+            return false;
+        value.kind = Constant::Kind::Real;
+        value.d = result;
+        return true;
+    }
+
+    static bool integer(Constant &value, int64_t result)
+    {
+        // INT64_MIN has no literal form in C++
+        if (result == std::numeric_limits<int64_t>::min())
+            return false;
+        value.kind = Constant::Kind::Int;
+        value.i = result;
+        return true;
+    }
+
+    static bool boolean(Constant &value, bool result)
+    {
+        value.kind = Constant::Kind::Bool;
+        value.b = result;
+        return true;
+    }
+
+    // Applies `op` to `operand` in place; false if it cannot be folded.
+    static bool foldUnary(TokenType op, Constant &operand)
+    {
+        switch (op)
+        {
+        case TokenType::MINUS:
+            if (operand.kind == Constant::Kind::Int)
+                return integer(operand, -operand.i);
+            if (operand.kind == Constant::Kind::Real)
+                return finite(operand, -operand.d);
+            return false;
+        case TokenType::NOT:
+            if (operand.kind == Constant::Kind::Bool)
+                return boolean(operand, !operand.b);
+            if (operand.isNumber())
+                return boolean(operand, operand.real() == 0);
+            return false;
+        case TokenType::BITWISE_NOT:
+            if (operand.kind == Constant::Kind::Int)
+                return integer(operand, ~operand.i);
+            return false;
+        default:
+            return false;
+        }
+    }
+
+    // Stores the result of `left op right` in `left`; false if it cannot
+    // be folded.
+    static bool foldBinary(const AST::BinaryExpr &binary, Constant &left, const Constant &right)
+    {
+        using Kind = Constant::Kind;
+
+        if (left.kind == Kind::Str && right.kind == Kind::Str)
+        {
+            switch (binary.op)
+            {
+            case TokenType::PLUS:
+                left.s += right.s;
+                return true;
+            case TokenType::EQ_EQ:
+                return boolean(left, left.s == right.s);
+            case TokenType::BANG_EQ:
+                return boolean(left, left.s != right.s);
+            default:
+                return false;
+            }
+        }
+
+        if (left.kind == Kind::Bool && right.kind == Kind::Bool)
+        {
+            switch (binary.op)
+            {
+            case TokenType::LOGICAL_AND:
+                return boolean(left, left.b && right.b);
+            case TokenType::LOGICAL_OR:
+                return boolean(left, left.b || right.b);
+            case TokenType::EQ_EQ:
+                return boolean(left, left.b == right.b);
+            case TokenType::BANG_EQ:
+                return boolean(left, left.b != right.b);
+            default:
+                return false;
+            }
+        }
+
+        if (!left.isNumber() || !right.isNumber())
+            return false;
+
+        // sema leaves integers that could outgrow int64_t to doubles
+        if (left.kind == Kind::Int && right.kind == Kind::Int && binary.type != AST::Type::Num)
+        {
+            int64_t a = left.i, b = right.i, result;
+            switch (binary.op)
+            {
+            case TokenType::PLUS:
+                return !__builtin_add_overflow(a, b, &result) && integer(left, result);
+            case TokenType::MINUS:
+                return !__builtin_sub_overflow(a, b, &result) && integer(left, result);
+            case TokenType::ASTER:
+                return !__builtin_mul_overflow(a, b, &result) && integer(left, result);
+            case TokenType::PERCENT:
+                return b != 0 && b != -1 && integer(left, a % b);
+            case TokenType::AND:
+                return integer(left, a & b);
+            case TokenType::OR:
+                return integer(left, a | b);
+            case TokenType::XOR:
+                return integer(left, a ^ b);
+            case TokenType::EQ_EQ:
+                return boolean(left, a == b);
+            case TokenType::BANG_EQ:
+                return boolean(left, a != b);
+            case TokenType::LT:
+                return boolean(left, a < b);
+            case TokenType::GT:
+                return boolean(left, a > b);
+            case TokenType::LT_EQ:
+                return boolean(left, a <= b);
+            case TokenType::GT_EQ:
+                return boolean(left, a >= b);
+            default:
+                break; // `/` divides exactly, below
+            }
+        }
+
+        double a = left.real(), b = right.real();
+        switch (binary.op)
+        {
+        case TokenType::PLUS:
+            return finite(left, a + b);
+        case TokenType::MINUS:
+            return finite(left, a - b);
+        case TokenType::ASTER:
+            return finite(left, a * b);
+        case TokenType::FSLASH:
+            return b != 0 && finite(left, a / b);
+        case TokenType::PERCENT:
+            return b != 0 && finite(left, std::fmod(a, b));
+        case TokenType::EQ_EQ:
+            return boolean(left, a == b);
+        case TokenType::BANG_EQ:
+            return boolean(left, a != b);
+        case TokenType::LT:
+            return boolean(left, a < b);
+        case TokenType::GT:
+            return boolean(left, a > b);
+        case TokenType::LT_EQ:
+            return boolean(left, a <= b);
+        case TokenType::GT_EQ:
+            return boolean(left, a >= b);
+        default:
+            return false;
+        }
+    }
+
+    void removeUnreachableFunctions()
+    {
+        std::unordered_set<const AST::FunctionStmt *> reached;
+        std::vector<const AST::FunctionStmt *> pending;
+        auto visit = [&](const AST::FunctionStmt *func)
+        {
+            if (reached.insert(func).second)
+                pending.push_back(func);
+        };
+
+        for (const auto &stmt : m_statements)
+        {
+            if (!dynamic_cast<const AST::FunctionStmt *>(stmt.get()))
+                collectCalls(*stmt, visit);
+        }
+        while (!pending.empty())
+        {
+            const AST::FunctionStmt *func = pending.back();
+            pending.pop_back();
+            collectCalls(*func->body, visit);
+        }
+
+        m_statements.erase(std::remove_if(m_statements.begin(), m_statements.end(),
+                                          [&reached](const AST::StmtPtr &stmt)
+                                          {
+                                              auto func = dynamic_cast<const AST::FunctionStmt *>(stmt.get());
+                                              return func && !reached.count(func);
+                                          }),
+                           m_statements.end());
+    }
+
+    template <typename Visit>
+    static void collectCalls(const AST::Stmt &stmt, Visit &visit)
+    {
+        forEachChild(stmt, [&visit](const AST::Stmt *s, const AST::Expr *e)
+                     {
+            if (s)
+                collectCalls(*s, visit);
+            if (e)
+                collectCalls(*e, visit); });
+    }
+
+    template <typename Visit>
+    static void collectCalls(const AST::Expr &expr, Visit &visit)
+    {
+        if (auto call = dynamic_cast<const AST::CallExpr *>(&expr))
+        {
+            if (call->target)
+                visit(call->target);
+            for (const auto &arg : call->args)
+            {
+                collectCalls(*arg, visit);
+            }
+        }
+        else if (auto unary = dynamic_cast<const AST::UnaryExpr *>(&expr))
+        {
+            collectCalls(*unary->right, visit);
+        }
+        else if (auto binary = dynamic_cast<const AST::BinaryExpr *>(&expr))
+        {
+            collectCalls(*binary->left, visit);
+            collectCalls(*binary->right, visit);
+        }
+        else if (auto index = dynamic_cast<const AST::IndexExpr *>(&expr))
+        {
+            collectCalls(*index->array, visit);
+            collectCalls(*index->index, visit);
+        }
+    }
+
+    // Calls `each(stmt, expr)` for the direct children of `stmt`, one of
+    // them null.
+    template <typename Each>
+    static void forEachChild(const AST::Stmt &stmt, Each &&each)
+    {
+        if (auto varDecl = dynamic_cast<const AST::VarDeclStmt *>(&stmt))
+        {
+            if (varDecl->initializer)
+                each(nullptr, varDecl->initializer.get());
+        }
+        else if (auto exprStmt = dynamic_cast<const AST::ExprStmt *>(&stmt))
+        {
+            each(nullptr, exprStmt->expr.get());
+        }
+        else if (auto block = dynamic_cast<const AST::BlockStmt *>(&stmt))
+        {
+            for (const auto &s : block->statements)
+            {
+                each(s.get(), nullptr);
+            }
+        }
+        else if (auto ifStmt = dynamic_cast<const AST::IfStmt *>(&stmt))
+        {
+            each(nullptr, ifStmt->condition.get());
+            each(ifStmt->thenBranch.get(), nullptr);
+            if (ifStmt->elseBranch)
+                each(ifStmt->elseBranch.get(), nullptr);
+        }
+        else if (auto whileStmt = dynamic_cast<const AST::WhileStmt *>(&stmt))
+        {
+            each(nullptr, whileStmt->condition.get());
+            each(whileStmt->body.get(), nullptr);
+        }
+        else if (auto forStmt = dynamic_cast<const AST::ForStmt *>(&stmt))
+        {
+            if (forStmt->initializer)
+                each(forStmt->initializer.get(), nullptr);
+            if (forStmt->condition)
+                each(nullptr, forStmt->condition.get());
+            if (forStmt->increment)
+                each(nullptr, forStmt->increment.get());
+            each(forStmt->body.get(), nullptr);
+        }
+        else if (auto forIn = dynamic_cast<const AST::ForInStmt *>(&stmt))
+        {
+            each(nullptr, forIn->iterable.get());
+            each(forIn->body.get(), nullptr);
+        }
+        else if (auto ret = dynamic_cast<const AST::ReturnStmt *>(&stmt))
+        {
+            if (ret->value)
+                each(nullptr, ret->value.get());
+        }
+        else if (auto func = dynamic_cast<const AST::FunctionStmt *>(&stmt))
+        {
+            each(func->body.get(), nullptr);
+        }
+    }
+
+    // References (reads and writes) to every variable, resolved with the
+    // same scoping as Sema.
+    void countReferences()
+    {
+        m_references.clear();
+        m_scopes.clear();
+        m_scopes.emplace_back();
+        for (const auto &stmt : m_statements)
+        {
+            if (auto varDecl = dynamic_cast<AST::VarDeclStmt *>(stmt.get()))
+                m_scopes.back()[varDecl->name] = varDecl;
+        }
+        for (const auto &stmt : m_statements)
+        {
+            countStmt(*stmt);
+        }
+    }
+
+    void countStmt(const AST::Stmt &stmt)
+    {
+        if (auto varDecl = dynamic_cast<const AST::VarDeclStmt *>(&stmt))
+        {
+            if (varDecl->initializer)
+                countExpr(*varDecl->initializer);
+            m_scopes.back()[varDecl->name] = const_cast<AST::VarDeclStmt *>(varDecl);
+        }
+        else if (auto block = dynamic_cast<const AST::BlockStmt *>(&stmt))
+        {
+            m_scopes.emplace_back();
+            for (const auto &s : block->statements)
+            {
+                countStmt(*s);
+            }
+            m_scopes.pop_back();
+        }
+        else if (auto forStmt = dynamic_cast<const AST::ForStmt *>(&stmt))
+        {
+            // a pfor writes its reduction variables back after the loop
+            for (const auto &reduction : forStmt->reductions)
+            {
+                if (auto decl = lookup(reduction.second))
+                    m_references[decl]++;
+            }
+            m_scopes.emplace_back();
+            if (forStmt->initializer)
+                countStmt(*forStmt->initializer);
+            if (forStmt->condition)
+                countExpr(*forStmt->condition);
+            if (forStmt->increment)
+                countExpr(*forStmt->increment);
+            countScoped(*forStmt->body);
+            m_scopes.pop_back();
+        }
+        else if (auto forIn = dynamic_cast<const AST::ForInStmt *>(&stmt))
+        {
+            countExpr(*forIn->iterable);
+            m_scopes.emplace_back();
+            m_scopes.back()[forIn->name] = nullptr;
+            countScoped(*forIn->body);
+            m_scopes.pop_back();
+        }
+        else if (auto func = dynamic_cast<const AST::FunctionStmt *>(&stmt))
+        {
+            m_scopes.emplace_back();
+            for (const auto &param : func->params)
+            {
+                m_scopes.back()[param] = nullptr;
+            }
+
+            // the body block shares the parameter scope
+            if (auto body = dynamic_cast<const AST::BlockStmt *>(func->body.get()))
+            {
+                for (const auto &s : body->statements)
+                {
+                    countStmt(*s);
+                }
+            }
+            else
+            {
+                countScoped(*func->body);
+            }
+            m_scopes.pop_back();
+        }
+        else
+        {
+            forEachChild(stmt, [this](const AST::Stmt *s, const AST::Expr *e)
+                         {
+                if (e)
+                    countExpr(*e);
+                if (s)
+                    countScoped(*s); });
+        }
+    }
+
+    void countScoped(const AST::Stmt &stmt)
+    {
+        m_scopes.emplace_back();
+        countStmt(stmt);
+        m_scopes.pop_back();
+    }
+
+    void countExpr(const AST::Expr &expr)
+    {
+        if (auto ident = dynamic_cast<const AST::IdentifierExpr *>(&expr))
+        {
+            if (auto decl = lookup(ident->name))
+                m_references[decl]++;
+        }
+        else if (auto unary = dynamic_cast<const AST::UnaryExpr *>(&expr))
+        {
+            countExpr(*unary->right);
+        }
+        else if (auto binary = dynamic_cast<const AST::BinaryExpr *>(&expr))
+        {
+            countExpr(*binary->left);
+            countExpr(*binary->right);
+        }
+        else if (auto call = dynamic_cast<const AST::CallExpr *>(&expr))
+        {
+            for (const auto &arg : call->args)
+            {
+                countExpr(*arg);
+            }
+        }
+        else if (auto index = dynamic_cast<const AST::IndexExpr *>(&expr))
+        {
+            countExpr(*index->array);
+            countExpr(*index->index);
+        }
+    }
+
+    static bool hasSideEffects(const AST::Expr &expr)
+    {
+        if (dynamic_cast<const AST::CallExpr *>(&expr))
+            return true;
+        if (auto unary = dynamic_cast<const AST::UnaryExpr *>(&expr))
+        {
+            return unary->op == TokenType::PLUS_PLUS || unary->op == TokenType::MINUS_MINUS ||
+                   hasSideEffects(*unary->right);
+        }
+        if (auto binary = dynamic_cast<const AST::BinaryExpr *>(&expr))
+        {
+            return isAssignment(binary->op) || binary->op == TokenType::STREAM_OUT ||
+                   hasSideEffects(*binary->left) || hasSideEffects(*binary->right);
+        }
+        if (auto index = dynamic_cast<const AST::IndexExpr *>(&expr))
+            return hasSideEffects(*index->array) || hasSideEffects(*index->index);
+        return false;
+    }
+
+    bool isUnused(const AST::Stmt &stmt) const
+    {
+        auto varDecl = dynamic_cast<const AST::VarDeclStmt *>(&stmt);
+        return varDecl && !m_references.count(varDecl) &&
+               !(varDecl->initializer && hasSideEffects(*varDecl->initializer));
+    }
+
+    // Removes unused variables from every statement list; returns whether
+    // any were found.
+    bool sweepUnused()
+    {
+        return sweepList(m_statements);
+    }
+
+    bool sweepList(AST::StmtList &statements)
+    {
+        size_t before = statements.size();
+        bool removed = false;
+        for (auto &stmt : statements)
+        {
+            if (isUnused(*stmt))
+                stmt = nullptr;
+            else
+                removed = sweepChildren(*stmt) || removed;
+        }
+        eraseRemoved(statements);
+        return removed || statements.size() != before;
+    }
+
+    bool sweepSlot(AST::StmtPtr &stmt)
+    {
+        if (isUnused(*stmt))
+        {
+            stmt = std::make_unique<AST::BlockStmt>(AST::StmtList(), stmt->line);
+            return true;
+        }
+        return sweepChildren(*stmt);
+    }
+
+    bool sweepChildren(AST::Stmt &stmt)
+    {
+        if (auto block = dynamic_cast<AST::BlockStmt *>(&stmt))
+            return sweepList(block->statements);
+        if (auto ifStmt = dynamic_cast<AST::IfStmt *>(&stmt))
+        {
+            bool removed = sweepSlot(ifStmt->thenBranch);
+            return (ifStmt->elseBranch && sweepSlot(ifStmt->elseBranch)) || removed;
+        }
+        if (auto whileStmt = dynamic_cast<AST::WhileStmt *>(&stmt))
+            return sweepSlot(whileStmt->body);
+        if (auto forStmt = dynamic_cast<AST::ForStmt *>(&stmt))
+            return sweepSlot(forStmt->body);
+        if (auto forIn = dynamic_cast<AST::ForInStmt *>(&stmt))
+            return sweepSlot(forIn->body);
+        if (auto func = dynamic_cast<AST::FunctionStmt *>(&stmt))
+            return sweepSlot(func->body);
+        return false;
+    }
+};
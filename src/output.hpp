@@ -0,0 +1,233 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+/*
+Append-only output for the code generator.
+
+Text goes into a list of chunks that are never moved once written: when the
+current chunk is full a new one twice as large is started (up to MAX_CHUNK),
+so appending is amortised O(1) without the copies of a growing string, and
+the last character is always at hand. The result can be written to a file
+descriptor chunk by chunk without ever being joined into one string.
+*/
+class OutputBuffer
+{
+public:
+    explicit OutputBuffer(size_t reserve = 16 * 1024)
+    {
+        newChunk(reserve);
+    }
+
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+    OutputBuffer(OutputBuffer &&) = default;
+    OutputBuffer &operator=(OutputBuffer &&) = default;
+
+    void append(const char *data, size_t length)
+    {
+        while (length > 0)
+        {
+            Chunk &chunk = m_chunks.back();
+            size_t room = chunk.capacity - chunk.size;
+            if (room == 0)
+            {
+                newChunk(std::min(chunk.capacity * 2, MAX_CHUNK));
+                continue;
+            }
+
+            size_t n = std::min(length, room);
+            std::memcpy(chunk.data.get() + chunk.size, data, n);
+            chunk.size += n;
+            m_size += n;
+            data += n;
+            length -= n;
+        }
+    }
+
+    OutputBuffer &operator<<(std::string_view text)
+    {
+        append(text.data(), text.size());
+        return *this;
+    }
+
+    OutputBuffer &operator<<(const std::string &text)
+    {
+        append(text.data(), text.size());
+        return *this;
+    }
+
+    OutputBuffer &operator<<(const char *text)
+    {
+        append(text, std::strlen(text));
+        return *this;
+    }
+
+    OutputBuffer &operator<<(char c)
+    {
+        Chunk &chunk = m_chunks.back();
+        if (chunk.size == chunk.capacity)
+        {
+            append(&c, 1);
+            return *this;
+        }
+        chunk.data[chunk.size++] = c;
+        m_size++;
+        return *this;
+    }
+
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, char> && !std::is_same_v<T, bool>>>
+    OutputBuffer &operator<<(T value)
+    {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        append(digits, static_cast<size_t>(result.ptr - digits));
+        return *this;
+    }
+
+    OutputBuffer &operator<<(const OutputBuffer &other)
+    {
+        for (const auto &chunk : other.m_chunks)
+        {
+            append(chunk.data.get(), chunk.size);
+        }
+        return *this;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    // Last character written, or '\0' if the buffer is empty.
+    char back() const
+    {
+        for (auto it = m_chunks.rbegin(); it != m_chunks.rend(); ++it)
+        {
+            if (it->size > 0)
+                return it->data[it->size - 1];
+        }
+        return '\0';
+    }
+
+    void popBack()
+    {
+        for (auto it = m_chunks.rbegin(); it != m_chunks.rend(); ++it)
+        {
+            if (it->size > 0)
+            {
+                it->size--;
+                m_size--;
+                return;
+            }
+        }
+    }
+
+    std::string str() const
+    {
+        std::string result;
+        result.reserve(m_size);
+        for (const auto &chunk : m_chunks)
+        {
+            result.append(chunk.data.get(), chunk.size);
+        }
+        return result;
+    }
+
+    bool writeTo(int fd) const
+    {
+#ifndef _WIN32
+        std::vector<iovec> pending;
+        for (const auto &chunk : m_chunks)
+        {
+            if (chunk.size > 0)
+                pending.push_back({chunk.data.get(), chunk.size});
+        }
+
+        size_t first = 0;
+        while (first < pending.size())
+        {
+            int count = static_cast<int>(std::min<size_t>(pending.size() - first, IOV_MAX));
+            ssize_t written = writev(fd, pending.data() + first, count);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+
+            size_t remaining = static_cast<size_t>(written);
+            while (first < pending.size() && remaining >= pending[first].iov_len)
+            {
+                remaining -= pending[first].iov_len;
+                first++;
+            }
+            if (first < pending.size())
+            {
+                pending[first].iov_base = static_cast<char *>(pending[first].iov_base) + remaining;
+                pending[first].iov_len -= remaining;
+            }
+        }
+        return true;
+#else
+        std::string joined = str();
+        return _write(fd, joined.data(), static_cast<unsigned>(joined.size())) == static_cast<int>(joined.size());
+#endif
+    }
+
+    bool writeToFile(const std::string &path) const
+    {
+        std::FILE *file = std::fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+
+        // chunks are already large; skip stdio's extra copy
+        std::setvbuf(file, nullptr, _IONBF, 0);
+        bool ok = true;
+        for (const auto &chunk : m_chunks)
+        {
+            ok = ok && std::fwrite(chunk.data.get(), 1, chunk.size, file) == chunk.size;
+        }
+        return std::fclose(file) == 0 && ok;
+    }
+
+private:
+    static constexpr size_t MAX_CHUNK = 4 * 1024 * 1024;
+
+    struct Chunk
+    {
+        std::unique_ptr<char[]> data;
+        size_t size;
+        size_t capacity;
+    };
+
+    std::vector<Chunk> m_chunks;
+    size_t m_size = 0;
+
+    void newChunk(size_t capacity)
+    {
+        if (capacity == 0)
+            capacity = 1;
+        m_chunks.push_back({std::unique_ptr<char[]>(new char[capacity]), 0, capacity});
+    }
+};
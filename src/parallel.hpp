@@ -0,0 +1,748 @@
+#pragma once
+
+#include "ast.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/*
+Automatic parallelization of `for` loops, after the Optimizer. A counted
+loop (an integer counter stepping up by one to a bound the body does not
+change) whose iterations are independent is marked `parallel` and generated
+with `#pragma omp parallel for`. Integers from outside updated only by `+=`
+and the like become reductions; floating-point sums are left serial, as
+another order would round them differently. Of nested loops only the
+outermost accepted one runs in parallel.
+*/
+class Parallelizer
+{
+public:
+    explicit Parallelizer(AST::StmtList &statements)
+        : m_statements(statements) {}
+
+    void parallelize()
+    {
+        m_scopes.clear();
+        m_scopes.emplace_back();
+        for (const auto &stmt : m_statements)
+        {
+            if (auto varDecl = dynamic_cast<const AST::VarDeclStmt *>(stmt.get()))
+                m_scopes.back()[varDecl->name] = varDecl;
+        }
+
+        computePurity();
+        for (auto &stmt : m_statements)
+        {
+            visit(*stmt);
+        }
+    }
+
+private:
+    // null for parameters
+    using Scope = std::unordered_map<std::string, const AST::VarDeclStmt *>;
+    using Binding = const Scope::value_type *;
+
+    // How a loop uses one array from outside it.
+    struct ArrayUse
+    {
+        bool written = false;
+        bool whole = false;     // used other than through its elements
+        bool irregular = false; // elements other than a[i + offset] for a single offset
+        bool indexed = false;
+        int64_t offset = 0;
+
+        void element(bool affine, int64_t at)
+        {
+            if (!affine || (indexed && at != offset))
+                irregular = true;
+            indexed = true;
+            offset = at;
+        }
+    };
+
+    // What a loop body, or a function body, does to the variables around it.
+    struct Effects
+    {
+        bool barrier = false; // exits early, does I/O, writes a shared scalar or calls unknown code
+        bool heavy = false;   // contains a loop or a call
+        std::vector<const AST::FunctionStmt *> callees;
+        std::unordered_map<Binding, std::string> reductions; // operator, empty once they disagree
+        std::unordered_set<Binding> reads;                   // scalars read outside a reduction
+        std::unordered_map<Binding, ArrayUse> arrays;
+    };
+
+    AST::StmtList &m_statements;
+    std::vector<Scope> m_scopes;
+    std::unordered_map<const AST::FunctionStmt *, bool> m_pure;
+
+    // state of the body being walked
+    Effects *m_effects = nullptr;
+    size_t m_regionDepth = 0; // first scope inside the body
+    Binding m_induction = nullptr;
+    int m_loops = 0; // loops entered inside the body
+    bool m_inFunction = false;
+
+    static bool integral(AST::Type type)
+    {
+        return type == AST::Type::Bool || type == AST::Type::I32 || type == AST::Type::Int;
+    }
+
+    static bool counter(AST::Type type)
+    {
+        return type == AST::Type::I32 || type == AST::Type::Int;
+    }
+
+    // The innermost binding of `name`, and whether it is declared inside
+    // the body being walked.
+    std::pair<Binding, bool> resolve(const std::string &name) const
+    {
+        for (size_t depth = m_scopes.size(); depth-- > 0;)
+        {
+            auto found = m_scopes[depth].find(name);
+            if (found != m_scopes[depth].end())
+                return {&*found, depth >= m_regionDepth};
+        }
+        return {nullptr, false};
+    }
+
+    static bool isVariable(const AST::Expr &expr, const std::string &name)
+    {
+        auto ident = dynamic_cast<const AST::IdentifierExpr *>(&expr);
+        return ident && ident->name == name;
+    }
+
+    // --- finding loops
+
+    void visit(AST::Stmt &stmt)
+    {
+        if (auto varDecl = dynamic_cast<AST::VarDeclStmt *>(&stmt))
+        {
+            m_scopes.back()[varDecl->name] = varDecl;
+        }
+        else if (auto block = dynamic_cast<AST::BlockStmt *>(&stmt))
+        {
+            m_scopes.emplace_back();
+            for (auto &s : block->statements)
+            {
+                visit(*s);
+            }
+            m_scopes.pop_back();
+        }
+        else if (auto ifStmt = dynamic_cast<AST::IfStmt *>(&stmt))
+        {
+            visitScoped(*ifStmt->thenBranch);
+            if (ifStmt->elseBranch)
+                visitScoped(*ifStmt->elseBranch);
+        }
+        else if (auto whileStmt = dynamic_cast<AST::WhileStmt *>(&stmt))
+        {
+            visitScoped(*whileStmt->body);
+        }
+        else if (auto forIn = dynamic_cast<AST::ForInStmt *>(&stmt))
+        {
+            m_scopes.emplace_back();
+            m_scopes.back()[forIn->name] = nullptr;
+            visitScoped(*forIn->body);
+            m_scopes.pop_back();
+        }
+        else if (auto forStmt = dynamic_cast<AST::ForStmt *>(&stmt))
+        {
+            // a pfor body already runs on every core
+            if (forStmt->pfor)
+                return;
+            m_scopes.emplace_back();
+            if (forStmt->initializer)
+                visit(*forStmt->initializer);
+            if (!tryParallelize(*forStmt))
+                visitScoped(*forStmt->body);
+            m_scopes.pop_back();
+        }
+        else if (auto func = dynamic_cast<AST::FunctionStmt *>(&stmt))
+        {
+            // a generator keeps some locals in its frame, where OpenMP cannot
+            // privatize them
+            if (func->generator)
+                return;
+            m_scopes.emplace_back();
+            for (const auto &param : func->params)
+            {
+                m_scopes.back()[param] = nullptr;
+            }
+            visit(*func->body);
+            m_scopes.pop_back();
+        }
+    }
+
+    void visitScoped(AST::Stmt &stmt)
+    {
+        m_scopes.emplace_back();
+        visit(stmt);
+        m_scopes.pop_back();
+    }
+
+    // i from its initializer while i < bound (or bound > i), i++ or i += 1.
+    bool canonical(const AST::ForStmt &loop, const AST::Expr *&bound) const
+    {
+        auto init = dynamic_cast<const AST::VarDeclStmt *>(loop.initializer.get());
+        auto condition = dynamic_cast<const AST::BinaryExpr *>(loop.condition.get());
+        if (!init || !init->initializer || !counter(init->varType) || !condition || !loop.increment)
+            return false;
+
+        const AST::Expr *tested;
+        if (condition->op == TokenType::LT)
+        {
+            tested = condition->left.get();
+            bound = condition->right.get();
+        }
+        else if (condition->op == TokenType::GT)
+        {
+            tested = condition->right.get();
+            bound = condition->left.get();
+        }
+        else
+        {
+            return false;
+        }
+        if (!isVariable(*tested, init->name) || !counter(bound->type))
+            return false;
+
+        const AST::Expr *stepped = nullptr;
+        if (auto unary = dynamic_cast<const AST::UnaryExpr *>(loop.increment.get()))
+        {
+            if (unary->op == TokenType::PLUS_PLUS)
+                stepped = unary->right.get();
+        }
+        else if (auto binary = dynamic_cast<const AST::BinaryExpr *>(loop.increment.get()))
+        {
+            auto step = dynamic_cast<const AST::LiteralExpr *>(binary->right.get());
+            if (binary->op == TokenType::PLUS_EQ && step && step->type == TokenType::NUMBER && step->value == "1")
+                stepped = binary->left.get();
+        }
+        return stepped && isVariable(*stepped, init->name);
+    }
+
+    // Called with the loop's own scope open and its variable declared.
+    bool tryParallelize(AST::ForStmt &loop)
+    {
+        const AST::Expr *bound;
+        if (!canonical(loop, bound))
+            return false;
+
+        auto &init = static_cast<const AST::VarDeclStmt &>(*loop.initializer);
+        Effects effects;
+        m_effects = &effects;
+        m_induction = resolve(init.name).first;
+        m_inFunction = false;
+        m_loops = 0;
+        m_scopes.emplace_back();
+        m_regionDepth = m_scopes.size() - 1;
+        walkStmt(*loop.body);
+        m_scopes.pop_back();
+        m_effects = nullptr;
+
+        if (!independent(effects) || !invariant(*bound, effects) || !invariant(*init.initializer, effects))
+            return false;
+
+        loop.parallel = true;
+        loop.straightLine = !effects.heavy;
+        for (const auto &[binding, op] : effects.reductions)
+        {
+            loop.reductions.push_back({op, binding->first});
+        }
+        std::sort(loop.reductions.begin(), loop.reductions.end(),
+                  [](const auto &a, const auto &b)
+                  { return a.second < b.second; });
+        return true;
+    }
+
+    // No early exit, I/O or pfor; only pure calls; outer scalars only read
+    // or reduced with one kind of operator; outer arrays written only as
+    // a[i + c] for a single c.
+    bool independent(const Effects &effects) const
+    {
+        if (effects.barrier)
+            return false;
+
+        bool calls = false;
+        for (const AST::FunctionStmt *callee : effects.callees)
+        {
+            auto pure = m_pure.find(callee);
+            if (pure == m_pure.end() || !pure->second)
+                return false;
+            calls = true;
+        }
+
+        // a called function sees top-level variables, never this loop's copies
+        auto global = [calls](Binding binding)
+        { return calls && binding->second && binding->second->global; };
+
+        for (const auto &[binding, op] : effects.reductions)
+        {
+            if (op.empty() || effects.reads.count(binding) || global(binding))
+                return false;
+        }
+        for (const auto &[binding, use] : effects.arrays)
+        {
+            if (use.written && (use.whole || use.irregular || global(binding)))
+                return false;
+        }
+        return true;
+    }
+
+    // Whether `expr` gives the same value on every iteration, without side
+    // effects (OpenMP evaluates the bounds once).
+    bool invariant(const AST::Expr &expr, const Effects &effects) const
+    {
+        if (dynamic_cast<const AST::LiteralExpr *>(&expr))
+            return true;
+        if (auto ident = dynamic_cast<const AST::IdentifierExpr *>(&expr))
+        {
+            Binding binding = resolve(ident->name).first;
+            return binding && binding != m_induction && !effects.reductions.count(binding);
+        }
+        if (auto unary = dynamic_cast<const AST::UnaryExpr *>(&expr))
+        {
+            return unary->op != TokenType::PLUS_PLUS && unary->op != TokenType::MINUS_MINUS &&
+                   invariant(*unary->right, effects);
+        }
+        if (auto binary = dynamic_cast<const AST::BinaryExpr *>(&expr))
+        {
+            return !assignment(binary->op) && binary->op != TokenType::STREAM_OUT &&
+                   invariant(*binary->left, effects) && invariant(*binary->right, effects);
+        }
+        if (auto call = dynamic_cast<const AST::CallExpr *>(&expr))
+        {
+            // the length of an array whose elements the loop may write
+            auto array = call->args.size() == 1 ? dynamic_cast<const AST::IdentifierExpr *>(call->args[0].get()) : nullptr;
+            return call->callee == "size" && !call->target && array && array->type == AST::Type::Arr;
+        }
+        return false;
+    }
+
+    // --- what a body does
+
+    // Every function's purity: no I/O and no writes outside itself, in
+    // itself and in everything it calls.
+    void computePurity()
+    {
+        std::vector<std::pair<const AST::FunctionStmt *, std::vector<const AST::FunctionStmt *>>> calls;
+        for (const auto &stmt : m_statements)
+        {
+            auto func = dynamic_cast<const AST::FunctionStmt *>(stmt.get());
+            if (!func)
+                continue;
+
+            Effects effects;
+            m_effects = &effects;
+            m_induction = nullptr;
+            m_inFunction = true;
+            m_loops = 0;
+            m_scopes.emplace_back();
+            m_regionDepth = m_scopes.size() - 1;
+            for (const auto &param : func->params)
+            {
+                m_scopes.back()[param] = nullptr;
+            }
+            walkStmt(*func->body);
+            m_scopes.pop_back();
+            m_effects = nullptr;
+
+            bool pure = !effects.barrier && effects.reductions.empty() &&
+                        std::none_of(effects.arrays.begin(), effects.arrays.end(),
+                                     [](const auto &array)
+                                     { return array.second.written; });
+            m_pure[func] = pure;
+            calls.push_back({func, std::move(effects.callees)});
+        }
+
+        // calling an impure function is impure, recursively
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (const auto &[func, callees] : calls)
+            {
+                if (!m_pure[func])
+                    continue;
+                for (const AST::FunctionStmt *callee : callees)
+                {
+                    if (!m_pure[callee])
+                    {
+                        m_pure[func] = false;
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    void walkScoped(const AST::Stmt &stmt)
+    {
+        m_scopes.emplace_back();
+        walkStmt(stmt);
+        m_scopes.pop_back();
+    }
+
+    void walkStmt(const AST::Stmt &stmt)
+    {
+        if (auto varDecl = dynamic_cast<const AST::VarDeclStmt *>(&stmt))
+        {
+            if (varDecl->initializer)
+                walkExpr(*varDecl->initializer);
+            m_scopes.back()[varDecl->name] = varDecl;
+        }
+        else if (auto exprStmt = dynamic_cast<const AST::ExprStmt *>(&stmt))
+        {
+            if (!reduction(*exprStmt->expr))
+                walkExpr(*exprStmt->expr);
+        }
+        else if (auto block = dynamic_cast<const AST::BlockStmt *>(&stmt))
+        {
+            m_scopes.emplace_back();
+            for (const auto &s : block->statements)
+            {
+                walkStmt(*s);
+            }
+            m_scopes.pop_back();
+        }
+        else if (auto ifStmt = dynamic_cast<const AST::IfStmt *>(&stmt))
+        {
+            walkExpr(*ifStmt->condition);
+            walkScoped(*ifStmt->thenBranch);
+            if (ifStmt->elseBranch)
+                walkScoped(*ifStmt->elseBranch);
+        }
+        else if (auto whileStmt = dynamic_cast<const AST::WhileStmt *>(&stmt))
+        {
+            m_effects->heavy = true;
+            walkExpr(*whileStmt->condition);
+            m_loops++;
+            walkScoped(*whileStmt->body);
+            m_loops--;
+        }
+        else if (auto forStmt = dynamic_cast<const AST::ForStmt *>(&stmt))
+        {
+            m_effects->heavy = true;
+            if (forStmt->pfor)
+                m_effects->barrier = true;
+            m_scopes.emplace_back();
+            if (forStmt->initializer)
+                walkStmt(*forStmt->initializer);
+            if (forStmt->condition)
+                walkExpr(*forStmt->condition);
+            if (forStmt->increment)
+                walkExpr(*forStmt->increment);
+            m_loops++;
+            walkScoped(*forStmt->body);
+            m_loops--;
+            m_scopes.pop_back();
+        }
+        else if (auto forIn = dynamic_cast<const AST::ForInStmt *>(&stmt))
+        {
+            m_effects->heavy = true;
+            walkExpr(*forIn->iterable);
+            // a gen from outside changes as it is iterated
+            auto gen = dynamic_cast<const AST::IdentifierExpr *>(forIn->iterable.get());
+            if (gen && gen->type == AST::Type::Gen)
+                write(*gen);
+            m_scopes.emplace_back();
+            m_scopes.back()[forIn->name] = nullptr;
+            m_loops++;
+            walkScoped(*forIn->body);
+            m_loops--;
+            m_scopes.pop_back();
+        }
+        else if (auto ret = dynamic_cast<const AST::ReturnStmt *>(&stmt))
+        {
+            if (ret->value)
+                walkExpr(*ret->value);
+            if (!m_inFunction)
+                m_effects->barrier = true;
+        }
+        else if (dynamic_cast<const AST::BreakStmt *>(&stmt))
+        {
+            if (m_loops == 0)
+                m_effects->barrier = true;
+        }
+    }
+
+    static bool assignment(TokenType op)
+    {
+        switch (op)
+        {
+        case TokenType::ASSIGN:
+        case TokenType::PLUS_EQ:
+        case TokenType::MINUS_EQ:
+        case TokenType::ASTER_EQ:
+        case TokenType::FSLASH_EQ:
+        case TokenType::PERCENT_EQ:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    void walkExpr(const AST::Expr &expr)
+    {
+        if (auto ident = dynamic_cast<const AST::IdentifierExpr *>(&expr))
+        {
+            read(*ident);
+        }
+        else if (auto index = dynamic_cast<const AST::IndexExpr *>(&expr))
+        {
+            element(*index, false);
+        }
+        else if (auto unary = dynamic_cast<const AST::UnaryExpr *>(&expr))
+        {
+            if (unary->op == TokenType::PLUS_PLUS || unary->op == TokenType::MINUS_MINUS)
+                write(*unary->right);
+            else
+                walkExpr(*unary->right);
+        }
+        else if (auto binary = dynamic_cast<const AST::BinaryExpr *>(&expr))
+        {
+            if (binary->op == TokenType::STREAM_OUT)
+                m_effects->barrier = true;
+
+            if (assignment(binary->op))
+            {
+                write(*binary->left);
+            }
+            else
+            {
+                walkExpr(*binary->left);
+            }
+            walkExpr(*binary->right);
+        }
+        else if (auto call = dynamic_cast<const AST::CallExpr *>(&expr))
+        {
+            walkCall(*call);
+        }
+    }
+
+    void read(const AST::IdentifierExpr &ident)
+    {
+        auto [binding, inner] = resolve(ident.name);
+        if (!binding || inner || binding == m_induction)
+            return;
+        if (ident.type == AST::Type::Arr)
+            m_effects->arrays[binding].whole = true;
+        else
+            m_effects->reads.insert(binding);
+    }
+
+    // A write that is not a reduction: fine only for the body's own
+    // variables and for array elements.
+    void write(const AST::Expr &target)
+    {
+        if (auto index = dynamic_cast<const AST::IndexExpr *>(&target))
+        {
+            element(*index, true);
+            return;
+        }
+
+        auto &ident = static_cast<const AST::IdentifierExpr &>(target);
+        auto [binding, inner] = resolve(ident.name);
+        if (!inner)
+            m_effects->barrier = true;
+    }
+
+    void element(const AST::IndexExpr &index, bool written)
+    {
+        walkExpr(*index.index);
+        auto array = dynamic_cast<const AST::IdentifierExpr *>(index.array.get());
+        if (!array)
+        {
+            // an element of a temporary, e.g. f()[i]
+            walkExpr(*index.array);
+            return;
+        }
+
+        auto [binding, inner] = resolve(array->name);
+        if (!binding || inner)
+            return;
+
+        ArrayUse &use = m_effects->arrays[binding];
+        use.written = use.written || written;
+        int64_t offset = 0;
+        bool affine = inductionOffset(*index.index, offset);
+        use.element(affine, offset);
+    }
+
+    // index == i + offset for the loop variable i and a constant offset.
+    bool inductionOffset(const AST::Expr &index, int64_t &offset) const
+    {
+        auto isInduction = [this](const AST::Expr &expr)
+        {
+            auto ident = dynamic_cast<const AST::IdentifierExpr *>(&expr);
+            return m_induction && ident && resolve(ident->name).first == m_induction;
+        };
+        auto integer = [](const AST::Expr &expr, int64_t &value)
+        {
+            auto literal = dynamic_cast<const AST::LiteralExpr *>(&expr);
+            if (!literal || literal->type != TokenType::NUMBER || !integral(literal->Expr::type))
+                return false;
+            const std::string &text = literal->value;
+            return std::from_chars(text.data(), text.data() + text.size(), value).ec == std::errc();
+        };
+
+        if (isInduction(index))
+        {
+            offset = 0;
+            return true;
+        }
+
+        auto binary = dynamic_cast<const AST::BinaryExpr *>(&index);
+        if (!binary)
+            return false;
+        if (binary->op == TokenType::PLUS)
+        {
+            return (isInduction(*binary->left) && integer(*binary->right, offset)) ||
+                   (isInduction(*binary->right) && integer(*binary->left, offset));
+        }
+        if (binary->op == TokenType::MINUS && isInduction(*binary->left) && integer(*binary->right, offset))
+        {
+            offset = -offset;
+            return true;
+        }
+        return false;
+    }
+
+    void walkCall(const AST::CallExpr &call)
+    {
+        if (call.callee == "size" && !call.target)
+        {
+            // only the length: no conflict with writes to the elements
+            for (const auto &arg : call.args)
+            {
+                if (arg->type != AST::Type::Arr || !dynamic_cast<const AST::IdentifierExpr *>(arg.get()))
+                    walkExpr(*arg);
+            }
+            return;
+        }
+
+        for (const auto &arg : call.args)
+        {
+            walkExpr(*arg);
+        }
+
+        if (call.target)
+        {
+            m_effects->heavy = true;
+            m_effects->callees.push_back(call.target);
+        }
+        else if (mathFunction(call.callee))
+        {
+            m_effects->heavy = true;
+        }
+        else if (call.callee != "array" && call.callee != "f\"\"")
+        {
+            m_effects->barrier = true;
+        }
+    }
+
+    static bool mathFunction(const std::string &name)
+    {
+        static const std::unordered_set<std::string> functions = {
+            "abs", "fabs", "sqrt", "cbrt", "pow", "exp", "exp2", "log", "log2", "log10",
+            "sin", "cos", "tan", "asin", "acos", "atan", "atan2", "sinh", "cosh", "tanh",
+            "floor", "ceil", "round", "trunc", "fmod", "fmin", "fmax", "hypot"};
+        return functions.count(name) != 0;
+    }
+
+    // `x += e`, `x -= e`, `x *= e`, `x++`, `x--` or `x = x op e` as a
+    // statement, on an integer from outside the body. False if `expr` is
+    // anything else.
+    bool reduction(const AST::Expr &expr)
+    {
+        const AST::Expr *target = nullptr;
+        const AST::Expr *operand = nullptr;
+        std::string op;
+
+        if (auto unary = dynamic_cast<const AST::UnaryExpr *>(&expr))
+        {
+            if (unary->op != TokenType::PLUS_PLUS && unary->op != TokenType::MINUS_MINUS)
+                return false;
+            target = unary->right.get();
+            op = "+";
+        }
+        else if (auto binary = dynamic_cast<const AST::BinaryExpr *>(&expr))
+        {
+            target = binary->left.get();
+            operand = binary->right.get();
+            if (binary->op == TokenType::PLUS_EQ || binary->op == TokenType::MINUS_EQ)
+                op = "+";
+            else if (binary->op == TokenType::ASTER_EQ)
+                op = "*";
+            else if (binary->op != TokenType::ASSIGN || !splitUpdate(*binary, op, operand))
+                return false;
+        }
+        else
+        {
+            return false;
+        }
+
+        auto ident = dynamic_cast<const AST::IdentifierExpr *>(target);
+        if (!ident || !counter(ident->type) || (operand && !integral(operand->type)))
+            return false;
+        auto [binding, inner] = resolve(ident->name);
+        if (!binding || inner || binding == m_induction)
+            return false;
+
+        if (operand)
+            walkExpr(*operand);
+        auto [found, added] = m_effects->reductions.emplace(binding, op);
+        if (!added && found->second != op)
+            found->second.clear();
+        return true;
+    }
+
+    // x = x op e, or x = e op x for a commutative op.
+    static bool splitUpdate(const AST::BinaryExpr &assignment, std::string &op, const AST::Expr *&operand)
+    {
+        auto target = dynamic_cast<const AST::IdentifierExpr *>(assignment.left.get());
+        auto value = dynamic_cast<const AST::BinaryExpr *>(assignment.right.get());
+        if (!target || !value)
+            return false;
+
+        switch (value->op)
+        {
+        case TokenType::PLUS:
+        case TokenType::MINUS:
+            op = "+";
+            break;
+        case TokenType::ASTER:
+            op = "*";
+            break;
+        case TokenType::AND:
+            op = "&";
+            break;
+        case TokenType::OR:
+            op = "|";
+            break;
+        case TokenType::XOR:
+            op = "^";
+            break;
+        default:
+            return false;
+        }
+
+        if (isVariable(*value->left, target->name))
+        {
+            operand = value->right.get();
+            return true;
+        }
+        if (value->op != TokenType::MINUS && isVariable(*value->right, target->name))
+        {
+            operand = value->left.get();
+            return true;
+        }
+        return false;
+    }
+};
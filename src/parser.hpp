@@ -25,6 +25,7 @@ public:
 private:
     std::vector<Token> m_tokens;
     size_t m_current;
+    bool m_yields = false; // the function being parsed has a yield
 
     bool isAtEnd() const
     {
@@ -48,6 +49,26 @@ private:
         return peek().type == type;
     }
 
+    // `in` is only a keyword in for (x in ...); elsewhere it is a name
+    bool checkForIn() const
+    {
+        return check(TokenType::IDENTIFIER) && m_current + 1 < m_tokens.size() &&
+               m_tokens[m_current + 1].type == TokenType::IDENTIFIER && m_tokens[m_current + 1].value == "in";
+    }
+
+    // `task` and `gen` only name a type when a variable name follows, and
+    // `reduce` is only a keyword after a pfor header; elsewhere they are names
+    bool checkWord(const std::string &word) const
+    {
+        return check(TokenType::IDENTIFIER) && peek().value == word;
+    }
+
+    bool checkHandleWord() const
+    {
+        return (checkWord("task") || checkWord("gen")) && m_current + 1 < m_tokens.size() &&
+               m_tokens[m_current + 1].type == TokenType::IDENTIFIER;
+    }
+
     Token advance()
     {
         if (!isAtEnd())
@@ -78,6 +99,34 @@ private:
         return false;
     }
 
+    // Explicitly typed declarations: i32, i64, f32, f64, bool.
+    bool matchScalarType()
+    {
+        return match({TokenType::KEYWORD_VAR_I32, TokenType::KEYWORD_VAR_I64, TokenType::KEYWORD_VAR_F32,
+                      TokenType::KEYWORD_VAR_F64, TokenType::KEYWORD_VAR_BOOL});
+    }
+
+    // task, gen, or chan<T> for any type T but arr; returns the type's name.
+    bool matchHandleType(std::string &typeName)
+    {
+        if (checkHandleWord())
+        {
+            typeName = advance().value.value();
+            return true;
+        }
+        if (!match(TokenType::KEYWORD_VAR_CHAN))
+            return false;
+
+        consume(TokenType::LT, "Expect '<' after 'chan'");
+        if (!matchScalarType() && !match({TokenType::KEYWORD_VAR_NUM, TokenType::KEYWORD_VAR_STR}))
+        {
+            throw parseError(peek(), "Expect the type of a chan's values");
+        }
+        typeName = "chan<" + to_string(previous().type) + ">";
+        consume(TokenType::GT, "Expect '>' after chan value type");
+        return true;
+    }
+
     Token consume(TokenType type, const std::string &message)
     {
         if (check(type))
@@ -104,11 +153,20 @@ private:
             case TokenType::KEYWORD_VAR_NUM:
             case TokenType::KEYWORD_VAR_STR:
             case TokenType::KEYWORD_VAR_ARR:
+            case TokenType::KEYWORD_VAR_I32:
+            case TokenType::KEYWORD_VAR_I64:
+            case TokenType::KEYWORD_VAR_F32:
+            case TokenType::KEYWORD_VAR_F64:
+            case TokenType::KEYWORD_VAR_BOOL:
+            case TokenType::KEYWORD_VAR_CHAN:
+            case TokenType::KEYWORD_VAR_VIEW:
             case TokenType::IMPORT:
             case TokenType::IF:
             case TokenType::WHILE:
             case TokenType::FOR:
+            case TokenType::PFOR:
             case TokenType::RETURN:
+            case TokenType::YIELD:
                 return;
             default:
                 advance();
@@ -126,8 +184,15 @@ private:
                 return numVarDeclaration();
             if (match(TokenType::KEYWORD_VAR_STR))
                 return strVarDeclaration();
+            if (match(TokenType::KEYWORD_VAR_VIEW))
+                return typedVarDeclaration(TokenType::KEYWORD_VAR_VIEW);
             if (match(TokenType::KEYWORD_VAR_ARR))
                 return arrVarDeclaration();
+            if (matchScalarType())
+                return typedVarDeclaration(previous().type);
+            std::string handleType;
+            if (matchHandleType(handleType))
+                return varDeclaration(handleType);
             if (match(TokenType::IMPORT))
                 return importStatement();
             return statement();
@@ -146,13 +211,23 @@ private:
         if (match(TokenType::WHILE))
             return whileStatement();
         if (match(TokenType::FOR))
-            return forStatement();
+            return forStatement(false);
+        if (match(TokenType::PFOR))
+            return forStatement(true);
         if (match(TokenType::LBRACE))
             return block();
         if (match(TokenType::RETURN))
             return returnStatement();
+        if (match(TokenType::YIELD))
+            return yieldStatement();
+        if (match(TokenType::BREAK))
+            return breakStatement();
+        if (match(TokenType::CONTINUE))
+            return continueStatement();
         if (match(TokenType::PRINT))
             return printStatement();
+        if (match(TokenType::STREAM_IN))
+            return readStatement();
         return expressionStatement();
     }
 
@@ -162,10 +237,25 @@ private:
         consume(TokenType::LPAREN, "Expect '(' after function name");
 
         std::vector<std::string> parameters;
+        std::vector<std::string> parameterTypes;
         if (!check(TokenType::RPAREN))
         {
             do
             {
+                std::string handleType;
+                if (matchHandleType(handleType))
+                {
+                    parameterTypes.push_back(handleType);
+                }
+                else if (matchScalarType() || match({TokenType::KEYWORD_VAR_NUM, TokenType::KEYWORD_VAR_STR,
+                                                TokenType::KEYWORD_VAR_VIEW, TokenType::KEYWORD_VAR_ARR}))
+                {
+                    parameterTypes.push_back(to_string(previous().type));
+                }
+                else
+                {
+                    parameterTypes.push_back("num");
+                }
                 parameters.push_back(consume(TokenType::IDENTIFIER, "Expect parameter name").value.value());
             } while (match(TokenType::COMMA));
         }
@@ -173,12 +263,17 @@ private:
         consume(TokenType::RPAREN, "Expect ')' after parameters");
         consume(TokenType::LBRACE, "Expect '{' before function body");
 
+        m_yields = false;
         auto body = block();
-        return std::make_unique<AST::FunctionStmt>(
+        auto func = std::make_unique<AST::FunctionStmt>(
             std::move(name),
             std::move(parameters),
+            std::move(parameterTypes),
             std::move(body),
             previous().line);
+        func->generator = m_yields;
+        m_yields = false;
+        return func;
     }
 
     AST::StmtPtr importStatement()
@@ -220,7 +315,6 @@ private:
 
     AST::StmtPtr typedVarDeclaration(TokenType type)
     {
-        int line = previous().line;
         std::string typeName;
 
         switch (type)
@@ -231,13 +325,29 @@ private:
         case TokenType::KEYWORD_VAR_STR:
             typeName = "str";
             break;
+        case TokenType::KEYWORD_VAR_VIEW:
+            typeName = "str_view";
+            break;
         case TokenType::KEYWORD_VAR_ARR:
             typeName = "arr";
             break;
+        case TokenType::KEYWORD_VAR_I32:
+        case TokenType::KEYWORD_VAR_I64:
+        case TokenType::KEYWORD_VAR_F32:
+        case TokenType::KEYWORD_VAR_F64:
+        case TokenType::KEYWORD_VAR_BOOL:
+            typeName = to_string(type);
+            break;
         default:
             throw parseError(previous(), "Invalid variable type");
         }
 
+        return varDeclaration(typeName);
+    }
+
+    AST::StmtPtr varDeclaration(const std::string &typeName)
+    {
+        int line = previous().line;
         std::string name = consume(TokenType::IDENTIFIER, "Expect variable name").value.value();
 
         AST::ExprPtr initializer = nullptr;
@@ -279,10 +389,18 @@ private:
         return std::make_unique<AST::WhileStmt>(std::move(condition), std::move(body), line);
     }
 
-    AST::StmtPtr forStatement()
+    // for, or pfor with optional `reduce(op: a, b)` clauses after the header
+    AST::StmtPtr forStatement(bool parallel)
     {
         int line = previous().line;
-        consume(TokenType::LPAREN, "Expect '(' after 'for'");
+        consume(TokenType::LPAREN, "Expect '(' after '" + to_string(previous().type) + "'");
+
+        if (checkForIn())
+        {
+            if (parallel)
+                throw parseError(peek(), "pfor only takes counted loops, not 'in'");
+            return forInStatement(line);
+        }
 
         AST::StmtPtr initializer;
         if (match(TokenType::SEMICOLON))
@@ -293,6 +411,10 @@ private:
         {
             initializer = numVarDeclaration();
         }
+        else if (matchScalarType())
+        {
+            initializer = typedVarDeclaration(previous().type);
+        }
         else
         {
             initializer = expressionStatement();
@@ -326,36 +448,46 @@ private:
         }
         consume(TokenType::RPAREN, "Expect ')' after for clauses");
 
-        auto body = statement();
-
-        AST::StmtPtr whileBody;
-        if (increment)
+        std::vector<std::pair<std::string, std::string>> reductions;
+        while (parallel && checkWord("reduce"))
         {
-            std::vector<AST::StmtPtr> bodyStmts;
-            bodyStmts.push_back(std::move(body));
-            bodyStmts.push_back(std::make_unique<AST::ExprStmt>(std::move(increment), line));
-            whileBody = std::make_unique<AST::BlockStmt>(std::move(bodyStmts), line);
-        }
-        else
-        {
-            whileBody = std::move(body);
+            advance();
+            reduceClause(reductions);
         }
 
-        auto whileLoop = std::make_unique<AST::WhileStmt>(
-            condition ? std::move(condition)
-                      : std::make_unique<AST::LiteralExpr>("1", TokenType::NUMBER, line),
-            std::move(whileBody),
-            line);
+        auto body = statement();
+        auto loop = std::make_unique<AST::ForStmt>(std::move(initializer), std::move(condition),
+                                                   std::move(increment), std::move(body), line);
+        loop->pfor = parallel;
+        loop->reductions = std::move(reductions);
+        return loop;
+    }
+
+    // for (x in iterable), after the '('
+    AST::StmtPtr forInStatement(int line)
+    {
+        std::string name = advance().value.value();
+        advance(); // in
+        auto iterable = expression();
+        consume(TokenType::RPAREN, "Expect ')' after for-in iterable");
+        auto body = statement();
+        return std::make_unique<AST::ForInStmt>(std::move(name), std::move(iterable), std::move(body), line);
+    }
 
-        if (initializer)
+    void reduceClause(std::vector<std::pair<std::string, std::string>> &reductions)
+    {
+        consume(TokenType::LPAREN, "Expect '(' after 'reduce'");
+        if (!match({TokenType::PLUS, TokenType::ASTER, TokenType::AND, TokenType::OR, TokenType::XOR}))
         {
-            std::vector<AST::StmtPtr> stmts;
-            stmts.push_back(std::move(initializer));
-            stmts.push_back(std::move(whileLoop));
-            return std::make_unique<AST::BlockStmt>(std::move(stmts), line);
+            throw parseError(peek(), "Expect one of + * & | ^ in 'reduce'");
         }
-
-        return whileLoop;
+        std::string op = to_string(previous().type);
+        consume(TokenType::COLON, "Expect ':' after reduction operator");
+        do
+        {
+            reductions.push_back({op, consume(TokenType::IDENTIFIER, "Expect variable name in 'reduce'").value.value()});
+        } while (match(TokenType::COMMA));
+        consume(TokenType::RPAREN, "Expect ')' after reduction variables");
     }
 
     AST::StmtPtr block()
@@ -385,6 +517,33 @@ private:
         return std::make_unique<AST::ReturnStmt>(std::move(value), line);
     }
 
+    // yield v; is a call to the builtin of that name
+    AST::StmtPtr yieldStatement()
+    {
+        int line = previous().line;
+        std::vector<AST::ExprPtr> args;
+        args.push_back(expression());
+        consume(TokenType::SEMICOLON, "Expect ';' after yield value");
+        m_yields = true;
+
+        auto call = std::make_unique<AST::CallExpr>("yield", std::move(args), line);
+        return std::make_unique<AST::ExprStmt>(std::move(call), line);
+    }
+
+    AST::StmtPtr breakStatement()
+    {
+        int line = previous().line;
+        consume(TokenType::SEMICOLON, "Expect ';' after 'break'");
+        return std::make_unique<AST::BreakStmt>(line);
+    }
+
+    AST::StmtPtr continueStatement()
+    {
+        int line = previous().line;
+        consume(TokenType::SEMICOLON, "Expect ';' after 'continue'");
+        return std::make_unique<AST::ContinueStmt>(line);
+    }
+
     AST::StmtPtr printStatement()
     {
         int line = previous().line;
@@ -400,6 +559,34 @@ private:
         return std::make_unique<AST::ExprStmt>(std::move(call), line);
     }
 
+    // >> a >> b[i]; assigns each target a call to the builtin ">>", which
+    // sema types after its target
+    AST::StmtPtr readStatement()
+    {
+        int line = previous().line;
+        AST::StmtList reads;
+        do
+        {
+            auto target = call();
+            if (!dynamic_cast<AST::IdentifierExpr *>(target.get()) && !dynamic_cast<AST::IndexExpr *>(target.get()))
+            {
+                throw parseError(previous(), "Expect a variable or element after '>>'");
+            }
+
+            auto read = std::make_unique<AST::CallExpr>(">>", std::vector<AST::ExprPtr>{}, line);
+            auto assignment = std::make_unique<AST::BinaryExpr>(std::move(target), TokenType::ASSIGN,
+                                                                std::move(read), line);
+            reads.push_back(std::make_unique<AST::ExprStmt>(std::move(assignment), line));
+        } while (match(TokenType::STREAM_IN));
+        consume(TokenType::SEMICOLON, "Expect ';' after '>>' targets");
+
+        if (reads.size() == 1)
+        {
+            return std::move(reads.front());
+        }
+        return std::make_unique<AST::BlockStmt>(std::move(reads), line);
+    }
+
     AST::StmtPtr expressionStatement()
     {
         auto expr = expression();
@@ -421,7 +608,7 @@ private:
         {
             TokenType op = previous().type;
             auto value = assignment();
-            if (dynamic_cast<AST::IdentifierExpr *>(expr.get()))
+            if (dynamic_cast<AST::IdentifierExpr *>(expr.get()) || dynamic_cast<AST::IndexExpr *>(expr.get()))
             {
                 return std::make_unique<AST::BinaryExpr>(std::move(expr), op, std::move(value), previous().line);
             }
@@ -560,6 +747,27 @@ private:
 
     AST::ExprPtr unary()
     {
+        // spawn f(x) and await h are calls to the builtins of the same names
+        if (match(TokenType::SPAWN))
+        {
+            int line = previous().line;
+            auto target = call();
+            if (!dynamic_cast<AST::CallExpr *>(target.get()))
+            {
+                throw parseError(previous(), "Expect a function call after 'spawn'");
+            }
+            std::vector<AST::ExprPtr> args;
+            args.push_back(std::move(target));
+            return std::make_unique<AST::CallExpr>("spawn", std::move(args), line);
+        }
+        if (match(TokenType::AWAIT))
+        {
+            int line = previous().line;
+            std::vector<AST::ExprPtr> args;
+            args.push_back(unary());
+            return std::make_unique<AST::CallExpr>("await", std::move(args), line);
+        }
+
         if (match({TokenType::NOT, TokenType::MINUS, TokenType::PLUS_PLUS, TokenType::MINUS_MINUS}))
         {
             TokenType op = previous().type;
@@ -580,6 +788,13 @@ private:
             {
                 expr = finishCall(std::move(expr));
             }
+            else if (match(TokenType::LBRACKET))
+            {
+                int line = previous().line;
+                auto index = expression();
+                consume(TokenType::RBRACKET, "Expect ']' after index");
+                expr = std::make_unique<AST::IndexExpr>(std::move(expr), std::move(index), line);
+            }
             else
             {
                 break;
@@ -622,6 +837,16 @@ private:
             return std::make_unique<AST::LiteralExpr>(previous().value.value(), previous().type, previous().line);
         }
 
+        if (match(TokenType::FSTRING_LIT))
+        {
+            return interpolation(previous());
+        }
+
+        if (match({TokenType::TRUE, TokenType::FALSE}))
+        {
+            return std::make_unique<AST::LiteralExpr>(to_string(previous().type), previous().type, previous().line);
+        }
+
         if (match(TokenType::IDENTIFIER))
         {
             return std::make_unique<AST::IdentifierExpr>(previous().value.value(), previous().line);
@@ -636,4 +861,71 @@ private:
 
         throw parseError(peek(), "Error expected expression");
     }
+
+    /*
+    f"took {ms} ms" is the builtin call f""("took ", ms, " ms"): its text and
+    the expressions in its braces, in order, each parsed from its own
+    tokens. {{ and }} stand for the braces themselves.
+    */
+    AST::ExprPtr interpolation(const Token &token)
+    {
+        const std::string &text = token.value.value();
+        std::vector<AST::ExprPtr> parts;
+        std::string literal;
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            char c = text[i];
+            if ((c == '{' || c == '}') && i + 1 < text.size() && text[i + 1] == c)
+            {
+                literal += c;
+                ++i;
+                continue;
+            }
+            if (c == '}')
+                throw parseError(token, "Single '}' in f-string; write '}}' for a brace");
+            if (c != '{')
+            {
+                literal += c;
+                continue;
+            }
+
+            size_t close = closingBrace(text, i);
+            if (close == text.size())
+                throw parseError(token, "Expect '}' after f-string expression");
+            if (!literal.empty())
+                parts.push_back(std::make_unique<AST::LiteralExpr>(literal, TokenType::STRING_LIT, token.line));
+            literal.clear();
+
+            Parser hole(Lexer(text.substr(i + 1, close - i - 1), token.line).tokenize());
+            if (hole.isAtEnd())
+                throw parseError(token, "Expect an expression between '{' and '}' in f-string");
+            parts.push_back(hole.expression());
+            if (!hole.isAtEnd())
+                throw parseError(hole.peek(), "Expect '}' after f-string expression");
+            i = close;
+        }
+        if (!literal.empty() || parts.empty())
+            parts.push_back(std::make_unique<AST::LiteralExpr>(literal, TokenType::STRING_LIT, token.line));
+        return std::make_unique<AST::CallExpr>("f\"\"", std::move(parts), token.line);
+    }
+
+    // The '}' that closes the '{' at `open`, skipping strings in between.
+    static size_t closingBrace(const std::string &text, size_t open)
+    {
+        int depth = 0;
+        bool nested = false;
+        for (size_t i = open; i < text.size(); ++i)
+        {
+            char c = text[i];
+            if (nested)
+                nested = c != '"';
+            else if (c == '"')
+                nested = true;
+            else if (c == '{')
+                depth++;
+            else if (c == '}' && --depth == 0)
+                return i;
+        }
+        return text.size();
+    }
 };
\ No newline at end of file
@@ -0,0 +1,427 @@
+#pragma once
+
+#include "ir.hpp"
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/*
+Optimization passes over the IR. Each pass rewrites a function in place
+and reports whether it changed anything; a PassManager runs a list of them
+in order. The standard pipeline removes copies, merges repeated
+computations and hoists loop-invariant code out of loops, leaving the
+rest (register allocation, scheduling) to the C++ compiler.
+*/
+namespace IR
+{
+    struct Pass
+    {
+        virtual ~Pass() = default;
+        virtual const char *name() const = 0;
+        virtual bool run(Function &func) = 0;
+    };
+
+    class PassManager
+    {
+    public:
+        PassManager &add(std::unique_ptr<Pass> pass)
+        {
+            m_passes.push_back(std::move(pass));
+            return *this;
+        }
+
+        bool run(Function &func)
+        {
+            bool changed = false;
+            for (auto &pass : m_passes)
+            {
+                changed |= pass->run(func);
+            }
+            return changed;
+        }
+
+        static PassManager standard();
+
+    private:
+        std::vector<std::unique_ptr<Pass>> m_passes;
+    };
+
+    // Forwards copies and removes phis that merge a single value.
+    struct CopyPropagation : Pass
+    {
+        const char *name() const override { return "copy-propagation"; }
+
+        bool run(Function &func) override
+        {
+            bool changed = false;
+            bool again = true;
+            while (again)
+            {
+                again = false;
+                for (auto &block : func.blocks)
+                {
+                    for (Instr *instr : block->instrs)
+                    {
+                        if (instr->op == Op::Copy && !instr->replacement)
+                        {
+                            instr->replacement = Function::resolve(instr->operands[0]);
+                            again = true;
+                        }
+                    }
+
+                    for (Instr *phi : block->phis)
+                    {
+                        if (phi->replacement)
+                            continue;
+
+                        Instr *same = trivialValue(*phi);
+                        if (same)
+                        {
+                            phi->replacement = same;
+                            again = true;
+                        }
+                    }
+                }
+                func.applyReplacements();
+                changed |= again;
+            }
+            return changed;
+        }
+
+    private:
+        // The one value a phi merges besides itself, or null.
+        static Instr *trivialValue(Instr &phi)
+        {
+            Instr *same = nullptr;
+            for (Instr *operand : phi.operands)
+            {
+                operand = Function::resolve(operand);
+                if (operand == &phi || operand == same)
+                    continue;
+                if (same)
+                    return nullptr;
+                same = operand;
+            }
+            return same;
+        }
+    };
+
+    // Common subexpression elimination: a computation dominated by an
+    // identical one reuses its value. Phis are left alone: their operands
+    // may still be rewritten by the time the walk comes back to them.
+    struct CommonSubexpressions : Pass
+    {
+        const char *name() const override { return "cse"; }
+
+        bool run(Function &func) override
+        {
+            func.computeDominators();
+            m_children.assign(func.blockCount, {});
+            for (auto &block : func.blocks)
+            {
+                if (block.get() != func.entry && block->idom)
+                    m_children[block->idom->id].push_back(block.get());
+            }
+
+            m_changed = false;
+            m_available.clear();
+            visit(func.entry);
+            func.applyReplacements();
+            return m_changed;
+        }
+
+    private:
+        static bool same(Instr *a, Instr *b)
+        {
+            a = Function::resolve(a);
+            b = Function::resolve(b);
+            if (a == b)
+                return true;
+            if (a->op != b->op || !a->floating())
+                return false;
+            return a->text == b->text && a->type == b->type;
+        }
+
+        struct Hash
+        {
+            size_t operator()(const Instr *instr) const
+            {
+                size_t h = static_cast<size_t>(instr->op) * 31 + static_cast<size_t>(instr->token);
+                h = h * 31 + static_cast<size_t>(instr->type);
+                for (Instr *operand : instr->operands)
+                {
+                    operand = Function::resolve(operand);
+                    h = h * 31 + (operand->floating() ? std::hash<std::string>()(operand->text)
+                                                      : static_cast<size_t>(operand->id));
+                }
+                return h;
+            }
+        };
+
+        struct Equal
+        {
+            bool operator()(const Instr *a, const Instr *b) const
+            {
+                if (a->op != b->op || a->token != b->token || a->type != b->type ||
+                    a->operands.size() != b->operands.size())
+                    return false;
+                for (size_t i = 0; i < a->operands.size(); ++i)
+                {
+                    if (!same(a->operands[i], b->operands[i]))
+                        return false;
+                }
+                return true;
+            }
+        };
+
+        std::vector<std::vector<Block *>> m_children; // dominator tree, by block id
+        std::unordered_set<Instr *, Hash, Equal> m_available;
+        bool m_changed = false;
+
+        void visit(Block *block)
+        {
+            std::vector<Instr *> added;
+            for (Instr *instr : block->instrs)
+            {
+                if (instr->op != Op::Cast && instr->op != Op::Unary && instr->op != Op::Binary)
+                    continue;
+
+                auto [found, inserted] = m_available.insert(instr);
+                if (inserted)
+                {
+                    added.push_back(instr);
+                }
+                else
+                {
+                    instr->replacement = *found;
+                    m_changed = true;
+                }
+            }
+
+            for (Block *child : m_children[block->id])
+            {
+                visit(child);
+            }
+            for (Instr *instr : added)
+            {
+                m_available.erase(instr);
+            }
+        }
+    };
+
+    // Loop-invariant code motion: computations whose operands are all
+    // defined outside a loop move to the block that enters it.
+    struct LoopInvariantMotion : Pass
+    {
+        const char *name() const override { return "licm"; }
+
+        bool run(Function &func) override
+        {
+            std::vector<Block *> order = func.computeDominators();
+
+            // a back edge jumps to a block that dominates its source
+            std::vector<Loop> loops;
+            for (Block *block : order)
+            {
+                for (Block *successor : block->successors())
+                {
+                    if (!Function::dominates(successor, block))
+                        continue;
+
+                    auto loop = std::find_if(loops.begin(), loops.end(), [successor](const Loop &l)
+                                             { return l.header == successor; });
+                    if (loop == loops.end())
+                        loop = loops.insert(loops.end(), Loop{successor, std::vector<char>(func.blockCount), 0});
+                    addLoopBody(*loop, block);
+                }
+            }
+
+            // inner loops first, so that what they hoist can move further out
+            std::stable_sort(loops.begin(), loops.end(), [](const Loop &a, const Loop &b)
+                             { return a.size < b.size; });
+
+            bool changed = false;
+            for (const Loop &loop : loops)
+            {
+                changed |= hoist(loop, order);
+            }
+            return changed;
+        }
+
+    private:
+        struct Loop
+        {
+            Block *header;
+            std::vector<char> body; // by block id
+            size_t size;
+
+            bool contains(const Block *block) const
+            {
+                return body[block->id];
+            }
+        };
+
+        static void addLoopBody(Loop &loop, Block *latch)
+        {
+            if (!loop.body[loop.header->id])
+            {
+                loop.body[loop.header->id] = true;
+                loop.size++;
+            }
+
+            std::vector<Block *> work = {latch};
+            while (!work.empty())
+            {
+                Block *block = work.back();
+                work.pop_back();
+                if (loop.body[block->id])
+                    continue;
+                loop.body[block->id] = true;
+                loop.size++;
+                for (Block *pred : block->preds)
+                {
+                    work.push_back(pred);
+                }
+            }
+        }
+
+        static bool integral(AST::Type type)
+        {
+            return type == AST::Type::Bool || type == AST::Type::I32 || type == AST::Type::Int;
+        }
+
+        // Safe to run even on iterations where the loop would have skipped
+        // it: no traps, and no double-to-integer conversion that could be
+        // out of range.
+        static bool speculatable(const Instr &instr)
+        {
+            switch (instr.op)
+            {
+            case Op::Cast:
+                return integral(instr.type) == integral(instr.operands[0]->type);
+            case Op::Unary:
+                return instr.token != TokenType::BITWISE_NOT || integral(instr.operands[0]->type);
+            case Op::Binary:
+                if (instr.token == TokenType::PERCENT)
+                    return !integral(instr.type);
+                if (instr.token == TokenType::AND || instr.token == TokenType::OR || instr.token == TokenType::XOR)
+                    return integral(instr.operands[0]->type) && integral(instr.operands[1]->type);
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        static bool hoist(const Loop &loop, const std::vector<Block *> &order)
+        {
+            Block *preheader = nullptr;
+            for (Block *pred : loop.header->preds)
+            {
+                if (loop.contains(pred))
+                    continue;
+                if (preheader)
+                    return false;
+                preheader = pred;
+            }
+            if (!preheader || preheader->exit != Block::Exit::Jump)
+                return false;
+
+            auto invariant = [&loop](const Instr *operand)
+            { return operand->floating() || !loop.contains(operand->block); };
+
+            bool changed = false;
+            for (Block *block : order)
+            {
+                if (!loop.contains(block))
+                    continue;
+
+                auto &instrs = block->instrs;
+                for (auto it = instrs.begin(); it != instrs.end();)
+                {
+                    Instr *instr = *it;
+                    if (speculatable(*instr) &&
+                        std::all_of(instr->operands.begin(), instr->operands.end(), invariant))
+                    {
+                        instr->block = preheader;
+                        preheader->instrs.push_back(instr);
+                        it = instrs.erase(it);
+                        changed = true;
+                    }
+                    else
+                    {
+                        ++it;
+                    }
+                }
+            }
+            return changed;
+        }
+    };
+
+    // Removes pure instructions whose value is never used.
+    struct DeadCodeElimination : Pass
+    {
+        const char *name() const override { return "dce"; }
+
+        bool run(Function &func) override
+        {
+            std::vector<char> live(func.values.size());
+            std::vector<const Instr *> work;
+            auto use = [&](const Instr *value)
+            {
+                if (value && !live[value->id])
+                {
+                    live[value->id] = true;
+                    work.push_back(value);
+                }
+            };
+
+            for (auto &block : func.blocks)
+            {
+                for (Instr *instr : block->instrs)
+                {
+                    if (!instr->pure())
+                        use(instr);
+                }
+                use(block->value);
+            }
+            while (!work.empty())
+            {
+                const Instr *instr = work.back();
+                work.pop_back();
+                for (const Instr *operand : instr->operands)
+                {
+                    use(operand);
+                }
+            }
+
+            bool changed = false;
+            auto dead = [&](const Instr *instr)
+            {
+                bool unused = !live[instr->id];
+                changed |= unused;
+                return unused;
+            };
+            for (auto &block : func.blocks)
+            {
+                for (auto *list : {&block->phis, &block->instrs})
+                {
+                    list->erase(std::remove_if(list->begin(), list->end(), dead), list->end());
+                }
+            }
+            return changed;
+        }
+    };
+
+    inline PassManager PassManager::standard()
+    {
+        PassManager passes;
+        passes.add(std::make_unique<CopyPropagation>())
+            .add(std::make_unique<CommonSubexpressions>())
+            .add(std::make_unique<LoopInvariantMotion>())
+            .add(std::make_unique<CopyPropagation>())
+            .add(std::make_unique<DeadCodeElimination>());
+        return passes;
+    }
+}
@@ -0,0 +1,1519 @@
+#pragma once
+
+/*
+C++ that the generator copies into the programs that need it. It is
+compiled as part of each program, and the split and incremental builds
+include it from several translation units, so everything in it is inline.
+*/
+namespace Runtime
+{
+    // Shared by the pieces below. GVOID_THREADS sets the number of threads;
+    // the default is one per core.
+    inline constexpr const char *THREADS = R"RUNTIME(
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+
+namespace gvoid
+{
+inline size_t threadCount()
+{
+    if (const char *env = std::getenv("GVOID_THREADS"))
+    {
+        long threads = std::atol(env);
+        if (threads > 0)
+            return static_cast<size_t>(threads);
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+}
+)RUNTIME";
+
+    /*
+    The pool behind `pfor`. A loop's range is cut into a few chunks per
+    thread, dealt out in contiguous runs to one deque per thread. Each thread
+    works through its own deque from the front and, once that is empty,
+    steals from the back of the others'; the thread that started the loop
+    takes part. A pfor reached while the pool is busy (nested in another, or
+    from a second thread) runs its chunks on the spot.
+    */
+    inline constexpr const char *WORK_STEALING = R"RUNTIME(
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace gvoid
+{
+class WorkPool
+{
+public:
+    static WorkPool &instance()
+    {
+        static WorkPool pool;
+        return pool;
+    }
+
+    ~WorkPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        for (auto &worker : m_workers)
+            worker.join();
+    }
+
+    size_t size() const { return m_queues.size(); }
+
+    // Calls task(chunk) for every chunk in [0, chunks).
+    void run(size_t chunks, const std::function<void(size_t)> &task)
+    {
+        std::unique_lock<std::mutex> busy(m_busy, std::defer_lock);
+        if (s_inside || chunks < 2 || m_queues.size() < 2 || !busy.try_lock())
+        {
+            for (size_t chunk = 0; chunk < chunks; ++chunk)
+                task(chunk);
+            return;
+        }
+
+        struct Inside
+        {
+            Inside() { s_inside = true; }
+            ~Inside() { s_inside = false; }
+        } inside;
+
+        // the task is in place before any chunk can be taken
+        m_task.store(&task, std::memory_order_release);
+        m_pending.store(chunks, std::memory_order_relaxed);
+        size_t threads = m_queues.size();
+        for (size_t q = 0; q < threads; ++q)
+        {
+            std::lock_guard<std::mutex> lock(m_queues[q].mutex);
+            for (size_t chunk = q * chunks / threads; chunk < (q + 1) * chunks / threads; ++chunk)
+                m_queues[q].chunks.push_back(chunk);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_generation++;
+        }
+        m_wake.notify_all();
+
+        work(0);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_pending.load(std::memory_order_acquire) == 0; });
+        m_task.store(nullptr, std::memory_order_relaxed);
+        if (m_error)
+        {
+            std::exception_ptr error = m_error;
+            m_error = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    struct alignas(64) Queue
+    {
+        std::mutex mutex;
+        std::deque<size_t> chunks;
+    };
+
+    static inline thread_local bool s_inside = false; // a pool thread, or the one running a loop
+
+    std::vector<Queue> m_queues; // by thread; 0 is the caller's
+    std::vector<std::thread> m_workers;
+    std::atomic<const std::function<void(size_t)> *> m_task{nullptr};
+    std::atomic<size_t> m_pending{0}; // chunks not yet finished
+    std::mutex m_busy;                // held for the whole of a parallel loop
+    std::mutex m_mutex;
+    std::condition_variable m_wake, m_done;
+    size_t m_generation = 0; // loops started
+    std::exception_ptr m_error;
+    bool m_stopping = false;
+
+    WorkPool() : m_queues(threadCount())
+    {
+        for (size_t i = 1; i < m_queues.size(); ++i)
+            m_workers.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    void workerLoop(size_t self)
+    {
+        s_inside = true;
+        size_t seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [&] { return m_stopping || m_generation != seen; });
+                if (m_stopping)
+                    return;
+                seen = m_generation;
+            }
+            work(self);
+        }
+    }
+
+    void work(size_t self)
+    {
+        size_t chunk;
+        while (take(self, chunk))
+        {
+            try
+            {
+                (*m_task.load(std::memory_order_acquire))(chunk);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_error)
+                    m_error = std::current_exception();
+            }
+            if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_done.notify_all();
+            }
+        }
+    }
+
+    // the front of its own deque walks forward through the range; thieves
+    // take from the far end
+    bool take(size_t self, size_t &chunk)
+    {
+        size_t threads = m_queues.size();
+        for (size_t i = 0; i < threads; ++i)
+        {
+            Queue &queue = m_queues[(self + i) % threads];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.chunks.empty())
+                continue;
+            if (i == 0)
+            {
+                chunk = queue.chunks.front();
+                queue.chunks.pop_front();
+            }
+            else
+            {
+                chunk = queue.chunks.back();
+                queue.chunks.pop_back();
+            }
+            return true;
+        }
+        return false;
+    }
+};
+
+// [begin, end) in `chunks` pieces of nearly equal length.
+struct Range
+{
+    static constexpr size_t CHUNKS_PER_THREAD = 8;
+
+    int64_t begin, end;
+    size_t chunks = 0;
+
+    Range(int64_t begin, int64_t end) : begin(begin), end(end)
+    {
+        if (end > begin)
+            chunks = static_cast<size_t>(std::min<uint64_t>(static_cast<uint64_t>(end) - static_cast<uint64_t>(begin),
+                                                            WorkPool::instance().size() * CHUNKS_PER_THREAD));
+    }
+
+    // first index of `chunk`; start(chunks) == end
+    int64_t start(size_t chunk) const
+    {
+        uint64_t length = static_cast<uint64_t>(end) - static_cast<uint64_t>(begin);
+        return begin + static_cast<int64_t>(chunk * (length / chunks) + std::min<uint64_t>(chunk, length % chunks));
+    }
+};
+
+// body(lo, hi, chunk) for every chunk of `range`
+template <typename Body>
+void parallelFor(const Range &range, Body body)
+{
+    WorkPool::instance().run(range.chunks, [&](size_t chunk)
+                             { body(range.start(chunk), range.start(chunk + 1), chunk); });
+}
+}
+)RUNTIME";
+
+    /*
+    spawn, await and chan. A chan is a bounded lock-free queue (Vyukov's); a
+    thread only takes its lock to sleep when it is full or empty. Spawned
+    calls go through the same kind of queue to one pool thread per core, and
+    the pool adds a thread when all are blocked while calls are queued. main
+    waits for every spawned call before it returns (finish()).
+    */
+    inline constexpr const char *TASKS = R"RUNTIME(
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace gvoid
+{
+class TaskPool;
+
+// Counts the thread as blocked while it lives, if the pool keeps count of
+// it; defined with the pool.
+struct Blocking
+{
+    Blocking();
+    ~Blocking();
+    Blocking(const Blocking &) = delete;
+    Blocking &operator=(const Blocking &) = delete;
+};
+
+template <typename T>
+class Channel
+{
+public:
+    explicit Channel(int64_t capacity)
+        : m_capacity(static_cast<size_t>(std::max<int64_t>(capacity, 2))), m_cells(m_capacity)
+    {
+        for (size_t i = 0; i < m_capacity; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    void send(T value)
+    {
+        while (!trySend(value))
+            waitUntil([this] { return sendable(); }, true);
+    }
+
+    T receive()
+    {
+        T value;
+        while (!tryReceive(value))
+            waitUntil([this] { return receivable(); }, true);
+        return value;
+    }
+
+private:
+    friend class TaskPool; // its queue of calls, which never blocks a spawn
+
+    static constexpr int SPINS = 64;
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence; // position it may be sent at, or that position + 1 once full
+        T value;
+    };
+
+    const size_t m_capacity; // at least 2, or a cell's two sequence numbers would collide
+    std::vector<Cell> m_cells;
+    alignas(64) std::atomic<size_t> m_sendPos{0};
+    alignas(64) std::atomic<size_t> m_receivePos{0};
+    alignas(64) std::atomic<size_t> m_sleepers{0};
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+
+    // Whether a send or receive could go through now: the next cell is
+    // not a lap behind.
+    bool sendable() const { return lapDifference(m_sendPos, 0) >= 0; }
+    bool receivable() const { return lapDifference(m_receivePos, 1) >= 0; }
+
+    std::ptrdiff_t lapDifference(const std::atomic<size_t> &position, size_t offset) const
+    {
+        size_t pos = position.load(std::memory_order_relaxed);
+        size_t sequence = m_cells[pos % m_capacity].sequence.load(std::memory_order_acquire);
+        return static_cast<std::ptrdiff_t>(sequence - (pos + offset));
+    }
+
+    bool trySend(T &value)
+    {
+        size_t pos = m_sendPos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = m_cells[pos % m_capacity];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == pos)
+            {
+                if (m_sendPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    wakeSleepers();
+                    return true;
+                }
+            }
+            else if (static_cast<std::ptrdiff_t>(sequence - pos) < 0)
+            {
+                return false; // full: the cell is a lap behind
+            }
+            else
+            {
+                pos = m_sendPos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryReceive(T &value)
+    {
+        size_t pos = m_receivePos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = m_cells[pos % m_capacity];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == pos + 1)
+            {
+                if (m_receivePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = std::move(cell.value);
+                    cell.sequence.store(pos + m_capacity, std::memory_order_release);
+                    wakeSleepers();
+                    return true;
+                }
+            }
+            else if (static_cast<std::ptrdiff_t>(sequence - (pos + 1)) < 0)
+            {
+                return false; // empty
+            }
+            else
+            {
+                pos = m_receivePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Until the operation may succeed; the caller then tries it again. A
+    // `blocked` thread is held up, rather than idle.
+    template <typename Possible>
+    void waitUntil(Possible possible, bool blocked)
+    {
+        for (int spin = 0; spin < SPINS; ++spin)
+        {
+            std::this_thread::yield();
+            if (possible())
+                return;
+        }
+
+        std::optional<Blocking> blocking;
+        if (blocked)
+            blocking.emplace();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_sleepers.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        m_changed.wait(lock, possible);
+        m_sleepers.fetch_sub(1);
+    }
+
+    // Pairs with the fence in waitUntil: either the sleeper sees this
+    // operation, or this sees the sleeper.
+    void wakeSleepers()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleepers.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_changed.notify_all();
+        }
+    }
+};
+
+class TaskPool
+{
+public:
+    static TaskPool &instance()
+    {
+        static TaskPool *pool = new TaskPool;
+        return *pool;
+    }
+
+    // A call that will be claimed(), by its job or an await.
+    void submit(std::function<void()> job)
+    {
+        m_pending.fetch_add(1);
+        m_unclaimed.fetch_add(1);
+        if (!m_jobs.trySend(job))
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_overflow.push_back(std::move(job));
+            }
+            m_overflowSize.fetch_add(1);
+            m_jobs.wakeSleepers();
+        }
+        ensureRunner();
+    }
+
+    static void claimed()
+    {
+        instance().m_unclaimed.fetch_sub(1);
+    }
+
+    // Counted for the pool's threads and the one that started the pool;
+    // other threads' waits are none of its business.
+    static void block()
+    {
+        if (!s_counted)
+            return;
+        instance().m_blocked.fetch_add(1);
+        instance().ensureRunner();
+    }
+
+    static void unblock()
+    {
+        if (s_counted)
+            instance().m_blocked.fetch_sub(1);
+    }
+
+    // Until every call spawned so far has returned; at the end of main.
+    static void finish()
+    {
+        if (!s_started.load())
+            return;
+        TaskPool &pool = instance();
+        Blocking blocking;
+        std::unique_lock<std::mutex> lock(pool.m_mutex);
+        pool.m_finished.wait(lock, [&pool] { return pool.m_pending.load() == 0; });
+    }
+
+private:
+    static constexpr int64_t QUEUE_CAPACITY = 4096;
+
+    static inline thread_local bool s_counted = false;
+    static inline std::atomic<bool> s_started{false};
+
+    Channel<std::function<void()>> m_jobs{QUEUE_CAPACITY};
+    std::deque<std::function<void()>> m_overflow; // calls spawned while m_jobs was full
+    std::atomic<size_t> m_overflowSize{0};
+    std::atomic<size_t> m_threads{1};
+    std::atomic<size_t> m_blocked{0};
+    std::atomic<size_t> m_unclaimed{0}; // queued calls that no thread has started
+    std::atomic<size_t> m_pending{0};   // submitted calls that have not returned
+    std::mutex m_mutex;
+    std::condition_variable m_finished; // m_pending reached 0
+
+    TaskPool()
+    {
+        s_started = true;
+        s_counted = true;
+        for (size_t i = threadCount(); i > 0; --i)
+            addThread();
+    }
+
+    // A thread for the queued calls if every counted thread is blocked.
+    void ensureRunner()
+    {
+        if (m_blocked.load() < m_threads.load() || m_unclaimed.load() == 0)
+            return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_blocked.load() >= m_threads.load() && m_unclaimed.load() > 0)
+            addThread();
+    }
+
+    void addThread()
+    {
+        m_threads.fetch_add(1);
+        std::thread([this]
+                    {
+            s_counted = true;
+            std::function<void()> job;
+            while (true)
+            {
+                if (m_jobs.tryReceive(job) || takeOverflow(job))
+                {
+                    job();
+                    job = nullptr; // let go of the task's state
+                    if (m_pending.fetch_sub(1) == 1)
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        m_finished.notify_all();
+                    }
+                }
+                else
+                    m_jobs.waitUntil([this] { return m_jobs.receivable() || m_overflowSize.load() > 0; }, false);
+            } })
+            .detach();
+    }
+
+    bool takeOverflow(std::function<void()> &job)
+    {
+        if (m_overflowSize.load() == 0)
+            return false;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_overflow.empty())
+            return false;
+        job = std::move(m_overflow.front());
+        m_overflow.pop_front();
+        m_overflowSize.fetch_sub(1);
+        return true;
+    }
+};
+
+inline Blocking::Blocking() { TaskPool::block(); }
+inline Blocking::~Blocking() { TaskPool::unblock(); }
+
+template <typename T>
+class Task
+{
+public:
+    Task() = default;
+
+    explicit Task(std::packaged_task<T()> work) : m_state(std::make_shared<State>(std::move(work))) {}
+
+    // A task of a narrower result type, as when a num task is given an
+    // integer one: converted once awaited.
+    template <typename U>
+    Task(const Task<U> &other) : Task(std::packaged_task<T()>([other] { return static_cast<T>(other.get()); })) {}
+
+    void start() const
+    {
+        m_state->queued = true;
+        TaskPool::instance().submit([state = m_state] { state->run(); });
+    }
+
+    T get() const
+    {
+        if (!m_state)
+            throw std::runtime_error("await on a task that was never spawned");
+        m_state->run();
+        if (m_state->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            Blocking blocking;
+            m_state->result.wait();
+        }
+        return m_state->result.get();
+    }
+
+private:
+    struct State
+    {
+        std::atomic<bool> claimed{false};
+        bool queued = false; // set before any thread can see it
+        std::packaged_task<T()> work;
+        std::shared_future<T> result;
+
+        explicit State(std::packaged_task<T()> task) : work(std::move(task)), result(work.get_future().share()) {}
+
+        // by whichever comes first, a pool thread or an await
+        void run()
+        {
+            if (claimed.exchange(true))
+                return;
+            if (queued)
+                TaskPool::claimed();
+            work();
+        }
+    };
+
+    std::shared_ptr<State> m_state;
+};
+
+template <typename F>
+auto spawn(F work) -> Task<decltype(work())>
+{
+    using Result = decltype(work());
+    Task<Result> task(std::packaged_task<Result()>(std::move(work)));
+    task.start();
+    return task;
+}
+
+// What channel(n) evaluates to: turns into a chan of any element type.
+struct Capacity
+{
+    int64_t size;
+};
+
+template <typename T>
+class Chan
+{
+public:
+    Chan() = default;
+    Chan(Capacity capacity) : m_channel(std::make_shared<Channel<T>>(capacity.size)) {}
+
+    void send(T value) const { channel().send(std::move(value)); }
+    T receive() const { return channel().receive(); }
+
+private:
+    std::shared_ptr<Channel<T>> m_channel;
+
+    Channel<T> &channel() const
+    {
+        if (!m_channel)
+            throw std::runtime_error("chan used before it was given a channel(n)");
+        return *m_channel;
+    }
+};
+}
+)RUNTIME";
+
+    /*
+    A generator's frame derives from Generator<Frame, T> and defines
+    bool next(T &); for (x : frame) then calls it for each value until it
+    returns false. Gen<T> holds any such stream behind one pointer: a frame
+    is kept by value where the generator knows which one it iterates, and
+    in a Gen where that is only known at run time (a gen variable or
+    parameter, or a generator that iterates itself).
+    */
+    inline constexpr const char *GENERATORS = R"RUNTIME(
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+namespace gvoid
+{
+// end() of every stream; the iterator knows when it is done.
+struct End
+{
+};
+
+template <typename Source, typename T>
+class Iterator
+{
+public:
+    explicit Iterator(Source &source) : m_source(&source) { ++*this; }
+
+    const T &operator*() const { return m_value; }
+    Iterator &operator++()
+    {
+        m_done = !m_source->next(m_value);
+        return *this;
+    }
+    bool operator!=(End) const { return !m_done; }
+
+private:
+    Source *m_source;
+    T m_value{};
+    bool m_done = false;
+};
+
+template <typename Frame, typename T>
+struct Generator
+{
+    using value_type = T;
+
+    Iterator<Frame, T> begin() { return Iterator<Frame, T>(static_cast<Frame &>(*this)); }
+    End end() const { return {}; }
+};
+
+template <typename T>
+class Gen
+{
+public:
+    using value_type = T;
+
+    Gen() = default;
+
+    // Any stream, converting its values if they are narrower.
+    template <typename S, typename = std::enable_if_t<!std::is_same_v<S, Gen>>>
+    Gen(S source) : m_source(std::make_shared<Adapter<S>>(std::move(source))) {}
+
+    bool next(T &out) const
+    {
+        if (!m_source)
+            throw std::runtime_error("gen iterated before it was given a generator");
+        return m_source->next(out);
+    }
+
+    Iterator<const Gen, T> begin() const { return Iterator<const Gen, T>(*this); }
+    End end() const { return {}; }
+
+private:
+    struct Source
+    {
+        virtual ~Source() = default;
+        virtual bool next(T &out) = 0;
+    };
+
+    template <typename S>
+    struct Adapter : Source
+    {
+        S source;
+
+        explicit Adapter(S s) : source(std::move(s)) {}
+
+        bool next(T &out) override
+        {
+            if constexpr (std::is_same_v<typename S::value_type, T>)
+            {
+                return source.next(out);
+            }
+            else
+            {
+                typename S::value_type value{};
+                if (!source.next(value))
+                    return false;
+                out = static_cast<T>(value);
+                return true;
+            }
+        }
+    };
+
+    std::shared_ptr<Source> m_source;
+};
+}
+)RUNTIME";
+
+    /*
+    Numbers as text, for print and for str + num, with std::to_chars: no
+    locale, no allocation. A floating-point value that holds an integer is
+    written as that integer (1000000, not 1e+06); any other is written in
+    the fewest digits that read back as the same value. concat() and append()
+    build the result of a whole chain of str + with one allocation, sized
+    from all its pieces.
+    */
+    inline constexpr const char *FORMAT = R"RUNTIME(
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace gvoid
+{
+// Room for any number format() writes.
+constexpr size_t NUMBER_CHARS = 32;
+
+// Writes `value` at `first`; returns the end of the text.
+template <typename T>
+char *format(char *first, T value)
+{
+    char *last = first + NUMBER_CHARS;
+    if constexpr (std::is_same_v<T, bool>)
+    {
+        *first = value ? '1' : '0';
+        return first + 1;
+    }
+    else if constexpr (std::is_integral_v<T>)
+    {
+        return std::to_chars(first, last, value).ptr;
+    }
+    else
+    {
+        // below 2^digits every integer is exact
+        constexpr T exact = static_cast<T>(1ull << std::numeric_limits<T>::digits);
+        if (value == std::trunc(value) && std::fabs(value) < exact)
+            return std::to_chars(first, last, static_cast<int64_t>(value)).ptr;
+        return std::to_chars(first, last, value).ptr;
+    }
+}
+
+// One operand of a str +: text as it is, a number formatted in place.
+class Piece
+{
+public:
+    Piece(std::string_view text) : m_text(text) {}
+
+    template <typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+    Piece(T number) : m_size(static_cast<size_t>(format(m_digits, number) - m_digits)), m_number(true)
+    {
+    }
+
+    std::string_view view() const { return m_number ? std::string_view(m_digits, m_size) : m_text; }
+
+private:
+    std::string_view m_text;
+    char m_digits[NUMBER_CHARS];
+    size_t m_size = 0;
+    bool m_number = false;
+};
+
+// a + b + ... + z in one allocation.
+template <typename... Parts>
+std::string concat(const Parts &...parts)
+{
+    const Piece pieces[] = {Piece(parts)...};
+    size_t size = 0;
+    for (const Piece &piece : pieces)
+        size += piece.view().size();
+    std::string text;
+    text.reserve(size);
+    for (const Piece &piece : pieces)
+        text.append(piece.view());
+    return text;
+}
+
+// text += a + ... + z. When text has to grow it at least doubles, so a loop
+// of appends copies each character a constant number of times, and the
+// pieces are copied before the old text is freed, as they may be part of it.
+template <typename... Parts>
+std::string &append(std::string &text, const Parts &...parts)
+{
+    const Piece pieces[] = {Piece(parts)...};
+    size_t size = text.size();
+    for (const Piece &piece : pieces)
+        size += piece.view().size();
+    if (size <= text.capacity())
+    {
+        for (const Piece &piece : pieces)
+            text.append(piece.view());
+        return text;
+    }
+    std::string grown;
+    grown.reserve(std::max(size, 2 * text.capacity()));
+    grown.append(text);
+    for (const Piece &piece : pieces)
+        grown.append(piece.view());
+    text.swap(grown);
+    return text;
+}
+}
+)RUNTIME";
+
+    /*
+    print() appends to one buffer in the program, which goes to stdout with
+    write(2) when it fills up and when the program ends, or dies of an
+    uncaught exception. Only an interactive stdout gets each line as it is
+    printed. Each print appends its line under a lock, so lines printed by
+    tasks and pfor bodies come out whole.
+    */
+    inline constexpr const char *OUTPUT = R"RUNTIME(
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <sstream>
+#include <string_view>
+#include <type_traits>
+#include <unistd.h>
+
+namespace gvoid
+{
+class Output
+{
+public:
+    static Output &instance()
+    {
+        static Output output;
+        return output;
+    }
+
+    ~Output()
+    {
+        std::set_terminate(m_terminate);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        flush();
+    }
+
+    template <typename... Args>
+    void print(const Args &...args)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        (append(args), ...);
+        write("\n", 1);
+        if (m_interactive)
+            flush();
+    }
+
+    // Before the program waits for input that may depend on its output.
+    void sync()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        flush();
+    }
+
+private:
+    static constexpr size_t CAPACITY = 1 << 16;
+
+    char m_buffer[CAPACITY];
+    size_t m_size = 0;
+    bool m_interactive = isatty(STDOUT_FILENO);
+    std::terminate_handler m_terminate;
+    std::mutex m_mutex;
+
+    Output() : m_terminate(std::set_terminate(terminate)) {}
+
+    static void terminate()
+    {
+        Output &output = instance();
+        if (output.m_mutex.try_lock())
+        {
+            output.flush();
+            output.m_mutex.unlock();
+        }
+        if (output.m_terminate)
+            output.m_terminate();
+        std::abort();
+    }
+
+    template <typename T>
+    void append(const T &value)
+    {
+        char digits[NUMBER_CHARS];
+        if constexpr (std::is_convertible_v<const T &, std::string_view>)
+        {
+            std::string_view text(value);
+            write(text.data(), text.size());
+        }
+        else if constexpr (std::is_same_v<T, char>)
+        {
+            write(&value, 1);
+        }
+        else if constexpr (std::is_arithmetic_v<T>)
+        {
+            write(digits, static_cast<size_t>(format(digits, value) - digits));
+        }
+        else
+        {
+            std::ostringstream stream;
+            stream << value;
+            append(stream.str());
+        }
+    }
+
+    void write(const char *data, size_t size)
+    {
+        if (m_size + size > CAPACITY)
+        {
+            flush();
+            if (size > CAPACITY)
+            {
+                writeAll(data, size);
+                return;
+            }
+        }
+        std::memcpy(m_buffer + m_size, data, size);
+        m_size += size;
+    }
+
+    void flush()
+    {
+        writeAll(m_buffer, m_size);
+        m_size = 0;
+    }
+
+    static void writeAll(const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t written = ::write(STDOUT_FILENO, data, size);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return; // nowhere left to report it
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+};
+
+template <typename... Args>
+void print(const Args &...args)
+{
+    Output::instance().print(args...);
+}
+}
+)RUNTIME";
+
+    /*
+    input(), readLine(), readNum(), eof() and `>> x` all take stdin through
+    one 1 MiB buffer, refilled with read(2) once the program has used it up.
+    Words and numbers are parsed where they lie in the buffer, numbers with
+    std::from_chars; only a token that straddles a refill is moved first. A
+    word that is not a number reads as 0, and everything reads as "" or 0
+    once the input has ended. What was printed goes out before each refill,
+    as std::cin does with std::cout. Reading is not synchronized: tasks must
+    not read at the same time.
+    */
+    inline constexpr const char *INPUT = R"RUNTIME(
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unistd.h>
+
+namespace gvoid
+{
+class Input
+{
+public:
+    static Input &instance()
+    {
+        static Input input;
+        return input;
+    }
+
+    std::string word()
+    {
+        return std::string(token());
+    }
+
+    double number()
+    {
+        std::string_view text = numberToken();
+        double value = 0;
+        std::from_chars(text.data(), text.data() + text.size(), value);
+        return value;
+    }
+
+    // Digits are converted directly; "2.5" or "1e6" go through a double.
+    int64_t integer()
+    {
+        std::string_view text = numberToken();
+        const char *first = text.data();
+        const char *last = first + text.size();
+        int64_t value = 0;
+        auto result = std::from_chars(first, last, value);
+        if (result.ptr == last && result.ec == std::errc())
+            return value;
+        double real = 0;
+        std::from_chars(first, last, real);
+        return static_cast<int64_t>(real);
+    }
+
+    // The rest of the current line, without its "\n" or "\r\n".
+    std::string line()
+    {
+        std::string text;
+        while (m_pos < m_end || fill())
+        {
+            const char *start = m_buffer + m_pos;
+            auto newline = static_cast<const char *>(std::memchr(start, '\n', m_end - m_pos));
+            if (newline)
+            {
+                text.append(start, newline);
+                m_pos = static_cast<size_t>(newline - m_buffer) + 1;
+                break;
+            }
+            text.append(start, m_end - m_pos);
+            m_pos = m_end;
+        }
+        if (!text.empty() && text.back() == '\r')
+            text.pop_back();
+        return text;
+    }
+
+    // Looks past whitespace without taking it, so a readLine() after this
+    // still gets the line as it was.
+    bool atEnd()
+    {
+        size_t ahead = m_pos;
+        for (;;)
+        {
+            for (; ahead < m_end; ++ahead)
+            {
+                if (!isSpace(m_buffer[ahead]))
+                    return false;
+            }
+            if (m_end - m_pos == CAPACITY)
+                m_pos = m_end; // a whole buffer of whitespace
+            size_t skipped = ahead - m_pos;
+            if (!fill())
+                return true;
+            ahead = m_pos + skipped;
+        }
+    }
+
+private:
+    static constexpr size_t CAPACITY = 1 << 20;
+
+    char m_buffer[CAPACITY];
+    size_t m_pos = 0;
+    size_t m_end = 0;
+    bool m_ended = false;
+
+    Input() = default;
+
+    static bool isSpace(char c)
+    {
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+
+    // The next whitespace-delimited word, valid until the next read; ""
+    // at the end of the input.
+    std::string_view token()
+    {
+        skipSpace();
+        size_t end = m_pos;
+        for (;;)
+        {
+            while (end < m_end && !isSpace(m_buffer[end]))
+                ++end;
+            if (end < m_end)
+                break;
+            size_t length = end - m_pos;
+            bool more = fill();
+            end = m_pos + length;
+            if (!more)
+                break;
+        }
+        std::string_view text(m_buffer + m_pos, end - m_pos);
+        m_pos = end;
+        return text;
+    }
+
+    // from_chars takes no leading '+'
+    std::string_view numberToken()
+    {
+        std::string_view text = token();
+        if (!text.empty() && text.front() == '+')
+            text.remove_prefix(1);
+        return text;
+    }
+
+    void skipSpace()
+    {
+        for (;;)
+        {
+            while (m_pos < m_end && isSpace(m_buffer[m_pos]))
+                ++m_pos;
+            if (m_pos < m_end || !fill())
+                return;
+        }
+    }
+
+    // Moves what is left to the front and reads more after it; false at the
+    // end of the input, or when the buffer holds nothing but what is left.
+    bool fill()
+    {
+        if (m_pos > 0)
+        {
+            std::memmove(m_buffer, m_buffer + m_pos, m_end - m_pos);
+            m_end -= m_pos;
+            m_pos = 0;
+        }
+        if (m_ended || m_end == CAPACITY)
+            return false;
+
+        Output::instance().sync();
+        for (;;)
+        {
+            ssize_t got = ::read(STDIN_FILENO, m_buffer + m_end, CAPACITY - m_end);
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+            {
+                m_ended = true;
+                return false;
+            }
+            m_end += static_cast<size_t>(got);
+            return true;
+        }
+    }
+};
+
+inline std::string input()
+{
+    return Input::instance().word();
+}
+
+inline std::string readLine()
+{
+    return Input::instance().line();
+}
+
+inline double readNum()
+{
+    return Input::instance().number();
+}
+
+inline bool eof()
+{
+    return Input::instance().atEnd();
+}
+
+// >> x, for an x of type T
+template <typename T>
+T read()
+{
+    if constexpr (std::is_same_v<T, std::string>)
+        return input();
+    else if constexpr (std::is_integral_v<T>)
+        return static_cast<T>(Input::instance().integer());
+    else
+        return static_cast<T>(readNum());
+}
+}
+)RUNTIME";
+
+    /*
+    readFile(), writeFile() and lines(). lines() maps the file and finds each
+    line in the mapping with memchr; the loop gets a string_view of it, so a
+    line costs neither a copy nor an allocation. A file that cannot be
+    mapped (a pipe, /dev/stdin) is read into memory instead. writeFile()
+    hands the whole str to write(2) at once. A file that cannot be opened,
+    read or written throws, naming the file.
+    */
+    inline constexpr const char *FILES = R"RUNTIME(
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gvoid
+{
+[[noreturn]] inline void fileError(const std::string &what, std::string_view path)
+{
+    throw std::runtime_error(what + " '" + std::string(path) + "': " + std::strerror(errno));
+}
+
+class FileDescriptor
+{
+public:
+    FileDescriptor(std::string_view path, int flags)
+        : m_fd(::open(std::string(path).c_str(), flags | O_CLOEXEC, 0644))
+    {
+        if (m_fd < 0)
+            fileError("cannot open", path);
+    }
+
+    ~FileDescriptor() { ::close(m_fd); }
+
+    FileDescriptor(const FileDescriptor &) = delete;
+    FileDescriptor &operator=(const FileDescriptor &) = delete;
+
+    int get() const { return m_fd; }
+
+    // The size of a regular file, -1 for anything else.
+    off_t regularSize() const
+    {
+        struct stat status;
+        return ::fstat(m_fd, &status) == 0 && S_ISREG(status.st_mode) ? status.st_size : -1;
+    }
+
+private:
+    int m_fd;
+};
+
+// Reads to the end into `out`, which is sized for what is expected; more
+// is appended, less is cut off.
+inline void readAll(const FileDescriptor &file, std::string &out, std::string_view path)
+{
+    size_t size = 0;
+    char chunk[1 << 16];
+    for (;;)
+    {
+        bool full = size == out.size();
+        ssize_t got = ::read(file.get(), full ? chunk : &out[size], full ? sizeof chunk : out.size() - size);
+        if (got < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fileError("cannot read", path);
+        }
+        if (got == 0)
+            break;
+        if (full)
+            out.append(chunk, static_cast<size_t>(got));
+        size += static_cast<size_t>(got);
+    }
+    out.resize(size);
+}
+
+inline std::string readFile(std::string_view path)
+{
+    FileDescriptor file(path, O_RDONLY);
+    off_t size = file.regularSize();
+    std::string contents(size > 0 ? static_cast<size_t>(size) : 0, '\0');
+    readAll(file, contents, path);
+    return contents;
+}
+
+inline void writeFile(std::string_view path, std::string_view text)
+{
+    FileDescriptor file(path, O_WRONLY | O_CREAT | O_TRUNC);
+    const char *data = text.data();
+    size_t size = text.size();
+    while (size > 0)
+    {
+        ssize_t written = ::write(file.get(), data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fileError("cannot write", path);
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+// A whole file in memory: mapped if it can be, read otherwise.
+class FileText
+{
+public:
+    explicit FileText(std::string_view path)
+    {
+        FileDescriptor file(path, O_RDONLY);
+        off_t size = file.regularSize();
+        if (size > 0)
+        {
+            void *mapped = ::mmap(nullptr, static_cast<size_t>(size), PROT_READ, MAP_PRIVATE, file.get(), 0);
+            if (mapped != MAP_FAILED)
+            {
+                ::madvise(mapped, static_cast<size_t>(size), MADV_SEQUENTIAL);
+                m_mapped = mapped;
+                m_data = static_cast<const char *>(mapped);
+                m_size = static_cast<size_t>(size);
+                return;
+            }
+            m_contents.resize(static_cast<size_t>(size));
+        }
+        readAll(file, m_contents, path);
+        m_data = m_contents.data();
+        m_size = m_contents.size();
+    }
+
+    ~FileText()
+    {
+        if (m_mapped)
+            ::munmap(m_mapped, m_size);
+    }
+
+    FileText(const FileText &) = delete;
+    FileText &operator=(const FileText &) = delete;
+
+    const char *data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    void *m_mapped = nullptr;
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+    std::string m_contents;
+};
+
+// Each line without its "\n" or "\r\n"; a last line without one counts.
+class Lines : public Generator<Lines, std::string_view>
+{
+public:
+    Lines() = default;
+    explicit Lines(std::string_view path) : m_text(std::make_shared<const FileText>(path)) {}
+
+    bool next(std::string_view &out)
+    {
+        if (!m_text || m_pos == m_text->size())
+            return false;
+        const char *start = m_text->data() + m_pos;
+        size_t left = m_text->size() - m_pos;
+        auto newline = static_cast<const char *>(std::memchr(start, '\n', left));
+        size_t length = newline ? static_cast<size_t>(newline - start) : left;
+        m_pos += newline ? length + 1 : length;
+        if (length > 0 && start[length - 1] == '\r')
+            --length;
+        out = std::string_view(start, length);
+        return true;
+    }
+
+private:
+    std::shared_ptr<const FileText> m_text;
+    size_t m_pos = 0;
+};
+
+inline Lines lines(std::string_view path)
+{
+    return Lines(path);
+}
+}
+)RUNTIME";
+
+    /*
+    substr(), find() and split() on string_views: substr and split give
+    views into their argument and copy nothing. Out of range positions are
+    clamped rather than reported, so substr(s, 2, 100) is the rest of s.
+    split() without a separator (or with "") splits on runs of whitespace,
+    leaving out empty words.
+    */
+    inline constexpr const char *TEXT = R"RUNTIME(
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace gvoid
+{
+inline size_t clampPosition(double position, size_t size)
+{
+    return position <= 0 ? 0 : position >= static_cast<double>(size) ? size : static_cast<size_t>(position);
+}
+
+inline std::string_view substr(std::string_view text, double start, double length = -1)
+{
+    size_t from = clampPosition(start, text.size());
+    size_t count = length < 0 ? text.size() - from : clampPosition(length, text.size() - from);
+    return text.substr(from, count);
+}
+
+inline int64_t find(std::string_view text, std::string_view part, double from = 0)
+{
+    size_t at = text.find(part, clampPosition(from, text.size()));
+    return at == std::string_view::npos ? -1 : static_cast<int64_t>(at);
+}
+
+class Split : public Generator<Split, std::string_view>
+{
+public:
+    Split() = default;
+    Split(std::string_view text, std::string_view separator = {}) : m_text(text), m_separator(separator) {}
+
+    bool next(std::string_view &out)
+    {
+        if (m_separator.empty())
+            return nextWord(out);
+        if (m_done)
+            return false;
+        size_t at = m_text.find(m_separator, m_pos);
+        if (at == std::string_view::npos)
+        {
+            m_done = true;
+            at = m_text.size();
+        }
+        out = m_text.substr(m_pos, at - m_pos);
+        m_pos = at + m_separator.size();
+        return true;
+    }
+
+private:
+    static bool isSpace(char c)
+    {
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+
+    bool nextWord(std::string_view &out)
+    {
+        while (m_pos < m_text.size() && isSpace(m_text[m_pos]))
+            ++m_pos;
+        if (m_pos == m_text.size())
+            return false;
+        size_t start = m_pos;
+        while (m_pos < m_text.size() && !isSpace(m_text[m_pos]))
+            ++m_pos;
+        out = m_text.substr(start, m_pos - start);
+        return true;
+    }
+
+    std::string_view m_text;
+    std::string m_separator;
+    size_t m_pos = 0;
+    bool m_done = false;
+};
+
+inline Split split(std::string_view text, std::string_view separator = {})
+{
+    return Split(text, separator);
+}
+}
+)RUNTIME";
+}
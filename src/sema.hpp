@@ -0,0 +1,2019 @@
+#pragma once
+
+#include "ast.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+Semantic analysis: resolves names against scoped symbol tables, resolves
+call targets and annotates the AST with types for the generator; the rules
+it enforces are those of readme.md.
+
+Parameter, return and `num` types are inferred from every call, `return`
+and assignment. Since one function's types depend on others, the whole
+program is walked repeatedly until nothing changes. Types only widen (bool <
+int < num) and integer value ranges widen to a few fixed bounds, so this
+terminates; an inferred integer is kept only while its range provably stays
+within 2^53, where a double would hold it exactly.
+*/
+class Sema
+{
+public:
+    explicit Sema(AST::StmtList &statements)
+        : m_statements(statements) {}
+
+    void analyze()
+    {
+        collectDeclarations();
+
+        do
+        {
+            do
+            {
+                m_changed = false;
+                m_pass++;
+                analyzeProgram();
+            } while (m_changed);
+        } while (applyDefaults());
+    }
+
+    static std::string typeName(AST::Type type)
+    {
+        switch (type)
+        {
+        case AST::Type::Void:
+            return "void";
+        case AST::Type::Bool:
+            return "bool";
+        case AST::Type::I32:
+            return "i32";
+        case AST::Type::Int:
+            return "i64";
+        case AST::Type::F32:
+            return "f32";
+        case AST::Type::Num:
+            return "num";
+        case AST::Type::Str:
+            return "str";
+        case AST::Type::View:
+            return "str_view";
+        case AST::Type::Arr:
+            return "arr";
+        case AST::Type::Task:
+            return "task";
+        case AST::Type::Chan:
+            return "chan";
+        case AST::Type::Gen:
+            return "gen";
+        default:
+            return "unknown";
+        }
+    }
+
+private:
+    // Points at the type annotation of the declaring AST node, so what one
+    // pass learns about a symbol is there for the next. Inferred symbols
+    // (num variables, parameters) widen with every value stored in them.
+    struct Symbol
+    {
+        AST::Type *type;
+        bool inferred;
+        AST::VarDeclStmt *topLevel = nullptr;
+        AST::Type *element = nullptr; // of a task or chan
+        int parameter = -1;           // index among the current function's parameters
+        std::vector<const AST::Type *> views = {}; // str variables a view or gen looks into
+    };
+
+    using Scope = std::unordered_map<std::string, Symbol>;
+
+    AST::StmtList &m_statements;
+    std::unordered_map<std::string, AST::FunctionStmt *> m_functions;
+    std::vector<Scope> m_scopes;
+    std::unordered_set<AST::VarDeclStmt *> m_numVars;
+    std::unordered_set<const AST::VarDeclStmt *> m_reached; // top-level declarations seen this pass
+    AST::FunctionStmt *m_currentFunction = nullptr;
+    int m_loopDepth = 0;     // loops around the statement being analyzed
+    int m_parallelDepth = 0; // m_loopDepth inside the innermost pfor body, 0 outside one
+    const AST::ForStmt *m_parallelLoop = nullptr; // the innermost pfor around
+    size_t m_parallelScope = 0;                   // first scope of its body
+    bool m_changed = false;
+    bool m_defaulted = false;
+    bool m_externalCalls = false;
+
+    // Ranges of the integers stored in inferred slots, and the pass that
+    // first stored one. An accumulation (x = x + e) adds at most its loops'
+    // trips times e to what the other stores put in x.
+    struct Known
+    {
+        AST::Range range;
+        int pass;
+        AST::Range base; // of the stores that are not accumulations
+        std::unordered_map<const AST::Expr *, AST::Range> growth = {};
+    };
+    std::unordered_map<const AST::Type *, Known> m_ranges;
+    int m_pass = 0;
+
+    // A loop around the statement being analyzed: at most how often its body
+    // runs each time the loop is reached, and the number of scopes outside it.
+    struct Loop
+    {
+        double trips;
+        size_t scopes;
+    };
+    std::vector<Loop> m_loops;
+
+    // A loop counter that is stepped towards the bound its loop checks
+    // first; while stepping it is within that bound.
+    struct Counter
+    {
+        const AST::IdentifierExpr *operand; // the counter as the step reads it
+        const AST::Expr *bound;
+        TokenType op; // of `counter op bound`
+    };
+    const Counter *m_counter = nullptr;
+
+    static constexpr double exactLimit = 9007199254740992.0; // 2^53
+    static constexpr double sizeLimit = 281474976710656.0;   // 2^48: no str or arr gets that long
+
+    std::runtime_error semanticError(int line, const std::string &message)
+    {
+        return std::runtime_error("[Line " + std::to_string(line) + "] Error: " + message);
+    }
+
+    // Unknown for num: its representation is inferred.
+    static AST::Type declaredType(const std::string &keyword)
+    {
+        if (keyword == "str")
+            return AST::Type::Str;
+        if (keyword == "str_view")
+            return AST::Type::View;
+        if (keyword == "arr")
+            return AST::Type::Arr;
+        if (keyword == "bool")
+            return AST::Type::Bool;
+        if (keyword == "i32")
+            return AST::Type::I32;
+        if (keyword == "i64")
+            return AST::Type::Int;
+        if (keyword == "f32")
+            return AST::Type::F32;
+        if (keyword == "f64")
+            return AST::Type::Num;
+        if (keyword == "task")
+            return AST::Type::Task;
+        if (keyword == "gen")
+            return AST::Type::Gen;
+        if (keyword.compare(0, 5, "chan<") == 0)
+            return AST::Type::Chan;
+        return AST::Type::Unknown;
+    }
+
+    // The values of a chan<T>; unknown for tasks and gens, whose results are
+    // inferred.
+    static AST::Type declaredElement(const std::string &keyword)
+    {
+        if (keyword.compare(0, 5, "chan<") != 0)
+            return AST::Type::Unknown;
+        std::string element = keyword.substr(5, keyword.size() - 6);
+        return element == "num" ? AST::Type::Num : declaredType(element);
+    }
+
+    static bool isHandle(AST::Type type)
+    {
+        return type == AST::Type::Task || type == AST::Type::Chan || type == AST::Type::Gen;
+    }
+
+    static bool isText(AST::Type type)
+    {
+        return type == AST::Type::Str || type == AST::Type::View;
+    }
+
+    // What `str +` accepts: strs and views, and numbers, which become text.
+    static bool concatenable(AST::Type type)
+    {
+        return isText(type) || type == AST::Type::Unknown || numericRank(type) > numericRank(AST::Type::Bool);
+    }
+
+    static int numericRank(AST::Type type)
+    {
+        switch (type)
+        {
+        case AST::Type::Bool:
+            return 1;
+        case AST::Type::I32:
+            return 2;
+        case AST::Type::Int:
+            return 3;
+        case AST::Type::F32:
+            return 4;
+        case AST::Type::Num:
+            return 5;
+        default:
+            return 0;
+        }
+    }
+
+    static bool assignable(AST::Type target, AST::Type source)
+    {
+        return target == source || target == AST::Type::Unknown || source == AST::Type::Unknown ||
+               (numericRank(target) > 0 && numericRank(source) > 0) || (isText(target) && isText(source));
+    }
+
+    // Type of +, -, * and % on two numbers: the wider operand, at least an
+    // integer. Unknown while an operand is still being inferred, so that an
+    // early pass does not widen anything prematurely.
+    static AST::Type arithmetic(AST::Type left, AST::Type right)
+    {
+        if (left == AST::Type::Num || right == AST::Type::Num)
+            return AST::Type::Num;
+        if (left == AST::Type::Unknown || right == AST::Type::Unknown)
+            return AST::Type::Unknown;
+        AST::Type wider = numericRank(left) >= numericRank(right) ? left : right;
+        return wider == AST::Type::Bool ? AST::Type::Int : wider;
+    }
+
+    static bool integral(AST::Type type)
+    {
+        return type == AST::Type::Bool || type == AST::Type::I32 || type == AST::Type::Int;
+    }
+
+    // Within 2^53, where an int64_t and a double agree. Ranges are worked
+    // out in doubles, which round a bound past 2^53 to 2^53 at least.
+    static bool exact(const AST::Range &range)
+    {
+        return range.low > -exactLimit && range.high < exactLimit;
+    }
+
+    // Any value of a declared type.
+    static AST::Range declaredRange(AST::Type type)
+    {
+        switch (type)
+        {
+        case AST::Type::Bool:
+            return {0, 1};
+        case AST::Type::I32:
+            return {-2147483648.0, 2147483647.0};
+        case AST::Type::Int:
+            return {-9223372036854775808.0, 9223372036854775807.0, true};
+        default:
+            return {};
+        }
+    }
+
+    AST::Range knownRange(const AST::Type &slot) const
+    {
+        auto known = m_ranges.find(&slot);
+        return known == m_ranges.end() ? AST::Range{} : known->second.range;
+    }
+
+    AST::Range rangeOf(const Symbol &symbol) const
+    {
+        if (symbol.inferred || m_ranges.count(symbol.type))
+            return knownRange(*symbol.type);
+        return declaredRange(*symbol.type);
+    }
+
+    // Adds the range of one more integer to that of an inferred slot. A
+    // range that still grows after the pass that first set it grows with
+    // every pass; it moves up to the next bound instead.
+    void widen(const AST::Type &slot, const AST::Range &range)
+    {
+        auto [it, added] = m_ranges.try_emplace(&slot, Known{range, m_pass, range});
+        if (added)
+        {
+            m_changed = true;
+            return;
+        }
+        it->second.base = hull(it->second.base, range);
+        grow(it->second, range);
+    }
+
+    void grow(Known &known, const AST::Range &range)
+    {
+        AST::Range widened = hull(known.range, range);
+        if (widened.low == known.range.low && widened.high == known.range.high &&
+            widened.fixed == known.range.fixed)
+            return;
+        if (known.pass < m_pass)
+        {
+            if (widened.high > known.range.high)
+                widened.high = nextBound(widened.high);
+            if (widened.low < known.range.low)
+                widened.low = -nextBound(-widened.low);
+        }
+        known.range = widened;
+        m_changed = true;
+    }
+
+    static AST::Range hull(const AST::Range &a, const AST::Range &b)
+    {
+        return {std::min(a.low, b.low), std::max(a.high, b.high), a.fixed || b.fixed};
+    }
+
+    // Stores `range`, the value of an accumulation `store` that adds `step`
+    // to an inferred local, and narrows it to what the accumulation can
+    // reach. False if the symbol's range is not tracked that way.
+    bool accumulate(Symbol &symbol, AST::Type type, const AST::Expr &store, const AST::Range &step,
+                    AST::Range &range, int line, const std::string &name)
+    {
+        auto known = m_ranges.find(symbol.type);
+        if (!symbol.inferred || symbol.parameter >= 0 || (symbol.topLevel && symbol.topLevel->global) ||
+            type != AST::Type::Int || known == m_ranges.end())
+            return false;
+
+        double trips = 1;
+        for (const Loop &loop : m_loops)
+        {
+            if (scopeOf(name) < loop.scopes)
+                trips = times(trips, loop.trips);
+        }
+        known->second.growth[&store] = {times(trips, std::min(step.low, 0.0)), times(trips, std::max(step.high, 0.0))};
+        AST::Range reach = known->second.base;
+        for (const auto &[other, growth] : known->second.growth)
+        {
+            reach.low += growth.low;
+            reach.high += growth.high;
+        }
+        range.low = std::max(range.low, reach.low);
+        range.high = std::min(range.high, reach.high);
+
+        merge(*symbol.type, numType(type), line, "'" + name + "'");
+        grow(known->second, range);
+        return true;
+    }
+
+    // a bound of 0 times an infinite one is 0, not NaN
+    static double times(double x, double y)
+    {
+        return x == 0 || y == 0 ? 0 : x * y;
+    }
+
+    static double nextBound(double value)
+    {
+        for (double bound : {65536.0, 4294967296.0, exactLimit})
+        {
+            if (value <= bound)
+                return bound;
+        }
+        return std::numeric_limits<double>::infinity();
+    }
+
+    // Range of `a op b` for + - * and %.
+    static AST::Range combine(TokenType op, const AST::Range &a, const AST::Range &b)
+    {
+        switch (op)
+        {
+        case TokenType::PLUS:
+            return {a.low + b.low, a.high + b.high};
+        case TokenType::MINUS:
+            return {a.low - b.high, a.high - b.low};
+        case TokenType::ASTER:
+        {
+            double corners[] = {times(a.low, b.low), times(a.low, b.high), times(a.high, b.low),
+                                times(a.high, b.high)};
+            return {*std::min_element(std::begin(corners), std::end(corners)),
+                    *std::max_element(std::begin(corners), std::end(corners))};
+        }
+        default:
+        {
+            // smaller than the divisor, with the sign of the dividend
+            double limit = std::max(-b.low, b.high) - 1;
+            return {std::max(std::min(a.low, 0.0), -limit), std::min(std::max(a.high, 0.0), limit)};
+        }
+        }
+    }
+
+    // Range of & | ^ and ~: within the powers of two around the operands. A
+    // double operand is truncated, to any int64_t.
+    static AST::Range bitwise(AST::Type left, AST::Type right, const AST::Range &a, const AST::Range &b)
+    {
+        if (!integral(left) || !integral(right) || !exact(a) || !exact(b))
+            return declaredRange(AST::Type::Int);
+        double magnitude = std::max({-a.low, a.high, -b.low, b.high});
+        double power = 1;
+        while (power <= magnitude)
+            power *= 2;
+        return {a.low < 0 || b.low < 0 ? -power : 0, power - 1};
+    }
+
+    // Type of `left op right` for + - * and %, whose range goes to `range`.
+    // Integers stay integers while the result is within 2^53; beyond that,
+    // or for a % that may divide by zero (NaN for a num), the operation is
+    // done in doubles. Arithmetic on fixed-width operands stays as written.
+    AST::Type arithmetic(TokenType op, AST::Type left, AST::Type right, const AST::Range &a, const AST::Range &b,
+                         AST::Range &range)
+    {
+        AST::Type type = arithmetic(left, right);
+        if (type == AST::Type::I32)
+            range = declaredRange(type);
+        if (type != AST::Type::Int)
+            return type;
+        if (a.fixed || b.fixed)
+        {
+            range = declaredRange(AST::Type::Int);
+            return type;
+        }
+        range = combine(op, a, b);
+        bool divides = op != TokenType::PERCENT || b.low > 0 || b.high < 0;
+        return divides && exact(range) ? AST::Type::Int : AST::Type::Num;
+    }
+
+    // What a num holding a value of `type` becomes: i64 or f64.
+    static AST::Type numType(AST::Type type)
+    {
+        switch (type)
+        {
+        case AST::Type::Bool:
+        case AST::Type::I32:
+            return AST::Type::Int;
+        case AST::Type::F32:
+            return AST::Type::Num;
+        default:
+            return type;
+        }
+    }
+
+    // Widens an inferred type with one more observation. Once defaults are
+    // in, an unknown value can only come from an external function, which
+    // may well return a fraction.
+    void merge(AST::Type &slot, AST::Type type, int line, const std::string &what)
+    {
+        if (type == AST::Type::Unknown)
+        {
+            if (!m_defaulted || numericRank(slot) == 0)
+                return;
+            type = AST::Type::Num;
+        }
+        if (slot == type)
+            return;
+
+        if (slot == AST::Type::Unknown ||
+            (numericRank(slot) > 0 && numericRank(type) > numericRank(slot)) ||
+            (slot == AST::Type::View && type == AST::Type::Str))
+        {
+            slot = type;
+            m_changed = true;
+            return;
+        }
+
+        if ((numericRank(slot) > 0 && numericRank(type) > 0) || (slot == AST::Type::Str && type == AST::Type::View))
+            return;
+
+        throw semanticError(line, what + " is used as both " + typeName(slot) + " and " + typeName(type));
+    }
+
+    // merge() that also widens the slot's range with an integer's.
+    void merge(AST::Type &slot, AST::Type type, const AST::Range &range, int line, const std::string &what)
+    {
+        merge(slot, type, line, what);
+        if (integral(type))
+            widen(slot, range);
+    }
+
+    // Stores a value of `type` into `symbol`: widens inferred symbols, checks
+    // declared ones.
+    void store(Symbol &symbol, AST::Type type, const AST::Range &range, int line, const std::string &name)
+    {
+        if (symbol.inferred)
+        {
+            merge(*symbol.type, numType(type), range, line, "'" + name + "'");
+        }
+        else if (!assignable(*symbol.type, type))
+        {
+            throw semanticError(line, "Cannot assign a " + typeName(type) + " value to " + typeName(*symbol.type) +
+                                          " '" + name + "'");
+        }
+    }
+
+    // A task or gen takes on the element type of every one stored in it; a
+    // chan only accepts chans of its own element type.
+    void storeElement(Symbol &symbol, const AST::Expr &value, int line, const std::string &name)
+    {
+        if (!symbol.element || value.element == AST::Type::Unknown)
+            return;
+        if (*symbol.type == AST::Type::Task)
+        {
+            merge(*symbol.element, value.element, line, "Result of task '" + name + "'");
+        }
+        else if (*symbol.type == AST::Type::Gen)
+        {
+            merge(*symbol.element, value.element, line, "Values of gen '" + name + "'");
+        }
+        else if (*symbol.element != value.element)
+        {
+            throw semanticError(line, "Cannot assign a chan<" + typeName(value.element) + "> to chan<" +
+                                          typeName(*symbol.element) + "> '" + name + "'");
+        }
+    }
+
+    // Whatever stayed unknown after inference had nothing to go on; it gets
+    // the general num representation. Returns whether another round of
+    // passes is needed, which includes the first time if external results
+    // have yet to be treated as doubles.
+    bool applyDefaults()
+    {
+        bool defaulted = !m_defaulted && m_externalCalls;
+        m_defaulted = true;
+        auto fallback = [&defaulted](AST::Type &type)
+        {
+            if (type == AST::Type::Unknown)
+            {
+                type = AST::Type::Num;
+                defaulted = true;
+            }
+        };
+
+        for (auto &[name, func] : m_functions)
+        {
+            for (auto &type : func->paramTypes)
+            {
+                fallback(type);
+            }
+            if (returnsValue(*func->body))
+            {
+                fallback(func->returnType);
+            }
+            if (func->generator)
+            {
+                fallback(func->yieldType);
+            }
+        }
+
+        for (auto *varDecl : m_numVars)
+        {
+            fallback(varDecl->varType);
+        }
+
+        return defaulted;
+    }
+
+    void collectDeclarations()
+    {
+        for (auto &stmt : m_statements)
+        {
+            if (auto func = dynamic_cast<AST::FunctionStmt *>(stmt.get()))
+            {
+                if (func->name == "main")
+                {
+                    throw semanticError(func->line, "'main' is reserved for the program entry point");
+                }
+                if (!m_functions.emplace(func->name, func).second)
+                {
+                    throw semanticError(func->line, "Function '" + func->name + "' is already defined");
+                }
+                if (func->generator)
+                {
+                    func->returnType = AST::Type::Gen;
+                }
+                func->paramTypes.clear();
+                func->paramElements.clear();
+                func->paramsAssigned.assign(func->params.size(), false);
+                for (const auto &typeName : func->paramTypeNames)
+                {
+                    func->paramTypes.push_back(declaredType(typeName));
+                    func->paramElements.push_back(declaredElement(typeName));
+                }
+            }
+        }
+    }
+
+    void analyzeProgram()
+    {
+        // Top-level variables become globals, visible everywhere.
+        m_scopes.clear();
+        m_scopes.emplace_back();
+        m_reached.clear();
+        for (auto &stmt : m_statements)
+        {
+            if (auto varDecl = dynamic_cast<AST::VarDeclStmt *>(stmt.get()))
+            {
+                Symbol symbol = declare(*varDecl);
+                symbol.topLevel = varDecl;
+                if (!m_scopes.back().emplace(varDecl->name, symbol).second)
+                {
+                    throw semanticError(varDecl->line, "Variable '" + varDecl->name + "' is already declared");
+                }
+            }
+        }
+
+        for (auto &stmt : m_statements)
+        {
+            if (auto varDecl = dynamic_cast<AST::VarDeclStmt *>(stmt.get()))
+            {
+                if (varDecl->initializer)
+                {
+                    checkInitializer(*varDecl);
+                    varDecl->constant = constant(*varDecl->initializer);
+                    lookInto(m_scopes.back().at(varDecl->name), *varDecl->initializer);
+                }
+                // a global is 0 until main() reaches an initializer that is not constant
+                if (varDecl->global && !varDecl->constant && varDecl->type == "num")
+                    widen(varDecl->varType, {0, 0});
+                m_reached.insert(varDecl);
+            }
+            else if (!dynamic_cast<AST::FunctionStmt *>(stmt.get()))
+            {
+                analyzeStmt(*stmt);
+            }
+        }
+
+        for (auto &stmt : m_statements)
+        {
+            if (auto func = dynamic_cast<AST::FunctionStmt *>(stmt.get()))
+            {
+                analyzeFunction(*func);
+            }
+        }
+    }
+
+    // Literals and operators on them (anything that stores has a variable
+    // operand), which a global can be initialized with before main() runs.
+    static bool constant(const AST::Expr &expr)
+    {
+        if (dynamic_cast<const AST::LiteralExpr *>(&expr))
+            return true;
+        if (auto unary = dynamic_cast<const AST::UnaryExpr *>(&expr))
+            return constant(*unary->right);
+        auto binary = dynamic_cast<const AST::BinaryExpr *>(&expr);
+        return binary && constant(*binary->left) && constant(*binary->right);
+    }
+
+    void analyzeFunction(AST::FunctionStmt &func)
+    {
+        m_currentFunction = &func;
+        m_scopes.emplace_back();
+        for (size_t i = 0; i < func.params.size(); ++i)
+        {
+            bool inferred = func.paramTypeNames[i] == "num";
+            Symbol symbol{&func.paramTypes[i], inferred};
+            symbol.parameter = static_cast<int>(i);
+            if (isHandle(func.paramTypes[i]))
+                symbol.element = &func.paramElements[i];
+            if (!m_scopes.back().emplace(func.params[i], symbol).second)
+            {
+                throw semanticError(func.line, "Duplicate parameter '" + func.params[i] + "'");
+            }
+        }
+
+        // the body block shares the parameter scope
+        if (auto block = dynamic_cast<AST::BlockStmt *>(func.body.get()))
+        {
+            for (auto &stmt : block->statements)
+            {
+                analyzeStmt(*stmt);
+            }
+        }
+        else
+        {
+            analyzeStmt(*func.body);
+        }
+
+        m_scopes.pop_back();
+        m_currentFunction = nullptr;
+
+        if (func.returnType == AST::Type::Unknown && !returnsValue(*func.body))
+        {
+            func.returnType = AST::Type::Void;
+            m_changed = true;
+        }
+    }
+
+    static bool returnsValue(const AST::Stmt &stmt)
+    {
+        if (auto ret = dynamic_cast<const AST::ReturnStmt *>(&stmt))
+            return ret->value != nullptr;
+        if (auto block = dynamic_cast<const AST::BlockStmt *>(&stmt))
+        {
+            for (const auto &s : block->statements)
+            {
+                if (returnsValue(*s))
+                    return true;
+            }
+        }
+        if (auto ifStmt = dynamic_cast<const AST::IfStmt *>(&stmt))
+            return returnsValue(*ifStmt->thenBranch) || (ifStmt->elseBranch && returnsValue(*ifStmt->elseBranch));
+        if (auto whileStmt = dynamic_cast<const AST::WhileStmt *>(&stmt))
+            return returnsValue(*whileStmt->body);
+        if (auto forStmt = dynamic_cast<const AST::ForStmt *>(&stmt))
+            return returnsValue(*forStmt->body);
+        if (auto forIn = dynamic_cast<const AST::ForInStmt *>(&stmt))
+            return returnsValue(*forIn->body);
+        return false;
+    }
+
+    Symbol *lookup(const std::string &name)
+    {
+        for (auto it = m_scopes.rbegin(); it != m_scopes.rend(); ++it)
+        {
+            auto found = it->find(name);
+            if (found != it->end())
+                return &found->second;
+        }
+        return nullptr;
+    }
+
+    // Index of the scope that declares `name`.
+    size_t scopeOf(const std::string &name) const
+    {
+        for (size_t i = m_scopes.size(); i-- > 0;)
+        {
+            if (m_scopes[i].count(name))
+                return i;
+        }
+        return 0;
+    }
+
+    Symbol &resolve(const std::string &name, int line)
+    {
+        Symbol *symbol = lookup(name);
+        if (!symbol)
+        {
+            throw semanticError(line, "Undefined variable '" + name + "'");
+        }
+        if (symbol->topLevel && (m_currentFunction || !m_reached.count(symbol->topLevel)))
+        {
+            m_changed = m_changed || !symbol->topLevel->global;
+            symbol->topLevel->global = true;
+        }
+        return *symbol;
+    }
+
+    // Symbol for a declaration; fixes the type of non-num declarations and
+    // registers nums for defaulting.
+    Symbol declare(AST::VarDeclStmt &varDecl)
+    {
+        bool inferred = varDecl.type == "num";
+        if (!inferred)
+        {
+            varDecl.varType = declaredType(varDecl.type);
+        }
+        else
+        {
+            m_numVars.insert(&varDecl);
+        }
+        Symbol symbol{&varDecl.varType, inferred};
+        if (varDecl.varType == AST::Type::Chan)
+            varDecl.element = declaredElement(varDecl.type);
+        if (isHandle(varDecl.varType))
+            symbol.element = &varDecl.element;
+        return symbol;
+    }
+
+    void checkInitializer(AST::VarDeclStmt &varDecl)
+    {
+        Symbol symbol = declare(varDecl);
+        AST::Type type = analyzeExpr(*varDecl.initializer);
+        if (!symbol.inferred && !assignable(varDecl.varType, type))
+        {
+            throw semanticError(varDecl.line, "Cannot initialize " + Sema::typeName(varDecl.varType) + " '" +
+                                                  varDecl.name + "' with a " + Sema::typeName(type) + " value");
+        }
+        if (varDecl.varType == AST::Type::View)
+            checkViewed(*varDecl.initializer, varDecl.line);
+        store(symbol, type, varDecl.initializer->range, varDecl.line, varDecl.name);
+        storeElement(symbol, *varDecl.initializer, varDecl.line, varDecl.name);
+    }
+
+    // What a str_view is made from must outlive it: a view, a variable or a
+    // literal, but not a str computed on the spot.
+    void checkViewed(const AST::Expr &text, int line)
+    {
+        if (text.type != AST::Type::Str || dynamic_cast<const AST::IdentifierExpr *>(&text))
+            return;
+        auto literal = dynamic_cast<const AST::LiteralExpr *>(&text);
+        if (literal && literal->type == TokenType::STRING_LIT)
+            return;
+        throw semanticError(line, "A str_view cannot look into a str computed on the spot; store that in a "
+                                  "str variable first");
+    }
+
+    // The innermost scope that a view of `text` depends on. A for-in
+    // variable is declared in its loop's scope, so a line of lines() or a
+    // piece of split() lasts only as long as the loop.
+    size_t lifetime(const AST::Expr &text) const
+    {
+        if (auto ident = dynamic_cast<const AST::IdentifierExpr *>(&text))
+            return scopeOf(ident->name);
+        auto call = dynamic_cast<const AST::CallExpr *>(&text);
+        if (call && call->type == AST::Type::View)
+            return lifetime(*call->args[0]); // substr
+        return 0;
+    }
+
+    // A view stored in `name` must not look into anything that goes away
+    // before `name` does.
+    void checkOutlived(const AST::Expr &text, const std::string &name, int line)
+    {
+        if (lifetime(text) > scopeOf(name))
+        {
+            throw semanticError(line, "str_view '" + name + "' would outlive what it looks into; make it a str "
+                                      "to keep a copy");
+        }
+    }
+
+    // The str variables that a view or gen made from `expr` looks into.
+    std::vector<const AST::Type *> sources(const AST::Expr &expr)
+    {
+        std::vector<const AST::Type *> found;
+        if (auto ident = dynamic_cast<const AST::IdentifierExpr *>(&expr))
+        {
+            if (Symbol *symbol = lookup(ident->name))
+            {
+                if (*symbol->type == AST::Type::Str)
+                    found.push_back(symbol->type);
+                else
+                    found = symbol->views;
+            }
+        }
+        else if (auto call = dynamic_cast<const AST::CallExpr *>(&expr))
+        {
+            for (size_t i = 0; i < call->args.size(); ++i)
+            {
+                bool viewed = call->target ? i < call->target->paramTypes.size() &&
+                                                 call->target->paramTypes[i] == AST::Type::View
+                                           : i == 0 && (call->callee == "substr" || call->callee == "split");
+                if (!viewed)
+                    continue;
+                auto more = sources(*call->args[i]);
+                found.insert(found.end(), more.begin(), more.end());
+            }
+        }
+        return found;
+    }
+
+    // Records what a view or gen stored in `symbol` looks into.
+    void lookInto(Symbol &symbol, const AST::Expr &value)
+    {
+        if (*symbol.type != AST::Type::View && *symbol.type != AST::Type::Gen)
+            return;
+        auto more = sources(value);
+        symbol.views.insert(symbol.views.end(), more.begin(), more.end());
+    }
+
+    // Changing a str moves or frees its characters, so it cannot change while
+    // a view or gen in scope may look into it.
+    void checkUnviewed(const Symbol &text, const std::string &name, int line)
+    {
+        for (const auto &scope : m_scopes)
+        {
+            for (const auto &[viewer, symbol] : scope)
+            {
+                if (std::find(symbol.views.begin(), symbol.views.end(), text.type) != symbol.views.end())
+                {
+                    throw semanticError(line, "Cannot change str '" + name + "' while " + typeName(*symbol.type) +
+                                                  " '" + viewer + "' looks into it");
+                }
+            }
+        }
+    }
+
+    void analyzeStmt(AST::Stmt &stmt)
+    {
+        if (auto varDecl = dynamic_cast<AST::VarDeclStmt *>(&stmt))
+        {
+            if (varDecl->initializer)
+            {
+                checkInitializer(*varDecl);
+            }
+            auto [declared, added] = m_scopes.back().emplace(varDecl->name, declare(*varDecl));
+            if (!added)
+            {
+                throw semanticError(varDecl->line, "Variable '" + varDecl->name + "' is already declared in this scope");
+            }
+            if (varDecl->initializer)
+                lookInto(declared->second, *varDecl->initializer);
+        }
+        else if (auto exprStmt = dynamic_cast<AST::ExprStmt *>(&stmt))
+        {
+            analyzeExpr(*exprStmt->expr);
+        }
+        else if (auto block = dynamic_cast<AST::BlockStmt *>(&stmt))
+        {
+            m_scopes.emplace_back();
+            for (auto &s : block->statements)
+            {
+                analyzeStmt(*s);
+            }
+            m_scopes.pop_back();
+        }
+        else if (auto ifStmt = dynamic_cast<AST::IfStmt *>(&stmt))
+        {
+            analyzeExpr(*ifStmt->condition);
+            analyzeScoped(*ifStmt->thenBranch);
+            if (ifStmt->elseBranch)
+                analyzeScoped(*ifStmt->elseBranch);
+        }
+        else if (auto forStmt = dynamic_cast<AST::ForStmt *>(&stmt))
+        {
+            if (forStmt->pfor)
+                checkReductions(*forStmt);
+            m_scopes.emplace_back();
+            if (forStmt->initializer)
+                analyzeStmt(*forStmt->initializer);
+            if (forStmt->condition)
+                analyzeExpr(*forStmt->condition);
+            Counter counter;
+            const Counter *outer = m_counter;
+            if (forStmt->increment && counts(forStmt->condition.get(), *forStmt->increment, *forStmt->body, counter))
+                m_counter = &counter;
+            m_loops.push_back({m_counter != outer ? trips(counter) : std::numeric_limits<double>::infinity(),
+                               m_scopes.size()});
+            if (forStmt->increment)
+                analyzeExpr(*forStmt->increment);
+            if (forStmt->pfor)
+                analyzeParallelBody(*forStmt);
+            else
+                analyzeLoopBody(*forStmt->body);
+            m_loops.pop_back();
+            m_counter = outer;
+            m_scopes.pop_back();
+        }
+        else if (auto forIn = dynamic_cast<AST::ForInStmt *>(&stmt))
+        {
+            analyzeForIn(*forIn);
+        }
+        else if (auto whileStmt = dynamic_cast<AST::WhileStmt *>(&stmt))
+        {
+            analyzeExpr(*whileStmt->condition);
+            Counter counter;
+            const Counter *outer = m_counter;
+            if (counts(*whileStmt, counter))
+                m_counter = &counter;
+            // a continue can skip the step
+            m_loops.push_back({m_counter != outer && !continues(*whileStmt->body)
+                                   ? trips(counter)
+                                   : std::numeric_limits<double>::infinity(),
+                               m_scopes.size()});
+            analyzeLoopBody(*whileStmt->body);
+            m_loops.pop_back();
+            m_counter = outer;
+        }
+        else if (dynamic_cast<AST::BreakStmt *>(&stmt))
+        {
+            checkInLoop(stmt.line, "break");
+            if (m_loopDepth == m_parallelDepth)
+            {
+                throw semanticError(stmt.line, "'break' cannot leave a pfor loop");
+            }
+        }
+        else if (dynamic_cast<AST::ContinueStmt *>(&stmt))
+        {
+            checkInLoop(stmt.line, "continue");
+        }
+        else if (auto ret = dynamic_cast<AST::ReturnStmt *>(&stmt))
+        {
+            if (!m_currentFunction)
+            {
+                throw semanticError(ret->line, "'return' outside of a function");
+            }
+            if (m_parallelDepth > 0)
+            {
+                throw semanticError(ret->line, "'return' inside a pfor loop");
+            }
+            if (ret->value && m_currentFunction->generator)
+            {
+                throw semanticError(ret->line, "Generator '" + m_currentFunction->name +
+                                                   "' cannot return a value; 'yield' it");
+            }
+            if (ret->value)
+            {
+                AST::Type type = analyzeExpr(*ret->value);
+                if (isHandle(type))
+                {
+                    throw semanticError(ret->line, "Functions cannot return a " + typeName(type));
+                }
+                if (type == AST::Type::View)
+                    type = AST::Type::Str; // a copy, which outlives what it was part of
+                merge(m_currentFunction->returnType, type, ret->value->range, ret->line,
+                      "Return value of '" + m_currentFunction->name + "'");
+            }
+        }
+        else if (auto func = dynamic_cast<AST::FunctionStmt *>(&stmt))
+        {
+            throw semanticError(func->line, "Functions can only be defined at the top level");
+        }
+    }
+
+    // A branch or loop body gets its own scope even when it is a single
+    // statement rather than a block.
+    void analyzeScoped(AST::Stmt &stmt)
+    {
+        m_scopes.emplace_back();
+        analyzeStmt(stmt);
+        m_scopes.pop_back();
+    }
+
+    void analyzeLoopBody(AST::Stmt &body)
+    {
+        m_loopDepth++;
+        analyzeScoped(body);
+        m_loopDepth--;
+    }
+
+    // A while loop whose body steps a counter, at its top level.
+    bool counts(const AST::WhileStmt &loop, Counter &counter)
+    {
+        auto block = dynamic_cast<const AST::BlockStmt *>(loop.body.get());
+        if (!block)
+            return false;
+        for (const auto &stmt : block->statements)
+        {
+            auto exprStmt = dynamic_cast<const AST::ExprStmt *>(stmt.get());
+            if (exprStmt && counts(loop.condition.get(), *exprStmt->expr, *loop.body, counter))
+                return true;
+        }
+        return false;
+    }
+
+    // Whether `step` (i++, i += k or i = i + k, or down) moves an inferred
+    // local towards the bound `condition` checks it against, with nothing
+    // else in `body` changing it; fills in `counter` if so.
+    bool counts(const AST::Expr *condition, const AST::Expr &step, const AST::Stmt &body, Counter &counter)
+    {
+        const AST::IdentifierExpr *target = nullptr;
+        const AST::IdentifierExpr *operand = nullptr;
+        bool up = false;
+        if (auto unary = dynamic_cast<const AST::UnaryExpr *>(&step))
+        {
+            if (unary->op != TokenType::PLUS_PLUS && unary->op != TokenType::MINUS_MINUS)
+                return false;
+            target = operand = dynamic_cast<const AST::IdentifierExpr *>(unary->right.get());
+            up = unary->op == TokenType::PLUS_PLUS;
+        }
+        else if (auto binary = dynamic_cast<const AST::BinaryExpr *>(&step))
+        {
+            target = operand = dynamic_cast<const AST::IdentifierExpr *>(binary->left.get());
+            const AST::Expr *amount = binary->right.get();
+            TokenType op = binary->op == TokenType::PLUS_EQ    ? TokenType::PLUS
+                           : binary->op == TokenType::MINUS_EQ ? TokenType::MINUS
+                                                               : TokenType::UNKNOWN;
+            auto sum = dynamic_cast<const AST::BinaryExpr *>(amount);
+            if (binary->op == TokenType::ASSIGN && sum)
+            {
+                operand = dynamic_cast<const AST::IdentifierExpr *>(sum->left.get());
+                amount = sum->right.get();
+                op = sum->op;
+            }
+            auto literal = dynamic_cast<const AST::LiteralExpr *>(amount);
+            if ((op != TokenType::PLUS && op != TokenType::MINUS) || !literal ||
+                literal->type != TokenType::NUMBER || literal->value.find('.') != std::string::npos ||
+                literal->value.find_first_not_of('0') == std::string::npos)
+                return false;
+            up = op == TokenType::PLUS;
+        }
+        if (!target || !operand || operand->name != target->name)
+            return false;
+        Symbol *symbol = lookup(target->name);
+        if (!symbol || !symbol->inferred || (symbol->topLevel && symbol->topLevel->global))
+            return false;
+
+        auto check = dynamic_cast<const AST::BinaryExpr *>(condition);
+        auto isTarget = [&target](const AST::Expr &expr)
+        {
+            auto ident = dynamic_cast<const AST::IdentifierExpr *>(&expr);
+            return ident && ident->name == target->name;
+        };
+        if (!check)
+            return false;
+        TokenType op = TokenType::UNKNOWN;
+        const AST::Expr *bound = nullptr;
+        if (isTarget(*check->left))
+        {
+            op = check->op;
+            bound = check->right.get();
+        }
+        else if (isTarget(*check->right))
+        {
+            op = check->op == TokenType::LT      ? TokenType::GT
+                 : check->op == TokenType::GT    ? TokenType::LT
+                 : check->op == TokenType::LT_EQ ? TokenType::GT_EQ
+                 : check->op == TokenType::GT_EQ ? TokenType::LT_EQ
+                                                 : TokenType::UNKNOWN;
+            bound = check->left.get();
+        }
+        bool towards = up ? op == TokenType::LT || op == TokenType::LT_EQ
+                          : op == TokenType::GT || op == TokenType::GT_EQ;
+        if (!towards || changes(*check, target->name, &step) || changes(body, target->name, &step))
+            return false;
+        counter = {operand, bound, op};
+        return true;
+    }
+
+    // Whether `stmt` has a continue for the loop around it.
+    static bool continues(const AST::Stmt &stmt)
+    {
+        if (dynamic_cast<const AST::ContinueStmt *>(&stmt))
+            return true;
+        if (auto block = dynamic_cast<const AST::BlockStmt *>(&stmt))
+            return std::any_of(block->statements.begin(), block->statements.end(),
+                               [](const AST::StmtPtr &s) { return continues(*s); });
+        if (auto ifStmt = dynamic_cast<const AST::IfStmt *>(&stmt))
+            return continues(*ifStmt->thenBranch) || (ifStmt->elseBranch && continues(*ifStmt->elseBranch));
+        return false;
+    }
+
+    // Whether `stmt` may store into `name`, other than by `step`.
+    static bool changes(const AST::Stmt &stmt, const std::string &name, const AST::Expr *step)
+    {
+        auto inExpr = [&](const AST::ExprPtr &expr)
+        { return expr && changes(*expr, name, step); };
+        auto inStmt = [&](const AST::StmtPtr &s)
+        { return s && changes(*s, name, step); };
+
+        if (auto varDecl = dynamic_cast<const AST::VarDeclStmt *>(&stmt))
+            return inExpr(varDecl->initializer);
+        if (auto exprStmt = dynamic_cast<const AST::ExprStmt *>(&stmt))
+            return inExpr(exprStmt->expr);
+        if (auto block = dynamic_cast<const AST::BlockStmt *>(&stmt))
+            return std::any_of(block->statements.begin(), block->statements.end(), inStmt);
+        if (auto ifStmt = dynamic_cast<const AST::IfStmt *>(&stmt))
+            return inExpr(ifStmt->condition) || inStmt(ifStmt->thenBranch) || inStmt(ifStmt->elseBranch);
+        if (auto whileStmt = dynamic_cast<const AST::WhileStmt *>(&stmt))
+            return inExpr(whileStmt->condition) || inStmt(whileStmt->body);
+        if (auto forStmt = dynamic_cast<const AST::ForStmt *>(&stmt))
+            return inStmt(forStmt->initializer) || inExpr(forStmt->condition) || inExpr(forStmt->increment) ||
+                   inStmt(forStmt->body);
+        if (auto forIn = dynamic_cast<const AST::ForInStmt *>(&stmt))
+            return inExpr(forIn->iterable) || inStmt(forIn->body);
+        if (auto ret = dynamic_cast<const AST::ReturnStmt *>(&stmt))
+            return inExpr(ret->value);
+        return false;
+    }
+
+    static bool changes(const AST::Expr &expr, const std::string &name, const AST::Expr *step)
+    {
+        if (&expr == step)
+            return false;
+        auto names = [&name](const AST::ExprPtr &target)
+        {
+            auto ident = dynamic_cast<const AST::IdentifierExpr *>(target.get());
+            return ident && ident->name == name;
+        };
+
+        if (auto unary = dynamic_cast<const AST::UnaryExpr *>(&expr))
+        {
+            if ((unary->op == TokenType::PLUS_PLUS || unary->op == TokenType::MINUS_MINUS) && names(unary->right))
+                return true;
+            return changes(*unary->right, name, step);
+        }
+        if (auto binary = dynamic_cast<const AST::BinaryExpr *>(&expr))
+        {
+            bool stores = binary->op == TokenType::ASSIGN || binary->op == TokenType::PLUS_EQ ||
+                          binary->op == TokenType::MINUS_EQ || binary->op == TokenType::ASTER_EQ ||
+                          binary->op == TokenType::FSLASH_EQ || binary->op == TokenType::PERCENT_EQ;
+            if (stores && names(binary->left))
+                return true;
+            return changes(*binary->left, name, step) || changes(*binary->right, name, step);
+        }
+        if (auto call = dynamic_cast<const AST::CallExpr *>(&expr))
+        {
+            return std::any_of(call->args.begin(), call->args.end(),
+                               [&](const AST::ExprPtr &arg)
+                               { return changes(*arg, name, step); });
+        }
+        if (auto index = dynamic_cast<const AST::IndexExpr *>(&expr))
+            return changes(*index->array, name, step) || changes(*index->index, name, step);
+        return false;
+    }
+
+    // The loop variable is an element: a num of an arr, a value of a gen.
+    void analyzeForIn(AST::ForInStmt &loop)
+    {
+        AST::Type iterable = analyzeExpr(*loop.iterable);
+        AST::Type element = AST::Type::Unknown;
+        if (iterable == AST::Type::Arr)
+        {
+            element = AST::Type::Num;
+        }
+        else if (iterable == AST::Type::Gen)
+        {
+            element = loop.iterable->element;
+            // taking a value moves a gen on
+            if (auto ident = dynamic_cast<AST::IdentifierExpr *>(loop.iterable.get()))
+                checkUnshared(ident->name, loop.line);
+        }
+        else if (iterable != AST::Type::Unknown)
+        {
+            throw semanticError(loop.line, "Cannot iterate over a " + typeName(iterable) + " value");
+        }
+        if (element != AST::Type::Unknown && element != loop.varType)
+        {
+            loop.varType = element;
+            m_changed = true;
+        }
+        if (integral(element))
+        {
+            auto call = dynamic_cast<const AST::CallExpr *>(loop.iterable.get());
+            widen(loop.varType, call && call->target ? knownRange(call->target->yieldType) : AST::Range{});
+        }
+
+        m_scopes.emplace_back();
+        Symbol &variable = m_scopes.back().emplace(loop.name, Symbol{&loop.varType, false}).first->second;
+        if (loop.varType == AST::Type::View)
+            variable.views = sources(*loop.iterable);
+        m_loops.push_back({std::numeric_limits<double>::infinity(), m_scopes.size()});
+        analyzeLoopBody(*loop.body);
+        m_loops.pop_back();
+        m_scopes.pop_back();
+    }
+
+    // pfor (i = start; i < bound; i++ or i += 1), with integer i and bound.
+    void analyzeParallelBody(AST::ForStmt &loop)
+    {
+        auto init = dynamic_cast<AST::VarDeclStmt *>(loop.initializer.get());
+        auto condition = dynamic_cast<AST::BinaryExpr *>(loop.condition.get());
+        auto isCounter = [init](const AST::Expr *expr)
+        {
+            auto ident = dynamic_cast<const AST::IdentifierExpr *>(expr);
+            return ident && ident->name == init->name;
+        };
+        auto unary = dynamic_cast<AST::UnaryExpr *>(loop.increment.get());
+        auto binary = dynamic_cast<AST::BinaryExpr *>(loop.increment.get());
+        auto step = binary ? dynamic_cast<AST::LiteralExpr *>(binary->right.get()) : nullptr;
+        bool stepsByOne = (unary && unary->op == TokenType::PLUS_PLUS && isCounter(unary->right.get())) ||
+                          (binary && binary->op == TokenType::PLUS_EQ && isCounter(binary->left.get()) &&
+                           step && step->value == "1");
+
+        if (!init || !init->initializer || !condition || condition->op != TokenType::LT ||
+            !isCounter(condition->left.get()) || !stepsByOne)
+        {
+            throw semanticError(loop.line, "pfor must have the form 'pfor (num i = start; i < end; i++)'");
+        }
+        if (!integerOrUnknown(init->varType))
+        {
+            throw semanticError(loop.line, "pfor variable '" + init->name + "' must be an integer, not " +
+                                               typeName(init->varType));
+        }
+        if (!integerOrUnknown(condition->right->type))
+        {
+            throw semanticError(loop.line, "pfor bound must be an integer, not " + typeName(condition->right->type));
+        }
+
+        int outerDepth = m_parallelDepth;
+        const AST::ForStmt *outerLoop = m_parallelLoop;
+        size_t outerScope = m_parallelScope;
+        m_parallelDepth = m_loopDepth + 1;
+        m_parallelLoop = &loop;
+        m_parallelScope = m_scopes.size();
+        analyzeLoopBody(*loop.body);
+        m_parallelDepth = outerDepth;
+        m_parallelLoop = outerLoop;
+        m_parallelScope = outerScope;
+    }
+
+    static bool integerOrUnknown(AST::Type type)
+    {
+        return type == AST::Type::I32 || type == AST::Type::Int || type == AST::Type::Unknown;
+    }
+
+    // Reduction variables are numbers, and & | ^ need integers. The loop
+    // writes them back at the end.
+    void checkReductions(const AST::ForStmt &loop)
+    {
+        std::unordered_set<std::string> seen;
+        for (const auto &[op, name] : loop.reductions)
+        {
+            if (!seen.insert(name).second)
+            {
+                throw semanticError(loop.line, "'" + name + "' is reduced twice");
+            }
+            checkUnshared(name, loop.line);
+            AST::Type type = *resolve(name, loop.line).type;
+            bool bitwise = op != "+" && op != "*";
+            if (type != AST::Type::Unknown &&
+                (numericRank(type) < 2 || (bitwise && !integerOrUnknown(type))))
+            {
+                throw semanticError(loop.line, "Cannot reduce " + typeName(type) + " '" + name + "' with '" + op + "'");
+            }
+        }
+    }
+
+    // Inside a pfor body only the body's own variables and the loop's
+    // reduction variables may change; anything else, the loop variable
+    // included, is shared by iterations running at the same time.
+    void checkUnshared(const std::string &name, int line)
+    {
+        if (!m_parallelLoop)
+            return;
+        for (size_t depth = m_scopes.size(); depth-- > m_parallelScope;)
+        {
+            if (m_scopes[depth].count(name))
+                return;
+        }
+        for (const auto &reduction : m_parallelLoop->reductions)
+        {
+            if (reduction.second == name)
+                return;
+        }
+        throw semanticError(line, "Cannot change '" + name + "' inside a pfor loop unless it is reduced");
+    }
+
+    void checkInLoop(int line, const std::string &keyword)
+    {
+        if (m_loopDepth == 0)
+        {
+            throw semanticError(line, "'" + keyword + "' outside of a loop");
+        }
+    }
+
+    AST::Type analyzeExpr(AST::Expr &expr)
+    {
+        expr.range = {};
+        expr.type = exprType(expr);
+        if (expr.type == AST::Type::Bool)
+            expr.range = {0, 1};
+        return expr.type;
+    }
+
+    AST::Type exprType(AST::Expr &expr)
+    {
+        if (auto literal = dynamic_cast<AST::LiteralExpr *>(&expr))
+        {
+            switch (literal->type)
+            {
+            case TokenType::STRING_LIT:
+                return AST::Type::Str;
+            case TokenType::NUMBER:
+                return numberType(*literal);
+            case TokenType::TRUE:
+            case TokenType::FALSE:
+                return AST::Type::Bool;
+            default:
+                return AST::Type::Unknown;
+            }
+        }
+
+        if (auto ident = dynamic_cast<AST::IdentifierExpr *>(&expr))
+        {
+            Symbol &symbol = resolve(ident->name, ident->line);
+            if (symbol.element)
+                ident->element = *symbol.element;
+            if (m_counter && ident == m_counter->operand)
+                return counterType(*ident, symbol);
+            ident->range = rangeOf(symbol);
+            return *symbol.type;
+        }
+
+        if (auto unary = dynamic_cast<AST::UnaryExpr *>(&expr))
+        {
+            AST::Type operand = analyzeExpr(*unary->right);
+            rejectHandle(operand, unary->line, to_string(unary->op));
+            switch (unary->op)
+            {
+            case TokenType::NOT:
+                return AST::Type::Bool;
+            case TokenType::PLUS_PLUS:
+            case TokenType::MINUS_MINUS:
+            {
+                auto target = dynamic_cast<AST::IdentifierExpr *>(unary->right.get());
+                if (!target)
+                {
+                    throw semanticError(unary->line, "Operand of '" + to_string(unary->op) + "' must be a variable");
+                }
+                checkUnshared(target->name, unary->line);
+                requireNumeric(operand, unary->line, to_string(unary->op));
+                return step(*unary, operand);
+            }
+            case TokenType::BITWISE_NOT:
+                requireNumeric(operand, unary->line, to_string(unary->op));
+                if (operand == AST::Type::Unknown && !m_defaulted)
+                    return AST::Type::Unknown;
+                unary->range = bitwise(operand, operand, unary->right->range, unary->right->range);
+                return AST::Type::Int;
+            default:
+                requireNumeric(operand, unary->line, to_string(unary->op));
+                unary->range = {-unary->right->range.high, -unary->right->range.low, unary->right->range.fixed};
+                return operand == AST::Type::Bool ? AST::Type::Int : operand;
+            }
+        }
+
+        if (auto binary = dynamic_cast<AST::BinaryExpr *>(&expr))
+        {
+            return binaryType(*binary);
+        }
+
+        if (auto call = dynamic_cast<AST::CallExpr *>(&expr))
+        {
+            return callType(*call);
+        }
+
+        if (auto index = dynamic_cast<AST::IndexExpr *>(&expr))
+        {
+            AST::Type array = analyzeExpr(*index->array);
+            if (array != AST::Type::Arr && array != AST::Type::Unknown)
+            {
+                throw semanticError(index->line, "Cannot index a " + typeName(array) + " value");
+            }
+            requireNumeric(analyzeExpr(*index->index), index->line, "[]");
+            return AST::Type::Num;
+        }
+
+        return AST::Type::Unknown;
+    }
+
+    // An integer literal is an integer if an int64_t holds it; a longer one
+    // is written as the double it stands for.
+    static AST::Type numberType(AST::LiteralExpr &literal)
+    {
+        if (literal.value.find('.') != std::string::npos)
+            return AST::Type::Num;
+        int64_t value;
+        const char *end = literal.value.data() + literal.value.size();
+        auto [ptr, error] = std::from_chars(literal.value.data(), end, value);
+        if (error != std::errc() || ptr != end)
+        {
+            literal.value += ".0";
+            return AST::Type::Num;
+        }
+        literal.range = {static_cast<double>(value), static_cast<double>(value)};
+        return AST::Type::Int;
+    }
+
+    // The counter as its step reads it, just checked against the bound;
+    // unknown until the bound's type is.
+    AST::Type counterType(AST::IdentifierExpr &ident, const Symbol &symbol)
+    {
+        const AST::Expr &bound = *m_counter->bound;
+        if (bound.type == AST::Type::Unknown)
+            return AST::Type::Unknown;
+
+        ident.range = within(*m_counter, rangeOf(symbol));
+        return *symbol.type;
+    }
+
+    // The range of a counter while its loop's condition holds.
+    AST::Range within(const Counter &counter, AST::Range range) const
+    {
+        const AST::Expr &bound = *counter.bound;
+        switch (counter.op)
+        {
+        case TokenType::LT:
+            range.high = std::ceil(bound.range.high) - 1;
+            break;
+        case TokenType::LT_EQ:
+            range.high = std::floor(bound.range.high);
+            break;
+        case TokenType::GT:
+            range.low = std::floor(bound.range.low) + 1;
+            break;
+        default:
+            range.low = std::ceil(bound.range.low);
+            break;
+        }
+        // counting to a declared i64 cannot overflow either
+        range.fixed = range.fixed || (bound.range.fixed && !exact(range));
+        return range;
+    }
+
+    // At most how often the body of a loop with `counter` runs each time the
+    // loop is reached: the counter is at a new value within its bound every
+    // time.
+    double trips(const Counter &counter)
+    {
+        if (counter.bound->type == AST::Type::Unknown)
+            return std::numeric_limits<double>::infinity();
+        AST::Range range = within(counter, rangeOf(*lookup(counter.operand->name)));
+        return std::max(range.high - range.low + 1, 0.0);
+    }
+
+    // ++ and -- store into their operand like `x = x + 1`.
+    AST::Type step(AST::UnaryExpr &unary, AST::Type operand)
+    {
+        auto &target = static_cast<AST::IdentifierExpr &>(*unary.right);
+        TokenType op = unary.op == TokenType::PLUS_PLUS ? TokenType::PLUS : TokenType::MINUS;
+        AST::Type type = arithmetic(op, operand, AST::Type::Int, target.range, {1, 1}, unary.range);
+        Symbol &symbol = resolve(target.name, unary.line);
+        AST::Range step = op == TokenType::PLUS ? AST::Range{1, 1} : AST::Range{-1, -1};
+        if (!accumulate(symbol, type, unary, step, unary.range, unary.line, target.name))
+            store(symbol, type, unary.range, unary.line, target.name);
+        return *symbol.type;
+    }
+
+    static TokenType compoundOperator(TokenType op)
+    {
+        switch (op)
+        {
+        case TokenType::PLUS_EQ:
+            return TokenType::PLUS;
+        case TokenType::MINUS_EQ:
+            return TokenType::MINUS;
+        case TokenType::ASTER_EQ:
+            return TokenType::ASTER;
+        default:
+            return TokenType::PERCENT;
+        }
+    }
+
+    void requireNumeric(AST::Type type, int line, const std::string &op)
+    {
+        if (isText(type) || type == AST::Type::Arr || type == AST::Type::Void)
+        {
+            throw semanticError(line, "Operator '" + op + "' cannot be applied to " + typeName(type));
+        }
+        rejectHandle(type, line, op);
+    }
+
+    void rejectHandle(AST::Type type, int line, const std::string &op)
+    {
+        if (isHandle(type))
+        {
+            throw semanticError(line, "Operator '" + op + "' cannot be applied to " + typeName(type));
+        }
+    }
+
+    AST::Type binaryType(AST::BinaryExpr &binary)
+    {
+        AST::Type left = analyzeExpr(*binary.left);
+        AST::Type right = isRead(*binary.right) ? readType(binary) : analyzeExpr(*binary.right);
+        std::string op = to_string(binary.op);
+        if (binary.op != TokenType::ASSIGN)
+        {
+            rejectHandle(left, binary.line, op);
+            rejectHandle(right, binary.line, op);
+        }
+
+        switch (binary.op)
+        {
+        case TokenType::ASSIGN:
+            binary.range = binary.right->range;
+            return assign(binary, right);
+
+        case TokenType::PLUS_EQ:
+            if (left == AST::Type::Str && concatenable(right))
+                return assign(binary, left);
+            [[fallthrough]];
+        case TokenType::MINUS_EQ:
+        case TokenType::ASTER_EQ:
+        case TokenType::PERCENT_EQ:
+            requireNumeric(left, binary.line, op);
+            requireNumeric(right, binary.line, op);
+            return assign(binary, arithmetic(compoundOperator(binary.op), left, right, binary.left->range,
+                                             binary.right->range, binary.range));
+
+        case TokenType::FSLASH_EQ:
+            requireNumeric(left, binary.line, op);
+            requireNumeric(right, binary.line, op);
+            return assign(binary, AST::Type::Num);
+
+        case TokenType::PLUS:
+            if (isText(left) || isText(right))
+            {
+                if (!concatenable(left) || !concatenable(right))
+                {
+                    throw semanticError(binary.line, "Cannot add " + typeName(left) + " and " + typeName(right));
+                }
+                return AST::Type::Str;
+            }
+            [[fallthrough]];
+        case TokenType::MINUS:
+        case TokenType::ASTER:
+        case TokenType::PERCENT:
+            requireNumeric(left, binary.line, op);
+            requireNumeric(right, binary.line, op);
+            return arithmetic(binary.op, left, right, binary.left->range, binary.right->range, binary.range);
+
+        // division is always real division: 7 / 2 == 3.5
+        case TokenType::FSLASH:
+            requireNumeric(left, binary.line, op);
+            requireNumeric(right, binary.line, op);
+            return AST::Type::Num;
+
+        case TokenType::AND:
+        case TokenType::OR:
+        case TokenType::XOR:
+            requireNumeric(left, binary.line, op);
+            requireNumeric(right, binary.line, op);
+            if ((left == AST::Type::Unknown || right == AST::Type::Unknown) && !m_defaulted)
+                return AST::Type::Unknown;
+            binary.range = bitwise(left, right, binary.left->range, binary.right->range);
+            return AST::Type::Int;
+
+        case TokenType::EQ_EQ:
+        case TokenType::BANG_EQ:
+            if (!assignable(left, right) && !assignable(right, left))
+            {
+                throw semanticError(binary.line, "Cannot compare " + typeName(left) + " and " + typeName(right));
+            }
+            return AST::Type::Bool;
+
+        case TokenType::LT:
+        case TokenType::GT:
+        case TokenType::LT_EQ:
+        case TokenType::GT_EQ:
+            if (isText(left) != isText(right) && left != AST::Type::Unknown && right != AST::Type::Unknown)
+            {
+                throw semanticError(binary.line, "Cannot compare " + typeName(left) + " and " + typeName(right));
+            }
+            return AST::Type::Bool;
+
+        case TokenType::LOGICAL_AND:
+        case TokenType::LOGICAL_OR:
+            return AST::Type::Bool;
+
+        case TokenType::STREAM_OUT:
+            return AST::Type::Void;
+
+        default:
+            return AST::Type::Unknown;
+        }
+    }
+
+    // Stores a value of `type` through an assignment; returns the type of
+    // its target.
+    AST::Type assign(AST::BinaryExpr &assignment, AST::Type type)
+    {
+        if (dynamic_cast<AST::IndexExpr *>(assignment.left.get()))
+        {
+            // array elements are num
+            requireNumeric(type, assignment.line, to_string(assignment.op));
+            return AST::Type::Num;
+        }
+        checkUnshared(targetName(assignment), assignment.line);
+        Symbol &symbol = target(assignment);
+        if (*symbol.type == AST::Type::View)
+        {
+            checkViewed(*assignment.right, assignment.line);
+            checkOutlived(*assignment.right, targetName(assignment), assignment.line);
+        }
+        if (*symbol.type == AST::Type::Str)
+            checkUnviewed(symbol, targetName(assignment), assignment.line);
+        lookInto(symbol, *assignment.right);
+        if (symbol.parameter >= 0)
+            m_currentFunction->paramsAssigned[symbol.parameter] = true;
+        AST::Range step;
+        if (!increment(assignment, step) ||
+            !accumulate(symbol, type, assignment, step, assignment.range, assignment.line, targetName(assignment)))
+            store(symbol, type, assignment.range, assignment.line, targetName(assignment));
+        storeElement(symbol, *assignment.right, assignment.line, targetName(assignment));
+        if (symbol.element)
+            assignment.element = *symbol.element;
+        return *symbol.type;
+    }
+
+    // Whether `assignment` adds `step` to its target: x = x + e, x = e + x,
+    // x = x - e, x += e or x -= e.
+    static bool increment(const AST::BinaryExpr &assignment, AST::Range &step)
+    {
+        auto isTarget = [&assignment](const AST::Expr &expr)
+        {
+            auto ident = dynamic_cast<const AST::IdentifierExpr *>(&expr);
+            return ident && ident->name == targetName(assignment);
+        };
+        const AST::Expr *amount = nullptr;
+        bool down = false;
+        if (assignment.op == TokenType::PLUS_EQ || assignment.op == TokenType::MINUS_EQ)
+        {
+            amount = assignment.right.get();
+            down = assignment.op == TokenType::MINUS_EQ;
+        }
+        else if (auto sum = dynamic_cast<const AST::BinaryExpr *>(assignment.right.get());
+                 sum && assignment.op == TokenType::ASSIGN)
+        {
+            if (sum->op == TokenType::PLUS || sum->op == TokenType::MINUS)
+                amount = isTarget(*sum->left) ? sum->right.get() : nullptr;
+            if (sum->op == TokenType::PLUS && !amount && isTarget(*sum->right))
+                amount = sum->left.get();
+            down = sum->op == TokenType::MINUS;
+        }
+        if (!amount)
+            return false;
+        step = down ? AST::Range{-amount->range.high, -amount->range.low} : amount->range;
+        return true;
+    }
+
+    // The target of an assignment that is not an array element.
+    Symbol &target(const AST::BinaryExpr &assignment)
+    {
+        return resolve(targetName(assignment), assignment.line);
+    }
+
+    static const std::string &targetName(const AST::BinaryExpr &assignment)
+    {
+        return static_cast<const AST::IdentifierExpr &>(*assignment.left).name;
+    }
+
+    AST::Type callType(AST::CallExpr &call)
+    {
+        std::vector<AST::Type> argTypes;
+        for (auto &arg : call.args)
+        {
+            argTypes.push_back(analyzeExpr(*arg));
+        }
+
+        auto it = m_functions.find(call.callee);
+        if (it == m_functions.end())
+        {
+            if (call.callee == "print")
+            {
+                if (isHandle(argTypes[0]))
+                {
+                    throw semanticError(call.line, "Cannot print a " + typeName(argTypes[0]));
+                }
+                return AST::Type::Void;
+            }
+            if (call.callee == "size")
+            {
+                call.range = {0, sizeLimit};
+                return AST::Type::Int;
+            }
+            if (call.callee == "array")
+                return AST::Type::Arr;
+            if (call.callee == "spawn" || call.callee == "await" || call.callee == "channel" ||
+                call.callee == "send" || call.callee == "receive")
+                return taskCallType(call, argTypes);
+            if (call.callee == "yield")
+                return yieldType(call, argTypes[0]);
+            if (call.callee == "input" || call.callee == "readLine" || call.callee == "readNum" ||
+                call.callee == "eof")
+                return inputType(call, argTypes);
+            if (call.callee == "readFile" || call.callee == "writeFile" || call.callee == "lines")
+                return fileType(call, argTypes);
+            if (call.callee == "substr" || call.callee == "find" || call.callee == "split")
+                return textType(call, argTypes);
+            if (call.callee == "f\"\"")
+                return interpolationType(call, argTypes);
+
+            // not ours: left to the C++ compiler (e.g. sqrt after @import math)
+            m_externalCalls = true;
+            return AST::Type::Unknown;
+        }
+
+        AST::FunctionStmt &func = *it->second;
+        call.target = &func;
+
+        if (argTypes.size() != func.params.size())
+        {
+            throw semanticError(call.line, "'" + func.name + "' expects " + std::to_string(func.params.size()) +
+                                               " arguments but got " + std::to_string(argTypes.size()));
+        }
+
+        for (size_t i = 0; i < argTypes.size(); ++i)
+        {
+            if (isHandle(argTypes[i]) && !isHandle(func.paramTypes[i]))
+            {
+                throw semanticError(call.line, "Parameter '" + func.params[i] + "' of '" + func.name +
+                                                   "' must be declared as " + typeName(argTypes[i]) +
+                                                   " to be passed one");
+            }
+            if (func.paramTypes[i] == AST::Type::Task || func.paramTypes[i] == AST::Type::Gen)
+            {
+                std::string kind = typeName(func.paramTypes[i]);
+                if (argTypes[i] != func.paramTypes[i] && argTypes[i] != AST::Type::Unknown)
+                {
+                    throw semanticError(call.line, "Cannot pass a " + typeName(argTypes[i]) + " value as " + kind +
+                                                       " parameter '" + func.params[i] + "' of '" + func.name + "'");
+                }
+                merge(func.paramElements[i], call.args[i]->element, call.line,
+                      "Element of " + kind + " parameter '" + func.params[i] + "' of '" + func.name + "'");
+            }
+            else if (func.paramTypes[i] == AST::Type::Chan)
+            {
+                AST::Type element = call.args[i]->element;
+                if ((argTypes[i] != AST::Type::Chan && argTypes[i] != AST::Type::Unknown) ||
+                    (element != AST::Type::Unknown && element != func.paramElements[i]))
+                {
+                    std::string given = argTypes[i] == AST::Type::Chan ? "chan<" + typeName(element) + ">"
+                                                                       : typeName(argTypes[i]);
+                    throw semanticError(call.line, "Cannot pass a " + given + " value as chan<" +
+                                                       typeName(func.paramElements[i]) + "> parameter '" +
+                                                       func.params[i] + "' of '" + func.name + "'");
+                }
+            }
+            else if (func.paramTypeNames[i] == "num")
+            {
+                merge(func.paramTypes[i], numType(argTypes[i]), call.args[i]->range, call.line,
+                      "Parameter '" + func.params[i] + "' of '" + func.name + "'");
+            }
+            else if (!assignable(func.paramTypes[i], argTypes[i]))
+            {
+                throw semanticError(call.line, "Cannot pass a " + typeName(argTypes[i]) + " value as " +
+                                                   typeName(func.paramTypes[i]) + " parameter '" + func.params[i] +
+                                                   "' of '" + func.name + "'");
+            }
+        }
+
+        if (func.generator)
+            call.element = func.yieldType;
+        call.range = knownRange(func.returnType);
+        return func.returnType;
+    }
+
+    // input(), readLine(), readNum() and eof().
+    AST::Type inputType(AST::CallExpr &call, const std::vector<AST::Type> &argTypes)
+    {
+        if (!argTypes.empty())
+        {
+            throw semanticError(call.line, "'" + call.callee + "' takes no arguments");
+        }
+        checkInput(call.line, call.callee);
+        if (call.callee == "readNum")
+            return AST::Type::Num;
+        if (call.callee == "eof")
+            return AST::Type::Bool;
+        return AST::Type::Str;
+    }
+
+    // readFile(path), writeFile(path, text) and lines(path).
+    AST::Type fileType(AST::CallExpr &call, const std::vector<AST::Type> &argTypes)
+    {
+        size_t expected = call.callee == "writeFile" ? 2 : 1;
+        if (argTypes.size() != expected)
+        {
+            throw semanticError(call.line, "'" + call.callee + "' expects " + std::to_string(expected) +
+                                               " argument" + (expected == 1 ? "" : "s") + " but got " +
+                                               std::to_string(argTypes.size()));
+        }
+        for (AST::Type type : argTypes)
+        {
+            if (!isText(type) && type != AST::Type::Unknown)
+            {
+                throw semanticError(call.line, "'" + call.callee + "' needs a str, not a " + typeName(type) +
+                                                   " value");
+            }
+        }
+
+        if (call.callee == "writeFile")
+            return AST::Type::Void;
+        if (call.callee == "readFile")
+            return AST::Type::Str;
+        call.element = AST::Type::View;
+        return AST::Type::Gen;
+    }
+
+    // substr(s, start[, length]), find(s, part[, from]) and split(s[, sep]).
+    AST::Type textType(AST::CallExpr &call, const std::vector<AST::Type> &argTypes)
+    {
+        size_t least = call.callee == "split" ? 1 : 2;
+        if (argTypes.size() < least || argTypes.size() > least + 1)
+        {
+            throw semanticError(call.line, "'" + call.callee + "' expects " + std::to_string(least) + " or " +
+                                               std::to_string(least + 1) + " arguments but got " +
+                                               std::to_string(argTypes.size()));
+        }
+        for (size_t i = 0; i < argTypes.size(); ++i)
+        {
+            bool text = i == 0 || call.callee == "split" || (call.callee == "find" && i == 1);
+            if (text && !isText(argTypes[i]) && argTypes[i] != AST::Type::Unknown)
+            {
+                throw semanticError(call.line, "'" + call.callee + "' needs a str, not a " +
+                                                   typeName(argTypes[i]) + " value");
+            }
+            if (!text)
+                requireNumeric(argTypes[i], call.line, call.callee);
+        }
+
+        if (call.callee == "find")
+        {
+            call.range = {-1, sizeLimit};
+            return AST::Type::Int;
+        }
+        checkViewed(*call.args[0], call.line);
+        if (call.callee == "substr")
+            return AST::Type::View;
+        call.element = AST::Type::View;
+        return AST::Type::Gen;
+    }
+
+    // f"...{expr}...", which the parser makes f""("...", expr, "...").
+    AST::Type interpolationType(const AST::CallExpr &call, const std::vector<AST::Type> &argTypes)
+    {
+        for (AST::Type type : argTypes)
+        {
+            if (!concatenable(type))
+                throw semanticError(call.line, "Cannot put a " + typeName(type) + " value into an f-string");
+        }
+        return AST::Type::Str;
+    }
+
+    // The value of `>> target`, which the parser makes `target = >>()`.
+    static bool isRead(const AST::Expr &expr)
+    {
+        auto call = dynamic_cast<const AST::CallExpr *>(&expr);
+        return call && call->callee == ">>";
+    }
+
+    // A read takes the type of its target; array elements and inferred nums
+    // take any number.
+    AST::Type readType(AST::BinaryExpr &read)
+    {
+        checkInput(read.line, ">>");
+        AST::Type type = AST::Type::Num;
+        if (!dynamic_cast<AST::IndexExpr *>(read.left.get()))
+        {
+            Symbol &symbol = target(read);
+            if (!symbol.inferred)
+                type = *symbol.type;
+            if (type == AST::Type::Str)
+                checkUnviewed(symbol, targetName(read), read.line);
+        }
+        if (type == AST::Type::Arr || type == AST::Type::View || isHandle(type))
+        {
+            throw semanticError(read.line, "Cannot read a " + typeName(type) + " value");
+        }
+        read.right->type = type;
+        return type;
+    }
+
+    void checkInput(int line, const std::string &what)
+    {
+        if (m_parallelDepth > 0)
+        {
+            throw semanticError(line, "'" + what + "' inside a pfor loop");
+        }
+    }
+
+    // yield value, inside a generator: widens what it yields.
+    AST::Type yieldType(AST::CallExpr &call, AST::Type type)
+    {
+        if (!m_currentFunction)
+        {
+            throw semanticError(call.line, "'yield' outside of a function");
+        }
+        if (m_parallelDepth > 0)
+        {
+            throw semanticError(call.line, "'yield' inside a pfor loop");
+        }
+        if (type == AST::Type::Void || isHandle(type))
+        {
+            throw semanticError(call.line, "Cannot yield a " + typeName(type) + " value");
+        }
+        merge(m_currentFunction->yieldType, type, call.args[0]->range, call.line,
+              "Values of generator '" + m_currentFunction->name + "'");
+        return AST::Type::Void;
+    }
+
+    // spawn f(x), await h, channel(n), send(c, value) and receive(c).
+    AST::Type taskCallType(AST::CallExpr &call, const std::vector<AST::Type> &argTypes)
+    {
+        size_t expected = call.callee == "send" ? 2 : 1;
+        if (argTypes.size() != expected)
+        {
+            throw semanticError(call.line, "'" + call.callee + "' expects " + std::to_string(expected) +
+                                               " argument" + (expected == 1 ? "" : "s") + " but got " +
+                                               std::to_string(argTypes.size()));
+        }
+
+        if (call.callee == "spawn")
+        {
+            auto target = static_cast<AST::CallExpr *>(call.args[0].get());
+            if (!target->target)
+            {
+                throw semanticError(call.line, "Can only spawn functions of this program, not '" +
+                                                   target->callee + "'");
+            }
+            if (target->target->generator)
+            {
+                throw semanticError(call.line, "Cannot spawn generator '" + target->callee +
+                                                   "'; spawn a function that iterates it");
+            }
+            for (size_t i = 0; i < target->target->params.size(); ++i)
+            {
+                if (target->target->paramTypes[i] == AST::Type::View)
+                {
+                    throw semanticError(call.line, "Cannot spawn '" + target->callee + "': its str_view parameter '" +
+                                                       target->target->params[i] +
+                                                       "' could outlive the str it looks into");
+                }
+            }
+            call.element = argTypes[0];
+            return AST::Type::Task;
+        }
+        if (call.callee == "channel")
+        {
+            requireNumeric(argTypes[0], call.line, "channel");
+            return AST::Type::Chan;
+        }
+
+        AST::Type handle = call.callee == "await" ? AST::Type::Task : AST::Type::Chan;
+        if (argTypes[0] != handle && argTypes[0] != AST::Type::Unknown)
+        {
+            throw semanticError(call.line, "'" + call.callee + "' needs a " + typeName(handle) + ", not a " +
+                                               typeName(argTypes[0]) + " value");
+        }
+        AST::Type element = call.args[0]->element;
+        if (argTypes[0] == AST::Type::Chan && element == AST::Type::Unknown)
+        {
+            throw semanticError(call.line, "'" + call.callee + "' needs a chan<T> variable or parameter, not a bare channel()");
+        }
+        if (call.callee == "receive")
+            call.range = declaredRange(element);
+        if (call.callee != "send")
+            return element;
+
+        if (!assignable(element, argTypes[1]) || isHandle(argTypes[1]))
+        {
+            throw semanticError(call.line, "Cannot send a " + typeName(argTypes[1]) + " value on a chan<" +
+                                               typeName(element) + ">");
+        }
+        return AST::Type::Void;
+    }
+};
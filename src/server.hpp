@@ -0,0 +1,471 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include "driver.hpp"
+#include "hash.hpp"
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+`gvoid serve`: a resident compiler listening on a Unix socket.
+
+Protocol, one request per connection:
+    client -> "compile <path>\n"  (or "run <path>\n")
+    server -> compiler diagnostics, if any, then a final status line
+              "ok <executable>" or "error <message>"
+
+For "run" the client executes the returned binary itself so the program
+keeps the client's terminal, stdin and environment.
+
+Each source file keeps its last content hash and executable; an unchanged
+file is answered from the cache without touching the lexer, parser or
+generator. Executables are stored by hash of the generated C++, so edits
+that do not change the output (comments, whitespace) reuse the existing
+binary too. A changed file is parsed and analyzed again in full: Sema infers
+types across the whole program, so no part of an old AST can be kept.
+
+The cache holds at most CACHE_BYTES of executables and the server remembers
+at most MAX_SOURCES files; past that the least recently used go first.
+
+The client runs whatever the server names, so the socket and the cache live
+in directories only the user can write: the XDG ones, or a directory in
+/tmp that must be ours and closed to everyone else.
+*/
+inline std::string environmentPath(const char *name)
+{
+    const char *value = std::getenv(name);
+    return value && *value ? value : "";
+}
+
+// For the socket and cache when no XDG_RUNTIME_DIR is set.
+inline std::string fallbackDirectory()
+{
+    return "/tmp/gvoid-" + std::to_string(getuid());
+}
+
+inline std::string defaultSocketPath()
+{
+    std::string runtimeDir = environmentPath("XDG_RUNTIME_DIR");
+    return (runtimeDir.empty() ? fallbackDirectory() : runtimeDir) + "/gvoid.sock";
+}
+
+inline std::string defaultCacheDirectory()
+{
+    std::string cacheHome = environmentPath("XDG_CACHE_HOME");
+    if (!cacheHome.empty())
+        return cacheHome + "/gvoid";
+    std::string home = environmentPath("HOME");
+    if (!home.empty())
+        return home + "/.cache/gvoid";
+    std::string runtimeDir = environmentPath("XDG_RUNTIME_DIR");
+    return (runtimeDir.empty() ? fallbackDirectory() : runtimeDir) + "/gvoid-cache";
+}
+
+// Creates `path` with mode 0700 if it is missing; false unless it is then a
+// real directory of ours that nobody else can write or read.
+inline bool privateDirectory(const std::string &path)
+{
+    if (mkdir(path.c_str(), 0700) != 0 && errno != EEXIST)
+        return false;
+    struct stat status;
+    return lstat(path.c_str(), &status) == 0 && S_ISDIR(status.st_mode) && status.st_uid == getuid() &&
+           (status.st_mode & 077) == 0;
+}
+
+// The directory of a socket in /tmp has to be private before it is used.
+inline bool checkSocketDirectory(const std::string &socketPath)
+{
+    std::string directory = std::filesystem::path(socketPath).parent_path().string();
+    if (directory != fallbackDirectory() || privateDirectory(directory))
+        return true;
+    std::cerr << directory << " is not a private directory of this user\n";
+    return false;
+}
+
+inline bool sendAll(int fd, const std::string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = write(fd, data.data() + sent, data.size() - sent);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+inline int connectTo(const std::string &socketPath)
+{
+    sockaddr_un addr{};
+    if (socketPath.size() >= sizeof(addr.sun_path))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, socketPath.c_str());
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+class CompileServer
+{
+public:
+    CompileServer(std::string socketPath, CompileOptions options)
+        : m_socketPath(std::move(socketPath)), m_options(std::move(options)) {}
+
+    int run()
+    {
+        namespace fs = std::filesystem;
+
+        std::error_code ec;
+        m_cacheDir = defaultCacheDirectory();
+        fs::create_directories(fs::path(m_cacheDir).parent_path(), ec);
+        if (!privateDirectory(m_cacheDir))
+        {
+            std::cerr << m_cacheDir << " is not a private directory of this user\n";
+            return 1;
+        }
+        if (!checkSocketDirectory(m_socketPath))
+            return 1;
+        loadCache();
+
+        std::signal(SIGPIPE, SIG_IGN);
+
+        sockaddr_un addr{};
+        if (m_socketPath.size() >= sizeof(addr.sun_path))
+        {
+            std::cerr << "Socket path too long: " << m_socketPath << "\n";
+            return 1;
+        }
+
+        int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0)
+        {
+            std::perror("socket");
+            return 1;
+        }
+
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, m_socketPath.c_str());
+        unlink(m_socketPath.c_str());
+
+        if (bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+            listen(listenFd, 64) != 0)
+        {
+            std::perror(m_socketPath.c_str());
+            close(listenFd);
+            return 1;
+        }
+
+        std::cout << "gvoid: serving on " << m_socketPath << " (cache " << m_cacheDir << ")" << std::endl;
+
+        while (true)
+        {
+            int clientFd = accept(listenFd, nullptr, nullptr);
+            if (clientFd < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                std::perror("accept");
+                break;
+            }
+
+            std::thread([this, clientFd]
+                        {
+                serve(clientFd);
+                close(clientFd); })
+                .detach();
+        }
+
+        close(listenFd);
+        unlink(m_socketPath.c_str());
+        return 1;
+    }
+
+private:
+    static constexpr uintmax_t CACHE_BYTES = uintmax_t(1) << 30;
+    static constexpr size_t MAX_SOURCES = 1024;
+
+    struct Entry
+    {
+        std::mutex mutex;
+        uint64_t sourceHash = 0;
+        std::string exe;
+        uint64_t lastUse = 0;
+    };
+
+    // An executable in the cache directory and its place in m_lru.
+    struct Cached
+    {
+        std::list<std::string>::iterator position;
+        uintmax_t size;
+    };
+
+    std::string m_socketPath;
+    CompileOptions m_options;
+    std::string m_cacheDir;
+    std::mutex m_entriesMutex;
+    std::unordered_map<std::string, std::shared_ptr<Entry>> m_entries;
+    uint64_t m_uses = 0;
+    std::mutex m_cacheMutex;
+    std::list<std::string> m_lru; // least recently used first
+    std::unordered_map<std::string, Cached> m_cached;
+    uintmax_t m_cachedBytes = 0;
+
+    // Takes over the executables a previous server left, oldest first.
+    void loadCache()
+    {
+        namespace fs = std::filesystem;
+
+        std::vector<std::pair<fs::file_time_type, std::string>> found;
+        std::error_code ec;
+        for (const auto &file : fs::directory_iterator(m_cacheDir, ec))
+        {
+            std::string name = file.path().filename().string();
+            if (name.size() == 16 && name.find_first_not_of("0123456789abcdef") == std::string::npos &&
+                file.is_regular_file(ec))
+                found.emplace_back(file.last_write_time(ec), file.path().string());
+        }
+        std::sort(found.begin(), found.end());
+        for (const auto &[time, exe] : found)
+        {
+            touch(exe);
+        }
+    }
+
+    // Marks `exe` as just used, then removes the least recently used other
+    // executables while the cache is over CACHE_BYTES.
+    void touch(const std::string &exe)
+    {
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        auto it = m_cached.find(exe);
+        if (it != m_cached.end())
+        {
+            m_lru.splice(m_lru.end(), m_lru, it->second.position);
+        }
+        else
+        {
+            std::error_code ec;
+            uintmax_t size = std::filesystem::file_size(exe, ec);
+            if (ec)
+                return;
+            m_lru.push_back(exe);
+            m_cached[exe] = {std::prev(m_lru.end()), size};
+            m_cachedBytes += size;
+        }
+
+        while (m_cachedBytes > CACHE_BYTES && m_lru.front() != exe)
+        {
+            auto oldest = m_cached.find(m_lru.front());
+            m_cachedBytes -= oldest->second.size;
+            std::remove(oldest->first.c_str());
+            m_cached.erase(oldest);
+            m_lru.pop_front();
+        }
+    }
+
+    void serve(int fd)
+    {
+        std::string request;
+        char c;
+        while (read(fd, &c, 1) == 1 && c != '\n')
+        {
+            request += c;
+        }
+
+        size_t space = request.find(' ');
+        std::string verb = request.substr(0, space);
+        if (space == std::string::npos || (verb != "compile" && verb != "run"))
+        {
+            sendAll(fd, "error unknown request\n");
+            return;
+        }
+
+        std::string reply;
+        try
+        {
+            reply = compile(request.substr(space + 1), fd);
+        }
+        catch (const std::filesystem::filesystem_error &error)
+        {
+            reply = std::string("error ") + error.what();
+        }
+        sendAll(fd, reply + "\n");
+    }
+
+    std::shared_ptr<Entry> entryFor(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(m_entriesMutex);
+        auto &entry = m_entries[path];
+        if (!entry)
+        {
+            entry = std::make_shared<Entry>();
+        }
+        entry->lastUse = ++m_uses;
+        std::shared_ptr<Entry> found = entry;
+
+        if (m_entries.size() > MAX_SOURCES)
+        {
+            auto oldest = std::min_element(m_entries.begin(), m_entries.end(), [](const auto &a, const auto &b)
+                                           { return a.second->lastUse < b.second->lastUse; });
+            m_entries.erase(oldest);
+        }
+        return found;
+    }
+
+    std::string compile(const std::string &requestPath, int clientFd)
+    {
+        namespace fs = std::filesystem;
+
+        std::string path = fs::absolute(requestPath).lexically_normal().string();
+        auto entry = entryFor(path);
+        std::lock_guard<std::mutex> lock(entry->mutex);
+
+        std::string source;
+        if (!readSource(path, source))
+        {
+            return "error cannot open " + path;
+        }
+
+        uint64_t sourceHash = fnv1a(source);
+        std::error_code ec;
+        if (sourceHash == entry->sourceHash && fs::exists(entry->exe, ec))
+        {
+            touch(entry->exe);
+            return "ok " + entry->exe;
+        }
+
+        std::string code;
+        try
+        {
+            AST::StmtList ast = parseSource(source, m_options);
+            Generator generator(ast, m_options.optimize);
+            code = generator.generate();
+        }
+        catch (const std::runtime_error &error)
+        {
+            entry->sourceHash = 0;
+            return std::string("error ") + error.what();
+        }
+
+        std::string exe = m_cacheDir + "/" + toHex(fnv1a(code));
+        if (!fs::exists(exe, ec))
+        {
+            // unique scratch names, then an atomic rename into the cache
+            std::string scratch = exe + "." + std::to_string(clientFd) + "." +
+                                  std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+            std::string cppFile = scratch + ".cxx";
+            if (!writeOutput(cppFile, code))
+            {
+                return "error cannot write " + cppFile;
+            }
+
+            int status = runProcess(compilerCommand(cppFile, scratch, m_options), clientFd);
+            std::remove(cppFile.c_str());
+            if (status != 0)
+            {
+                std::remove(scratch.c_str());
+                entry->sourceHash = 0;
+                return "error " + m_options.compiler + " failed";
+            }
+            fs::rename(scratch, exe, ec);
+            if (ec)
+            {
+                std::remove(scratch.c_str());
+                entry->sourceHash = 0;
+                return "error cannot store " + exe + ": " + ec.message();
+            }
+        }
+
+        touch(exe);
+        entry->sourceHash = sourceHash;
+        entry->exe = exe;
+        return "ok " + exe;
+    }
+};
+
+// `gvoid client compile|run <file>`: asks a running server to build the file.
+inline int clientCommand(const std::string &socketPath, const std::string &verb, const std::string &path)
+{
+    if (!checkSocketDirectory(socketPath))
+        return 1;
+    int fd = connectTo(socketPath);
+    if (fd < 0)
+    {
+        std::cerr << "Cannot connect to gvoid server at " << socketPath << "\n";
+        return 1;
+    }
+
+    std::error_code ec;
+    std::string absolute = std::filesystem::absolute(path, ec).string();
+    if (ec)
+    {
+        std::cerr << "Cannot resolve " << path << ": " << ec.message() << "\n";
+        close(fd);
+        return 1;
+    }
+    sendAll(fd, verb + " " + absolute + "\n");
+    shutdown(fd, SHUT_WR);
+
+    std::string reply;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        reply.append(buffer, static_cast<size_t>(n));
+    }
+    close(fd);
+
+    while (!reply.empty() && reply.back() == '\n')
+    {
+        reply.pop_back();
+    }
+    size_t lineStart = reply.rfind('\n');
+    std::string status = lineStart == std::string::npos ? reply : reply.substr(lineStart + 1);
+    if (lineStart != std::string::npos)
+    {
+        std::cerr << reply.substr(0, lineStart + 1);
+    }
+
+    if (status.rfind("ok ", 0) != 0)
+    {
+        std::cerr << status << "\n";
+        return 1;
+    }
+
+    std::string exe = status.substr(3);
+    if (verb == "run")
+    {
+        return runProcess({exe});
+    }
+
+    std::cout << exe << "\n";
+    return 0;
+}
+
+#endif
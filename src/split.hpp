@@ -0,0 +1,140 @@
+#pragma once
+
+#include "driver.hpp"
+#include "jobserver.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <numeric>
+
+/*
+Builds one program as several translation units compiled in parallel.
+
+Functions are spread over `units` files by size (largest first onto the
+least loaded unit) so the backend compiles take about the same time; the
+globals and main() get a unit of their own. Every unit includes one shared
+header with the prototypes and extern globals.
+*/
+class SplitBuilder
+{
+public:
+    SplitBuilder(std::string workDir, size_t units, CompileOptions options, JobSlots &slots)
+        : m_workDir(std::move(workDir)), m_units(std::max<size_t>(1, units)),
+          m_options(std::move(options)), m_slots(slots) {}
+
+    bool build(const AST::StmtList &ast, const std::string &exeFile, std::string &error)
+    {
+        namespace fs = std::filesystem;
+
+        std::error_code ec;
+        fs::create_directories(m_workDir, ec);
+
+        Generator generator(ast, m_options.optimize);
+        std::vector<std::string> sources = {generator.generateHeader()};
+        if (!writeOutput(m_workDir + "/" + HEADER_NAME, sources[0]))
+        {
+            error = "cannot write to " + m_workDir;
+            return false;
+        }
+        sources[0] = generator.generateMainUnit(HEADER_NAME);
+
+        std::vector<std::string> definitions;
+        for (const auto &stmt : ast)
+        {
+            if (auto func = dynamic_cast<const AST::FunctionStmt *>(stmt.get()))
+            {
+                definitions.push_back(generator.generateFunctionDefinition(*func));
+            }
+        }
+
+        for (const auto &unit : partition(definitions))
+        {
+            std::string code = "#include \"" + std::string(HEADER_NAME) + "\"\n\n";
+            for (size_t index : unit)
+            {
+                code += definitions[index];
+            }
+            sources.push_back(std::move(code));
+        }
+
+        ThreadPool pool(sources.size());
+        std::vector<std::future<bool>> compiled;
+        std::vector<std::string> objects;
+
+        for (size_t i = 0; i < sources.size(); ++i)
+        {
+            std::string base = m_workDir + "/unit" + std::to_string(i);
+            objects.push_back(base + ".o");
+
+            compiled.push_back(pool.submit([this, base, &sources, i]
+                                           {
+                if (!writeOutput(base + ".cxx", sources[i]))
+                    return false;
+
+                auto slot = m_slots.acquire();
+                int status = runProcess(objectCommand(base + ".cxx", base + ".o", m_options));
+                m_slots.release(slot);
+                return status == 0; }));
+        }
+
+        bool ok = true;
+        for (auto &result : compiled)
+        {
+            ok = result.get() && ok;
+        }
+
+        if (ok)
+        {
+            auto slot = m_slots.acquire();
+            ok = runProcess(linkCommand(objects, exeFile, m_options)) == 0;
+            m_slots.release(slot);
+            if (!ok)
+                error = m_options.compiler + " failed to link " + exeFile;
+        }
+        else
+        {
+            error = m_options.compiler + " failed on a unit in " + m_workDir;
+        }
+
+        if (ok)
+        {
+            fs::remove_all(m_workDir, ec);
+        }
+        return ok;
+    }
+
+private:
+    static constexpr const char *HEADER_NAME = "program.hpp";
+
+    std::string m_workDir;
+    size_t m_units;
+    CompileOptions m_options;
+    JobSlots &m_slots;
+
+    // Greedy longest-processing-time partition; each unit keeps its functions
+    // in source order so the output is deterministic.
+    std::vector<std::vector<size_t>> partition(const std::vector<std::string> &definitions) const
+    {
+        size_t count = std::min(m_units, definitions.size());
+        std::vector<std::vector<size_t>> units(count);
+        std::vector<size_t> load(count, 0);
+
+        std::vector<size_t> order(definitions.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                         { return definitions[a].size() > definitions[b].size(); });
+
+        for (size_t index : order)
+        {
+            size_t target = std::min_element(load.begin(), load.end()) - load.begin();
+            units[target].push_back(index);
+            load[target] += definitions[index].size();
+        }
+
+        for (auto &unit : units)
+        {
+            std::sort(unit.begin(), unit.end());
+        }
+        return units;
+    }
+};
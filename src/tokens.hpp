@@ -13,6 +13,13 @@ enum class TokenType
     KEYWORD_VAR_NUM, // num
     KEYWORD_VAR_STR, // str
     KEYWORD_VAR_ARR, // arr<num or str> 
+    KEYWORD_VAR_I32, // i32
+    KEYWORD_VAR_I64, // i64
+    KEYWORD_VAR_F32, // f32
+    KEYWORD_VAR_F64, // f64
+    KEYWORD_VAR_BOOL, // bool
+    KEYWORD_VAR_CHAN, // chan<num or str>
+    KEYWORD_VAR_VIEW, // str_view
     ARROW_RIGHT,
     ARROW_LEFT,
     FUNCTION,
@@ -23,16 +30,22 @@ enum class TokenType
     WHILE,
     DO,
     FOR,
+    PFOR,
+    SPAWN,
+    AWAIT,
+    YIELD,
     BREAK,
     CONTINUE,
 
     //--(Literals
     STRING_LIT,
+    FSTRING_LIT, // f"...{expr}...", unparsed
     NUMBER,
     IDENTIFIER,
 
     //--(Symbols & Operators
     SEMICOLON, // ;
+    COLON,     // :
     COMMA,     // ,
     ASSIGN,    // =
     PLUS,      // +
@@ -100,6 +113,20 @@ inline std::string to_string(const TokenType token)
         return "str";
     case TokenType::KEYWORD_VAR_ARR:
         return "arr";
+    case TokenType::KEYWORD_VAR_I32:
+        return "i32";
+    case TokenType::KEYWORD_VAR_I64:
+        return "i64";
+    case TokenType::KEYWORD_VAR_F32:
+        return "f32";
+    case TokenType::KEYWORD_VAR_F64:
+        return "f64";
+    case TokenType::KEYWORD_VAR_BOOL:
+        return "bool";
+    case TokenType::KEYWORD_VAR_CHAN:
+        return "chan";
+    case TokenType::KEYWORD_VAR_VIEW:
+        return "str_view";
     case TokenType::FUNCTION:
         return "func";
     case TokenType::IMPORT:
@@ -124,12 +151,22 @@ inline std::string to_string(const TokenType token)
         return "do";
     case TokenType::FOR:
         return "for";
+    case TokenType::PFOR:
+        return "pfor";
+    case TokenType::SPAWN:
+        return "spawn";
+    case TokenType::AWAIT:
+        return "await";
+    case TokenType::YIELD:
+        return "yield";
     case TokenType::BREAK:
         return "break";
     case TokenType::CONTINUE:
         return "continue";
     case TokenType::STRING_LIT:
         return "string_lit";
+    case TokenType::FSTRING_LIT:
+        return "fstring_lit";
     case TokenType::NUMBER:
         return "number";
     case TokenType::IDENTIFIER:
@@ -138,6 +175,8 @@ inline std::string to_string(const TokenType token)
         return "$";
     case TokenType::SEMICOLON:
         return ";";
+    case TokenType::COLON:
+        return ":";
     case TokenType::COMMA:
         return ",";
     case TokenType::ASSIGN:
@@ -180,6 +219,8 @@ inline std::string to_string(const TokenType token)
         return "&&";
     case TokenType::STREAM_OUT:
         return "<<";
+    case TokenType::STREAM_IN:
+        return ">>";
     case TokenType::PLUS_EQ:
         return "+=";
     case TokenType::MINUS_EQ: